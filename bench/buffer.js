@@ -0,0 +1,16 @@
+/**
+ * Buffer allocation, indexed access, copy, slice and conversion to string.
+ */
+require("http"); /* global request/response, as in a FastCGI page */
+var Buffer = require("binary").Buffer;
+
+var b = new Buffer(64 * 1024);
+for (var i=0;i<b.length;i++) { b[i] = i & 0x7F; }
+
+var copy = new Buffer(b.length);
+b.copy(copy);
+
+var sum = 0;
+for (var i=0;i<copy.length;i+=64) { sum += copy.slice(i, i+64).toString("ascii").length; }
+
+response.write(sum + " bytes");
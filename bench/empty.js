@@ -0,0 +1,5 @@
+/**
+ * Smallest possible page: measures the request cycle itself.
+ */
+require("http"); /* global request/response, as in a FastCGI page */
+response.write("");
@@ -0,0 +1,14 @@
+/**
+ * The json.js workload with the native "json" module instead of the built-in JSON:
+ * serialized straight into a Buffer and parsed back from it.
+ */
+require("http"); /* global request/response, as in a FastCGI page */
+var json = require("json");
+var records = [];
+for (var i=0;i<1000;i++) {
+	records.push({id:i, name:"record " + i, tags:["a", "b", "c"], active:!!(i % 2), score:i / 7});
+}
+
+var buffer = json.stringify({records:records});
+var parsed = json.parse(buffer);
+response.write(parsed.records.length + " records, " + buffer.length + " bytes");
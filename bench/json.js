@@ -0,0 +1,13 @@
+/**
+ * JSON serialization and parsing of a 1000-record structure with the built-in JSON;
+ * json-native.js does the same with the native "json" module.
+ */
+require("http"); /* global request/response, as in a FastCGI page */
+var records = [];
+for (var i=0;i<1000;i++) {
+	records.push({id:i, name:"record " + i, tags:["a", "b", "c"], active:!!(i % 2), score:i / 7});
+}
+
+var str = JSON.stringify({records:records});
+var parsed = JSON.parse(str);
+response.write(parsed.records.length + " records, " + str.length + " chars");
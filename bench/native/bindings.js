@@ -0,0 +1,137 @@
+/**
+ * Per-call cost of native binding patterns and of typical native calls.
+ * Prints one JSON object per case; ns_per_call excludes the loop and the
+ * cost of a plain native call (microbench.noop), reported as "call".
+ *
+ * Run with "make microbench". Set TEAJS_BENCH_PGSQL to a libpq connection
+ * string to include pgsql.fetchAll.
+ */
+var Buffer = require("binary").Buffer;
+var mb = require("microbench");
+
+var CALLS = 1000000;
+var overhead = 0;
+
+var time = function(count, f) {
+	f(Math.min(count, 1000)); /* warm up the call site */
+	var start = system.getTimeInMicroseconds();
+	f(count);
+	return (system.getTimeInMicroseconds() - start) * 1000 / count;
+}
+
+var report = function(name, count, ns, extra) {
+	var result = {bench:name, calls:count, ns_per_call:Math.round(ns * 10) / 10};
+	for (var p in extra) { result[p] = extra[p]; }
+	system.stdout.writeLine(JSON.stringify(result));
+}
+
+var bench = function(name, count, f) {
+	try {
+		report(name, count, Math.max(0, time(count, f) - overhead));
+	} catch (e) {
+		report(name, 0, 0, {skipped:String(e)});
+	}
+}
+
+/* setup() runs outside the timed calls; its result is passed to f and then closed */
+var fixture = function(name, count, setup, f) {
+	var state;
+	try {
+		state = setup();
+	} catch (e) {
+		report(name, 0, 0, {skipped:String(e)});
+		return;
+	}
+	bench(name, count, function(n) { f(n, state); });
+	state.close();
+}
+
+/* loop without a call, then a call which does nothing */
+var loop = time(CALLS, function(n) { for (var i=0;i<n;i++) {} });
+overhead = time(CALLS, function(n) { for (var i=0;i<n;i++) { mb.noop(); } }) - loop;
+report("call", CALLS, overhead);
+overhead += loop;
+
+/* binding patterns */
+var probe = new mb.Probe();
+bench("LOAD_PTR", CALLS, function(n) { for (var i=0;i<n;i++) { probe.loadPtr(); } });
+bench("GC_PTR", CALLS, function(n) { for (var i=0;i<n;i++) { mb.gcptr(); } });
+bench("JS_INT", CALLS, function(n) { for (var i=0;i<n;i++) { mb.int(i); } });
+bench("JS_STR", CALLS, function(n) { for (var i=0;i<n;i++) { mb.str(); } });
+bench("JS_STR_LEN", CALLS, function(n) { for (var i=0;i<n;i++) { mb.strlen(); } });
+
+var ascii = "hello world";
+var long = new Array(101).join("0123456789");
+var wide = new Array(101).join("příliš ");
+bench("Utf8Value short", CALLS, function(n) { for (var i=0;i<n;i++) { mb.utf8(ascii); } });
+bench("Utf8Value 1kB", CALLS, function(n) { for (var i=0;i<n;i++) { mb.utf8(long); } });
+bench("Utf8Value non-ascii", CALLS, function(n) { for (var i=0;i<n;i++) { mb.utf8(wide); } });
+
+var b = new Buffer(256);
+b.fill(1);
+bench("IS_BUFFER", CALLS, function(n) { for (var i=0;i<n;i++) { mb.isBuffer(b); } });
+bench("JS_BUFFER_TO_CHAR", CALLS, function(n) { for (var i=0;i<n;i++) { mb.bufferData(b); } });
+bench("JS_BUFFER 64B", CALLS, function(n) { for (var i=0;i<n;i++) { mb.buffer(); } });
+
+/* indexed interceptors; interceptor calls are not counted as function calls, so only the loop is subtracted */
+var interceptor = function(name, f) {
+	var saved = overhead;
+	overhead = loop;
+	bench(name, CALLS, f);
+	overhead = saved;
+}
+interceptor("Buffer_get", function(n) { var x = 0; for (var i=0;i<n;i++) { x += b[i & 0xFF]; } });
+interceptor("Buffer_set", function(n) { for (var i=0;i<n;i++) { b[i & 0xFF] = i; } });
+var indexed = new mb.Indexed();
+interceptor("ByteArray _get", function(n) { var x = 0; for (var i=0;i<n;i++) { x += indexed[i & 0xFF]; } });
+interceptor("ByteArray _set", function(n) { for (var i=0;i<n;i++) { indexed[i & 0xFF] = i; } });
+
+/* typical calls */
+fixture("socket.send", 100000, function() {
+	var Socket = require("socket").Socket;
+	var port = 20000 + (system.getpid() % 20000);
+	var server = new Socket(Socket.PF_INET, Socket.SOCK_DGRAM, Socket.IPPROTO_UDP);
+	server.bind("127.0.0.1", port);
+	var client = new Socket(Socket.PF_INET, Socket.SOCK_DGRAM, Socket.IPPROTO_UDP);
+	return {client:client, port:port, data:new Buffer(64), close:function() { client.close(); server.close(); }};
+}, function(n, s) {
+	/* never read: once the receive buffer is full the kernel drops datagrams, send still succeeds */
+	for (var i=0;i<n;i++) { s.client.send(s.data, "127.0.0.1", s.port); }
+});
+
+fixture("fs.File.read 4kB", 100000, function() {
+	var fs = require("fs");
+	var f = new fs.File("microbench_" + system.getpid());
+	f.open("wb").write(new Buffer(4096)).close();
+	f.open("rb");
+	return {file:f, close:function() { f.close(); f.remove(); }};
+}, function(n, s) {
+	for (var i=0;i<n;i++) {
+		s.file.read(4096);
+		s.file.rewind();
+	}
+});
+
+fixture("pgsql.fetchAll 100x4", 10000, function() {
+	if (!system.env.TEAJS_BENCH_PGSQL) { throw new Error("TEAJS_BENCH_PGSQL not set"); }
+	var pgsql = require("pgsql");
+	var db = new pgsql.PostgreSQL();
+	db.connect(system.env.TEAJS_BENCH_PGSQL);
+	var result = db.query("select i, i * 2 as double, 'row ' || i as name, i % 2 = 0 as even from generate_series(1, 100) as i");
+	return {result:result, close:function() { result.clear(); db.close(); }};
+}, function(n, s) {
+	for (var i=0;i<n;i++) { s.result.fetchAll(); }
+});
+
+fixture("xdom parse 100 elements", 10000, function() {
+	var xdom = require("xdom");
+	var items = [];
+	for (var i=0;i<100;i++) { items.push("<item id=\"" + i + "\">value " + i + "</item>"); }
+	return {
+		parser: xdom.DOMImplementationRegistry.getDOMImplementation("LS").createLSParser(1),
+		xml: "<?xml version=\"1.0\"?><list>" + items.join("") + "</list>",
+		close: function() {}
+	};
+}, function(n, s) {
+	for (var i=0;i<n;i++) { s.parser.parse(s.xml); }
+});
@@ -0,0 +1,13 @@
+/**
+ * Page pulling in many modules: measures module resolution, compilation and native init.
+ */
+require("http"); /* global request/response, as in a FastCGI page */
+var modules = ["fs", "binary", "socket", "template", "sprintf", "assert", "html", "base64", "hash", "getopt", "query", "session"];
+var count = 0;
+for (var i=0;i<modules.length;i++) {
+	try {
+		require(modules[i]);
+		count++;
+	} catch (e) {}
+}
+response.write(count + " modules");
@@ -0,0 +1,13 @@
+/**
+ * Template rendering of a 100-row table.
+ */
+require("http"); /* global request/response, as in a FastCGI page */
+var Template = require("template").Template;
+
+var source = "<table>$code( for (var i=0;i<data.rows.length;i++) { var row = data.rows[i]; )" +
+	"<tr><td>$(row.id)</td><td>$(row.name)</td><td>$(row.price)</td></tr>$code( } )</table>";
+
+var rows = [];
+for (var i=0;i<100;i++) { rows.push({id:i, name:"item " + i, price:(i * 1.5).toFixed(2)}); }
+
+response.write(new Template().processString(source, {rows:rows}));
@@ -0,0 +1,13 @@
+/**
+ * Compression and decompression of 64kB of text.
+ */
+require("http"); /* global request/response, as in a FastCGI page */
+var Buffer = require("binary").Buffer;
+var zlib = require("zlib");
+
+var text = [];
+for (var i=0;i<2048;i++) { text.push("line " + i + " of the benchmark input"); }
+var input = new Buffer(text.join("\n").substring(0, 64 * 1024), "utf-8");
+
+var output = zlib.decompress(zlib.compress(input));
+response.write(output.length + " bytes");
@@ -2,6 +2,7 @@
  * Currently only supports MySQL
  */
 var sprintf = require("./sprintf").sprintf;
+var queryFilter = require("./query").filter; /* native, when lib/query.so is built */
 
 /* ***** BEGIN LICENSE BLOCK *****
  * 
@@ -3715,11 +3716,17 @@ ActiveSupport.extend(Adapters.InMemory.prototype,{
         }
         if(typeof(where) === 'string')
         {
+            var where_parser = new WhereParser();
+            var abstract_syntax_tree = where_parser.parse(where);
+            var program = (queryFilter && abstract_syntax_tree ? abstract_syntax_tree.toProgram() : null);
             return function json_result_where_processor(result_set)
             {
-                var response = [];
-                var where_parser = new WhereParser();
-                var abstract_syntax_tree = where_parser.parse(where);
+                var response = (program ? queryFilter(result_set, program) : null);
+                if (response)
+                {
+                    return response;
+                }
+                response = [];
                 for(var i = 0; i < result_set.length; ++i)
                 {
                     if(abstract_syntax_tree.execute(result_set[i],Adapters.InMemory.method_call_handler))
@@ -4252,6 +4259,54 @@ BinaryOperatorNode.prototype.execute = function execute(row, functionProvider)
     return result;
 };
 
+/*
+ * toProgram
+ * 
+ * Nested array form evaluated by the native filter() of the query module;
+ * null when some part of the expression cannot be expressed that way.
+ */
+BinaryOperatorNode.prototype.toProgram = function toProgram()
+{
+    var lhs = this.lhs.toProgram();
+    if (!lhs)
+    {
+        return null;
+    }
+
+    if (this.operator == IN)
+    {
+        var items = [];
+        for (var i = 0; i < this.rhs.length; i++)
+        {
+            var item = this.rhs[i].toProgram();
+            if (!item)
+            {
+                return null;
+            }
+            items.push(item);
+        }
+        return ["in", lhs, items];
+    }
+
+    var rhs = this.rhs.toProgram();
+    if (!rhs)
+    {
+        return null;
+    }
+    switch (this.operator)
+    {
+        case EQUAL:                 return ["=", lhs, rhs];
+        case NOT_EQUAL:             return ["!=", lhs, rhs];
+        case LESS_THAN:             return ["<", lhs, rhs];
+        case LESS_THAN_EQUAL:       return ["<=", lhs, rhs];
+        case GREATER_THAN:          return [">", lhs, rhs];
+        case GREATER_THAN_EQUAL:    return [">=", lhs, rhs];
+        case AND:                   return ["and", lhs, rhs];
+        case OR:                    return ["or", lhs, rhs];
+        default:                    return null;
+    }
+};
+
 // Identifer node
 
 /*
@@ -4275,6 +4330,11 @@ IdentifierNode.prototype.execute = function execute(row, functionProvider)
     return row[this.identifier];
 };
 
+IdentifierNode.prototype.toProgram = function toProgram()
+{
+    return ["col", this.identifier];
+};
+
 // Function node
 
 /*
@@ -4309,6 +4369,11 @@ FunctionNode.prototype.execute = function execute(row, functionProvider)
     return functionProvider(this.name, row, args);
 };
 
+FunctionNode.prototype.toProgram = function toProgram()
+{
+    return null;
+};
+
 // Scalar node
 
 /*
@@ -4330,6 +4395,11 @@ ScalarNode.prototype.execute = function execute(row, functionProvider)
     return this.value;
 };
 
+ScalarNode.prototype.toProgram = function toProgram()
+{
+    return ["val", this.value];
+};
+
 
 // Parser class
 
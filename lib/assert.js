@@ -121,3 +121,5 @@ exports.notDeepEqual = notDeepEqual;
 exports.strictEqual = strictEqual;
 exports.notStrictEqual = notStrictEqual;
 exports.throws = throws;
+
+module.persistent = true; /* no request state; may be kept across requests */
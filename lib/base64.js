@@ -46,43 +46,15 @@ function encode_any(input,cfg)
 	return output;
 }
 
-function decode_any(input,cfg,allow_end)
+/* native codecs in the binary module: bytes go straight to characters, no per-byte JS */
+function to_string(input)
 {
-	if (!(input instanceof Buffer)) { input = new Buffer(input, "utf-8"); }
-	var alphabetBuffer=cfg.alphabetBuffer;
-
-	var output = new Buffer(Math.ceil(3 * input.length / 4));
-	var chr1, chr2, chr3, enc1, enc2, enc3, enc4;
-	var i=0, j=0;
-	
-	try {
-
-		do {
-			enc1 = (input.length<=i && allow_end)?64:alphabetBuffer.indexOf(input[i++]);
-			enc2 = (input.length<=i && allow_end)?64:alphabetBuffer.indexOf(input[i++]);
-			enc3 = (input.length<=i && allow_end)?64:alphabetBuffer.indexOf(input[i++]);
-			enc4 = (input.length<=i && allow_end)?64:alphabetBuffer.indexOf(input[i++]);
-
-			chr1 = (enc1 << 2) | (enc2 >> 4);
-			chr2 = ((enc2 & 15) << 4) | (enc3 >> 2);
-			chr3 = ((enc3 & 3) << 6) | enc4;
-
-			output[j++] = chr1;
-			
-			if (enc3 != 64) { output[j++] = chr2; }
-			if (enc4 != 64) { output[j++] = chr3; }
-		} while (i < input.length);
-
-	} catch (e) {
-		throw new Error("Malformed base64 sequence at char " + i);
-	}
-
-	output = output.range(0, j);
-	return output;
+	return (input instanceof Buffer ? input.toString("utf-8") : input);
 }
 
 exports.encode = function(input) {
-	return encode_any(input,config.base64);
+	if (!(input instanceof Buffer)) { input = new Buffer(input, "utf-8"); }
+	return new Buffer(input.toString("base64"), "utf-8");
 };
 
 exports.encode_url = function(input) {
@@ -90,9 +62,9 @@ exports.encode_url = function(input) {
 };
 
 exports.decode = function(input) {
-	return decode_any(input,config.base64,false);
+	return new Buffer(to_string(input), "base64");
 };
 
 exports.decode_url = function(input) {
-	return decode_any(input,config.base64url,true);
+	return new Buffer(to_string(input), "base64url");
 };
@@ -1,4 +1,6 @@
 var Socket = require("socket").Socket;
+var Poller = Socket.Poller;
+var poller = null; /* persistent interest set, created lazily */
 
 var eventCount = 0;
 var lastId = 0;
@@ -8,6 +10,7 @@ var events = { /* all scheduled events */
 	time: {},
 	socket: {}
 }; 
+var sockets = new Map(); /* socket => {socket, tls, reads, writes, read, write, want, mask, listeners}, the per-socket index of events.socket */
 
 /* ---- private ---- */
 
@@ -28,27 +31,98 @@ var addSocketListener = function(callback, socket, read) {
 	eventCount++;
 	var id = lastId++;
 
-	events.socket[id] = {
+	var entry = sockets.get(socket);
+	if (!entry) {
+		entry = {socket:socket, tls:(typeof(socket.want) == "function"), reads:0, writes:0, read:false, write:false, want:0, mask:0, listeners:{}};
+		sockets.set(socket, entry);
+	}
+	var item = {
 		callback: callback,
 		socket: socket,
-		read: read
+		read: read,
+		entry: entry
 	}
+	events.socket[id] = item;
+	entry.listeners[id] = item;
+	entry[read ? "reads" : "writes"]++;
+	updateInterest(entry);
 
 	return id;
 }
 
-var processSockets = function(read, write) {
-	for (var id in events.socket) {
-		var item = events.socket[id];
-		if (
-			(item.read && read.indexOf(item.socket) != -1) /* readable */
-			||
-			(!item.read && write.indexOf(item.socket) != -1) /* writeable */
-			) {
-				
-			item.callback(item.socket);
+var removeSocketListener = function(id) {
+	var item = events.socket[id];
+	var entry = item.entry;
+	delete events.socket[id];
+	delete entry.listeners[id];
+	eventCount--;
+	entry[item.read ? "reads" : "writes"]--;
+	if (!entry.reads && !entry.writes) { sockets.delete(entry.socket); }
+	updateInterest(entry);
+}
+
+/**
+ * Recompute the combined interest of a socket's listeners and register it with the poller, when it changed.
+ * A TLS object whose last operation returned false waits for what its want() asks for instead:
+ * a receive may need the socket to be writable and a send may need it to be readable.
+ */
+var updateInterest = function(entry) {
+	entry.read = (entry.reads > 0);
+	entry.write = (entry.writes > 0);
+	entry.want = 0;
+	if (entry.tls && (entry.read || entry.write)) {
+		var want = entry.socket.want();
+		var TLS = entry.socket.constructor;
+		if (want == TLS.WANT_READ || want == TLS.WANT_WRITE) {
+			entry.want = want;
+			entry.read = (want == TLS.WANT_READ);
+			entry.write = !entry.read;
 		}
 	}
+
+	if (!Poller) { return; }
+	if (!poller) { poller = new Poller(); }
+
+	var mask = (entry.read ? Poller.READ : 0) | (entry.write ? Poller.WRITE : 0);
+	if (mask == entry.mask) { return; }
+	entry.mask = mask;
+	try {
+		poller.set(entry.socket, mask);
+	} catch (e) {} /* socket already closed */
+}
+
+/**
+ * Call listeners of a socket whose interest is satisfied; failed = error or hangup, wakes everybody.
+ * While a TLS object waits for want(), any readiness wakes everybody: they repeat their operation.
+ */
+var dispatch = function(socket, read, write, failed) {
+	var entry = sockets.get(socket);
+	if (!entry) { return; }
+	var all = failed || entry.want;
+	for (var id in entry.listeners) {
+		var item = entry.listeners[id];
+		if (all || (item.read ? read : write)) { item.callback(item.socket); }
+	}
+	/* the callbacks changed what TLS waits for */
+	if (entry.tls && sockets.get(socket) === entry) { updateInterest(entry); }
+}
+
+var processSockets = function(read, write) {
+	/* Socket.select() leaves holes where sockets were not ready */
+	for (var i=0;i<read.length;i++) {
+		if (i in read) { dispatch(read[i], true, false, false); }
+	}
+	for (var i=0;i<write.length;i++) {
+		if (i in write) { dispatch(write[i], false, true, false); }
+	}
+}
+
+var processReady = function(ready) {
+	var failed = Poller.ERROR | Poller.HANGUP;
+	for (var i=0;i<ready.length;i++) {
+		var mask = ready[i].events;
+		dispatch(ready[i].socket, mask & Poller.READ, mask & Poller.WRITE, mask & failed);
+	}
 }
 
 var processTime = function() {
@@ -91,11 +165,23 @@ exports.run = function(maxTime) {
 		}
 		if (timeout == 1/0) { timeout = null; }
 		
-		/* prepare socket arrays */
-		for (var id in events.socket) {
-			var item = events.socket[id];
-			(item.read ? read : write).push(item.socket);
+		if (poller) {
+			try {
+				var ready = poller.wait(timeout);
+			} catch (e) {
+				break;
+			}
+
+			processTime();
+			processReady(ready);
+			continue;
 		}
+
+		/* prepare socket arrays */
+		sockets.forEach(function(entry) {
+			if (entry.read) { read.push(entry.socket); }
+			if (entry.write) { write.push(entry.socket); }
+		});
 		
 		try {
 			var result = Socket.select(read, write, null, timeout);
@@ -126,6 +212,11 @@ exports.clearTimeout = exports.clearInterval = function(id) {
 	}
 }
 
+/**
+ * @param {function} callback
+ * @param {Socket || TLS} socket A TLS object is polled for what its want() asks for;
+ * since it may hold decrypted data the socket does not signal, callbacks should receive until it returns false
+ */
 exports.readSocket = function(callback, socket) {
 	return addSocketListener(callback, socket, true);
 }
@@ -136,18 +227,11 @@ exports.writeSocket = function(callback, socket) {
 
 exports.clearSocket = function(id) {
 	if (typeof(id) == "number") { /* remove by ID */
-		if (id in events.socket) {
-			delete events.socket[id];
-			eventCount--;
-		}
+		if (id in events.socket) { removeSocketListener(id); }
 	} else { /* remove by socket */
-		for (var sid in events.socket) {
-			var item = events.socket[sid];
-			if (item.socket == id) { 
-				delete events.socket[sid];
-				eventCount--;
-			}
-		}
+		var entry = sockets.get(id);
+		if (!entry) { return; }
+		for (var sid in entry.listeners) { removeSocketListener(sid); }
 	}
 }
 
@@ -6,8 +6,23 @@
  */
 
 var Buffer = require("binary").Buffer;
+try {
+	var Crypto = require("crypto"); /* native digests, when built */
+} catch (e) {
+	var Crypto = null;
+}
+
+var native = function(algorithm, input) {
+	return Crypto.digest(algorithm, (input instanceof Buffer ? input : input.toString()), "hex");
+}
+
+exports.sha256 = function(input) {
+	if (!Crypto) { throw new Error("SHA-256 requires the crypto module"); }
+	return native("sha256", input);
+}
 
 exports.md5 = function(input) {
+	if (Crypto) { return native("md5", input); }
 	if (!(input instanceof Buffer)) { input = new Buffer(input.toString(), "utf-8"); }
 
 	var hexcase = 0;  /* hex output format. 0 - lowercase; 1 - uppercase        */
@@ -173,6 +188,7 @@ exports.md5 = function(input) {
 };
 
 exports.sha1 = function(input) {
+	if (Crypto) { return native("sha1", input); }
 	if (!(input instanceof Buffer)) { input = new Buffer(input.toString(), "utf-8"); }
 
 	var hexcase = 0;  /* hex output format. 0 - lowercase; 1 - uppercase        */
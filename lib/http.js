@@ -302,11 +302,12 @@ ClientRequest.send_parallel=function(arr)
 	var Socket = require("socket").Socket;
 	var ret=[];
 	var options=[];
-	// Sending
+	// Sending; TLS handshakes and request writes of all connections overlap
 	for (var i=0;i<arr.length;i++) {
-		options[i]=arr[i].send_only(arr[i]._follow);
+		options[i]=arr[i].send_only(arr[i]._follow, true);
 		options[i]._received=new Buffer(0);
 	}
+	ClientRequest._finish_pending(options);
 	// Receiving data
 	var flag=0;
 	while (!flag) {
@@ -343,12 +344,51 @@ ClientRequest.send_parallel=function(arr)
 	return ret;
 };
 
+/**
+ * Drive the TLS handshakes and request writes deferred by send_only(follow, true).
+ * A connection whose call returned false waits in select() for what its want()
+ * asks for, so one slow server does not hold up the others. The sockets are
+ * blocking again afterwards.
+ */
+ClientRequest._finish_pending = function (options) {
+	var Socket = require("socket").Socket;
+	var timeout = null;
+	for (var i=0;i<options.length;i++) {
+		if (options[i].timeout) { timeout = Math.max(timeout || 0, options[i].timeout * 1000); }
+	}
+	while (true) {
+		var read = [], write = [];
+		for (var i=0;i<options.length;i++) {
+			var el = options[i];
+			while (el.pending) {
+				if (el.connecting) {
+					if (el.socket.connect() === false) { break; }
+					el.connecting = false;
+				}
+				if (el.pending.length && el.socket.send(el.pending[0]) === false) { break; }
+				el.pending.shift();
+				if (!el.pending.length) {
+					el.pending = null;
+					el.socket.getSocket().setBlocking(true);
+				}
+			}
+			if (el.pending) { (el.socket.want() == el.socket.constructor.WANT_WRITE ? write : read).push(el.socket); }
+		}
+		if (!read.length && !write.length) { return; }
+		if (!Socket.select(read, write, null, timeout)) { throw new Error("TLS handshake timed out"); }
+	}
+}
+
 ClientRequest.prototype.send = function (follow) {
 	var _options=this.send_only(follow);
 	return this.recv_only(follow,_options);
 }
 
-ClientRequest.prototype.send_only = function (follow) {
+/**
+ * @param {bool} [deferred] https only: leave the TLS handshake and the request
+ * writes to ClientRequest._finish_pending(), which runs several at once
+ */
+ClientRequest.prototype.send_only = function (follow, deferred) {
 	var dd = new Date();
 	var Socket = require("socket").Socket;
 	var Buffer = require("binary").Buffer;
@@ -452,6 +492,17 @@ ClientRequest.prototype.send_only = function (follow) {
 		socket.setSNI(host);
 		socket.setCertificateCheck(this.certificateCheck);
 		socket.setTLSMethod(this.TLSMethod);
+		if (deferred) {
+			hiddenSocket.setBlocking(false);
+			var pending = [data];
+			if (post) { pending.push(post); }
+			return {
+				socket		:socket,
+				connecting	:true,
+				pending		:pending,
+				timeout		:this.timeout
+			};
+		}
 		socket.connect();
 		if (system.env.PRINT_DEBUGS == 1) {
 			system.stdout.writeLine('CONNECT TLS TIME = ' + (new Date() - dd));
@@ -10,6 +10,8 @@ var Query = function(type) {
 	this._offset = 0;
 	this._group = [];
 	this._having = [];
+	this._params = null; /* array while rendering with placeholders, see toParams() */
+	this._inlined = false; /* a %n literal went into the text, see toParams() */
 }
 
 Query.SELECT = 0;
@@ -18,9 +20,14 @@ Query.UPDATE = 2;
 Query.DELETE = 3;
 Query._relations = [];
 Query._db = null;
+Query._quote = "\"";
+Query.PREPARE_THRESHOLD = 2; /* executions of the same text before it is prepared server-side */
+Query.MAX_STATEMENTS = 256; /* prepared statements per connection */
+Query.MAX_USES = 1024; /* texts counted towards PREPARE_THRESHOLD per connection */
 
 Query.setDB = function(db) {
 	this._db = db;
+	this._quote = (db && db.qualify ? db.qualify("x").charAt(0) : "\"");
 }
 
 Query.addRelation = function(t1,f1,t2,f2) {
@@ -53,31 +60,24 @@ Query.prototype.table = function(name, jointype, joinfield) {
 
 Query.prototype.join = Query.prototype.table;
 
+/* Clauses keep their arguments and are rendered by toString(), so that the same query can produce inline or parametrized SQL */
 Query.prototype.field = function(fieldDef) {
-	var str = "";
-	if (arguments.length == 1) {
-		str = this._qualify(fieldDef);
-	} else {
-		str = this._expand.apply(this, arguments);
-	}
-	this._field.push(str);
+	this._field.push(arguments.length == 1 ? fieldDef : Array.prototype.slice.call(arguments));
 	return this;
 }
 
 Query.prototype.value = function(value, noescape) {
-	var val = value;
-	if (!noescape) { val = "'" + this._escape(val)+ "'"; }
-	this._value.push(val);
+	this._value.push({value:value, noescape:noescape});
 	return this;
 }
 
 Query.prototype.where = function(conditionDef) {
-	this._where.push(this._expand.apply(this, arguments));
+	this._where.push(Array.prototype.slice.call(arguments));
 	return this;
 }
 
 Query.prototype.order = function(fieldDef) {
-	this._order.push(this._expand.apply(this, arguments));
+	this._order.push(Array.prototype.slice.call(arguments));
 	return this;
 }
 
@@ -92,12 +92,12 @@ Query.prototype.offset = function(offset) {
 }
 
 Query.prototype.group = function(field) {
-	this._group.push(this._qualify(field));
+	this._group.push(field);
 	return this;
 }
 
 Query.prototype.having = function(conditionDef) {
-	this._having.push(this._expand.apply(this, arguments));
+	this._having.push(Array.prototype.slice.call(arguments));
 	return this;
 }
 
@@ -113,9 +113,63 @@ Query.prototype.toString = function() {
 	}
 }
 
+/**
+ * Render with $1, $2, ... placeholders instead of inline %s and value() data.
+ * Numbers (%n) stay inline: an untyped parameter would take the column type.
+ * @returns {object} {text:string, values:array, inlined:bool}, inlined = the text holds %n literals
+ */
+Query.prototype.toParams = function() {
+	this._params = [];
+	this._inlined = false;
+	try {
+		var text = this.toString();
+		return {text:text, values:this._params, inlined:this._inlined};
+	} finally {
+		this._params = null;
+	}
+}
+
+/**
+ * Databases with queryParams() get parametrized SQL; texts executed repeatedly
+ * on the same connection are prepared once and then only executed. Texts with
+ * inlined %n literals change with every value and are never counted or prepared.
+ * The driver drops db._statements when it connects, closes or resets the connection.
+ */
 Query.prototype.execute = function() {
-	var str = this.toString();
-	return Query._db.query(str);
+	var db = Query._db;
+	if (!db.queryParams) { return db.query(this.toString()); }
+
+	var q = this.toParams();
+	if (!q.values.length) { return db.query(q.text); }
+	if (!db.prepare || !db.execute || q.inlined) { return db.queryParams(q.text, q.values, false); } /* "" stays "", as inline */
+
+	if (!db._statements) { db._statements = {count:0, uses:{}, used:0, names:{}}; }
+	var statements = db._statements;
+	var name = statements.names[q.text];
+	if (name) { return db.execute(name, q.values); }
+
+	var uses = (statements.uses[q.text] || 0) + 1;
+	if (uses < Query.PREPARE_THRESHOLD || statements.count >= Query.MAX_STATEMENTS) {
+		if (statements.count < Query.MAX_STATEMENTS) {
+			if (uses == 1 && statements.used >= Query.MAX_USES) { /* too many one-off texts: start counting afresh */
+				statements.uses = {};
+				statements.used = 0;
+			}
+			if (uses == 1) { statements.used++; }
+			statements.uses[q.text] = uses;
+		}
+		return db.queryParams(q.text, q.values, false);
+	}
+
+	name = "teajs_query_" + statements.count;
+	db.prepare(name, q.text);
+	statements.count++;
+	statements.names[q.text] = name;
+	if (q.text in statements.uses) {
+		delete statements.uses[q.text];
+		statements.used--;
+	}
+	return db.execute(name, q.values);
 }
 
 Query.prototype._toStringSelect = function() {
@@ -172,13 +226,13 @@ Query.prototype._toStringLimit = function() {
 }
 
 Query.prototype._toStringOrder = function() {
-	return (this._order.length ? "ORDER BY "+this._order.join(", ") : "");
+	return (this._order.length ? "ORDER BY "+this._render(this._order).join(", ") : "");
 }
 
 Query.prototype._toStringHaving = function() {
 	var str = "";
 	if (this._having.length) {
-		str += "HAVING "+this._having.join(" ");
+		str += "HAVING "+this._render(this._having).join(" ");
 	}
 	return str;
 }
@@ -186,14 +240,16 @@ Query.prototype._toStringHaving = function() {
 Query.prototype._toStringWhere = function() {
 	var str = "";
 	if (this._where.length) {
-		str += "WHERE "+this._where.join(" ");
+		str += "WHERE "+this._render(this._where).join(" ");
 	}
 	return str;
 }
 
 Query.prototype._toStringGroup = function() {
 	if (this._group.length) {
-		return "GROUP BY "+this._group.join(", ");
+		var arr = [];
+		for (var i=0;i<this._group.length;i++) { arr.push(this._qualify(this._group[i])); }
+		return "GROUP BY "+arr.join(", ");
 	} else {
 		return "";
 	}
@@ -253,31 +309,62 @@ Query.prototype._toStringTable = function() {
 }
 
 Query.prototype._toStringField = function() {
+	var fields = [];
+	for (var i=0;i<this._field.length;i++) {
+		var field = this._field[i];
+		fields.push(typeof(field) == "string" ? this._qualify(field) : this._expand.apply(this, field));
+	}
+
 	switch (this._type) {
 		case Query.SELECT:
-			return this._field.join(", ");
+			return fields.join(", ");
 		break;
 		
 		case Query.INSERT:
-			return "("+this._field.join(", ")+") VALUES ("+this._value.join(", ")+")";
+			var values = [];
+			for (var i=0;i<this._value.length;i++) { values.push(this._toStringValue(this._value[i])); }
+			return "("+fields.join(", ")+") VALUES ("+values.join(", ")+")";
 		break;
 		
 		case Query.UPDATE:
 			var arr = [];
-			for (var i=0;i<this._field.length;i++) {
-				arr.push(this._field[i]+"="+this._value[i]);
+			for (var i=0;i<fields.length;i++) {
+				arr.push(fields[i]+"="+this._toStringValue(this._value[i]));
 			}
 			return "SET "+arr.join(", ");
 		break;
 	}
 }
 
+Query.prototype._toStringValue = function(item) {
+	if (item.noescape) { return item.value; }
+	if (this._params) {
+		this._params.push(item.value);
+		return "$" + this._params.length;
+	}
+	return "'" + this._escape(item.value)+ "'";
+}
+
+/* expand a list of stored argument arrays */
+Query.prototype._render = function(list) {
+	var arr = [];
+	for (var i=0;i<list.length;i++) { arr.push(this._expand.apply(this, list[i])); }
+	return arr;
+}
+
 Query.prototype._qualify = function(str) {
+	if (exports.qualify) { return exports.qualify(str, Query._quote); }
 	var parts = str.split(".");
 	var arr = [];
 	for (var i=0;i<parts.length;i++) {
 		var val = parts[i];
-		arr.push(val == "*" ? val : Query._db.qualify(val));
+		if (val == "*") {
+			arr.push(val);
+		} else if (Query._db.qualify) {
+			arr.push(Query._db.qualify(val));
+		} else {
+			arr.push(Query._quote + val.split(Query._quote).join(Query._quote+Query._quote) + Query._quote);
+		}
 	}
 	return arr.join(".");
 }
@@ -288,6 +375,9 @@ Query.prototype._escape = function(str) {
 
 Query.prototype._expand = function(str) {
 	if (arguments.length == 1) { return str; }
+	if (exports.expand) {
+		return exports.expand(str, Array.prototype.slice.call(arguments, 1), Query._quote, Query._db, this._params);
+	}
 	var s = "";
 	var argptr = 1;
 	var index = 0;
@@ -313,7 +403,12 @@ Query.prototype._expand = function(str) {
 			case "s":
 				if (start) {
 					start = false;
-					s += "'"+this._escape(arguments[argptr++])+"'";
+					if (this._params) {
+						this._params.push(arguments[argptr++]);
+						s += "$" + this._params.length;
+					} else {
+						s += "'"+this._escape(arguments[argptr++])+"'";
+					}
 				} else {
 					s += ch;
 				}
@@ -324,7 +419,8 @@ Query.prototype._expand = function(str) {
 					start = false;
 					var num = parseFloat(arguments[argptr++]);
 					if (isNaN(num)) { num = 0; }
-					s += num;
+					if (this._params) { this._inlined = true; }
+					s += num; /* inline even with params: an untyped $n would take the column type */
 				} else {
 					s += ch;
 				}
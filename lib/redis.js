@@ -24,6 +24,9 @@ THE SOFTWARE.
 
 */
 
+var Buffer = require('binary').Buffer;
+var RESP = require('resp');
+
 exports.Redis = (function(){
 
 	return function(params){
@@ -32,6 +35,7 @@ exports.Redis = (function(){
 		params['port'] = 'undefined' != typeof params['port'] ? parseInt(params['port'], 10) : 6379;
 		params['password'] = 'undefined' != typeof params['password'] ? params['password'] : '';
 		params['bufsz'] = 'undefined' != typeof params['bufsz'] ?  parseInt(params['bufsz'], 10) : 67108864;
+		params['readsz'] = 'undefined' != typeof params['readsz'] ?  parseInt(params['readsz'], 10) : 65536;
 		params['db'] = 'undefined' != typeof params['db'] ? params['db'] : '0';
 		params['debug'] = 'undefined' != typeof params['debug'] ? params['debug'] : false;
 
@@ -39,6 +43,9 @@ exports.Redis = (function(){
 		this.rows = 0;
 		this.debug = params['debug'];
 		this.bufsz = params['bufsz'];		
+		this.readsz = params['readsz'];
+		this.parser = null;
+		this.readBuffer = null;
 		this.connection = null;
 
 		var Sock = require('socket').Socket;
@@ -200,6 +207,61 @@ exports.Redis.prototype = {
 		return res;
 	},
 
+	/**
+	 * Binary-safe command, e.g. command(['SET', key, buffer]).
+	 * Bulk replies are Buffers; error replies are returned as Error instances.
+	 */
+	command : function(args){
+		return this.pipeline([args])[0];
+	},
+
+	/**
+	 * Write all commands at once, then collect one reply per command
+	 */
+	pipeline : function(commands){
+		this.send(commands);
+		var replies = [];
+		while(replies.length < commands.length){
+			replies = replies.concat(this.receive());
+		}
+		return replies;
+	},
+
+	/**
+	 * Run commands as one MULTI/EXEC transaction in a single round trip
+	 * @returns {array || null} EXEC result, null when the transaction was aborted
+	 */
+	multi : function(commands){
+		var replies = this.pipeline([['MULTI']].concat(commands, [['EXEC']]));
+		return replies[replies.length-1];
+	},
+
+	/**
+	 * Queue commands without waiting for replies (see receive)
+	 */
+	send : function(commands){
+		if(!this.connection) throw new Error('Not connected');
+		var data = RESP.encodeMany(commands);
+		while(data.length){
+			var sent = this.connection.send(data);
+			if(sent === false) continue; /* blocked */
+			data = data.slice(sent);
+		}
+	},
+
+	/**
+	 * Read once and return all complete replies. With a non-blocking connection
+	 * (connection.setBlocking(false) + EL.readSocket), returns [] instead of waiting.
+	 */
+	receive : function(){
+		if(!this.parser) this.parser = new RESP.Parser(true, false); /* replies must not alias the read buffer */
+		if(!this.readBuffer) this.readBuffer = new Buffer(this.readsz);
+		var count = this.connection.receiveInto(this.readBuffer);
+		if(count === false) return [];
+		if(!count) throw new Error('Connection closed by remote side');
+		return this.parser.push(this.readBuffer.range(0, count));
+	},
+
 	disconnect : function(){
 		if(this.connection){
 			this.connection.close();
@@ -151,4 +151,6 @@ function sprintf( ) {
     return format.replace(regex, doFormat);
 }
 
-exports.sprintf = sprintf;
\ No newline at end of file
+exports.sprintf = sprintf;
+
+module.persistent = true; /* no request state; may be kept across requests */
@@ -7,11 +7,17 @@ var Template = function(options) {
 }
 
 Template.prototype.process = function(file, data) {
+	if (exports.compileFile) { /* native part: compiled once, recompiled when the file or its includes change */
+		return exports.compileFile(file, this.options.path, this.options.suffix).call(this, data);
+	}
 	var contents = this._read(file);
 	return this.processString(contents, data);
 }
 
 Template.prototype.processString = function(str, data) {
+	if (exports.compileString) {
+		return exports.compileString(str, this.options.path, this.options.suffix).call(this, data);
+	}
 	var code = this._process(str);
 	return this._evalTemplate(code, data);
 }
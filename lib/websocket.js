@@ -4,6 +4,11 @@ var Buffer = require("binary").Buffer;
 var HASH = require("hash");
 var BASE64 = require("base64");
 var EL = require("eventloop");
+try {
+	var Codec = require("wscodec"); /* native frame parser */
+} catch (e) {
+	var Codec = null;
+}
 
 var Server = function(ip, port, options) {
 	this.setDebug(true);
@@ -78,16 +83,22 @@ Server.prototype.send = function(id, data) {
 	}
 	this._debug("["+id+"] sending " + frame.payload.length + " bytes");
 
-	var buffer = frame.toBuffer();
-	var remain = buffer.length;
-	while (1) {
-		var sent = this._clients[id].socket.send(buffer); 
+	this._sendFrame(this._clients[id].socket, frame);
+}
+
+/**
+ * Write a whole frame; header and payload leave in one syscall when the socket supports sendv
+ */
+Server.prototype._sendFrame = function(socket, frame) {
+	var parts = (socket.sendv ? frame.toBuffers() : [frame.toBuffer()]);
+	while (parts.length) {
+		var sent = (socket.sendv ? socket.sendv(parts) : socket.send(parts[0]));
 		if (sent === false) { continue; } /* blocked */
-		remain -= sent;
-		if (!remain) { break; }
-		var newBuffer = new Buffer(remain);
-		newBuffer.copyFrom(buffer, sent);
-		buffer = newBuffer;
+		while (parts.length && sent >= parts[0].length) { /* drop fully written parts */
+			sent -= parts[0].length;
+			parts.shift();
+		}
+		if (sent) { parts[0] = parts[0].slice(sent); }
 	}
 }
 
@@ -117,9 +128,7 @@ Server.prototype.disconnect = function(id, code, message) {
 		if (message) { messageBuffer.copy(payload, 2); }
 		frame.payload = payload;
 	}
-	var buffer = frame.toBuffer();
-
-	try { client.socket.send(buffer); } catch (e) { this._debug("["+id+"] send error: " + e.message); }
+	try { this._sendFrame(client.socket, frame); } catch (e) { this._debug("["+id+"] send error: " + e.message); }
 	this._closeClient(client);
 	client.app.ondisconnect(id, code || 1005, message); /* notify the app */
 }
@@ -178,6 +187,18 @@ Server.prototype._processSocket = function(socket) {
 	}
 	if (!data.length) { return; } /* cannot read, would block */
 	
+	if (client.decoder) { /* native codec returns complete messages only */
+		try {
+			var messages = client.decoder.push(data);
+			for (var i=0;i<messages.length;i++) {
+				this._processFrame({opcode:messages[i].opcode, payload:messages[i].payload, fin:true}, client);
+			}
+		} catch (e) {
+			this.disconnect(id, e.code, e.message);
+		}
+		return;
+	}
+
 	if (client.buffer) { /* merge with pending buffer */
 		var newBuffer = new Buffer(client.buffer.length + data.length);
 		client.buffer.copy(newBuffer);
@@ -219,6 +240,7 @@ Server.prototype._processMaster = function() {
 		app: null,			/* websocket application */
 		buffer: null,		/* partically received data */
 		frame: null,		/* ws frame */
+		decoder: null,		/* native frame decoder */
 		payload: null,		/* partially received payload */
 		payloadType: null	/* payload type (opcode) */
 	}
@@ -297,7 +319,7 @@ Server.prototype._processFrame = function(frame, client) {
 			var response = new Frame();
 			response.opcode = 0xA;
 			response.payload = frame.payload;
-			client.socket.send(response.toBuffer());
+			this._sendFrame(client.socket, response);
 		break;
 
 		case 0xA: /* pong, noop */
@@ -417,6 +439,7 @@ Server.prototype._handshake = function(client) {
 	
 	client.app = app;
 	client.frame = new Frame();
+	client.decoder = (Codec ? new Codec.Decoder() : null);
 	app.onconnect(client.id, headers, protocol);
 }
 
@@ -506,12 +529,25 @@ Frame.prototype.addData = function(buffer, bufferOffset) {
 }
 
 Frame.prototype.toBuffer = function() {
+	var parts = this.toBuffers();
+	if (parts.length == 1) { return parts[0]; }
+
+	var buffer = new Buffer(parts[0].length + parts[1].length);
+	parts[0].copy(buffer, 0);
+	parts[1].copy(buffer, parts[0].length);
+	return buffer;
+}
+
+/**
+ * @returns {Buffer[]} header and (uncopied) payload
+ */
+Frame.prototype.toBuffers = function() {
 	var length = (this.payload ? this.payload.length : 0);
 	var dataOffset = 2;
 	if (length > 125) { dataOffset += 2; } /* two bytes for size */
 	if (length > 0xFFFF) { dataOffset += 6; } /* eight bytes for size */
 	
-	var buffer = new Buffer(dataOffset + length);
+	var buffer = new Buffer(dataOffset);
 	buffer[0] = 0x80 + this.opcode;
 	
 	if (length > 125) {
@@ -533,9 +569,7 @@ Frame.prototype.toBuffer = function() {
 		buffer[1] = length;
 	}
 	
-	if (this.payload) { this.payload.copy(buffer, dataOffset); }
-	
-	return buffer;
+	return (length ? [buffer, this.payload] : [buffer]);
 }
 
 var ProtocolError = function(code, message) {
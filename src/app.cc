@@ -32,7 +32,17 @@
 #	define dlsym(x, y) GetProcAddress((HMODULE)x, y)
 #endif
 
+/**
+ * CONTEXT_POOL: every request gets a context created ahead of time (see
+ * fill_pool), so context creation is not on the request path. Used
+ * contexts are discarded, never cleaned for reuse.
+ */
+#if defined(CONTEXT_POOL) && !defined(CONTEXT_POOL_SIZE)
+#	define CONTEXT_POOL_SIZE 2
+#endif
+
 int fcgi_pre_accepted=0;
+volatile sig_atomic_t heap_sampling_toggle=0;
 void write_debug(const char *text)
 {
 	struct tm *ptr;
@@ -124,7 +134,7 @@ void TeaJS_App::init(int argc, char ** argv) {
 
 	v8::V8::InitializeICUDefaultLocation(path);
 	v8::V8::InitializeExternalStartupData(path);
-	platform = v8::platform::NewDefaultPlatform();
+	platform = v8::platform::NewDefaultPlatform(0, v8::platform::IdleTaskSupport::kEnabled);
 	v8::V8::InitializePlatform(platform.get());
 	v8::V8::Initialize();
 
@@ -134,6 +144,12 @@ void TeaJS_App::init(int argc, char ** argv) {
 	create_params.array_buffer_allocator = v8::ArrayBuffer::Allocator::NewDefaultAllocator();
 	this->isolate = v8::Isolate::New(create_params);
 	this->isolate->Enter();
+	this->gc.install(this->isolate);
+	this->gc_idle_time = 0;
+	this->gc_heap_growth = 0;
+	this->heap_sampling_started = false;
+
+	this->fill_pool();
 }
 
 /**
@@ -155,8 +171,10 @@ void TeaJS_App::prepare(char ** envp) {
 	v8::Local<v8::Array> paths = v8::Local<v8::Array>::New(JS_ISOLATE, this->paths);
 
 	/* config file */
+	double time = Metrics::now();
 	v8::Local<v8::Object> config =
 			v8::Local<v8::Object>::New(JS_ISOLATE, this->require(path_normalize(this->cfgfile), path_getcwd()));
+	this->phase(Metrics::CONFIG, time);
 
 	if (!paths->Length()) {
 		std::string error = "require.paths is empty, have you forgotten to push some data there?";
@@ -165,6 +183,54 @@ void TeaJS_App::prepare(char ** envp) {
 	
 	(void)g->Set(JS_CONTEXT,JS_STR("Config"), config->Get(JS_CONTEXT,JS_STR("Config")).ToLocalChecked());
 
+	v8::String::Utf8Value module_cache(JS_ISOLATE, this->get_config("moduleCache"));
+	std::string mode = (*module_cache ? *module_cache : "");
+	this->cache.setMode(mode == "inotify" ? Cache::INOTIFY : mode == "production" ? Cache::PRODUCTION : Cache::STAT);
+
+	/* modules worth compiling eagerly: everything in them runs on every request */
+	v8::Local<v8::Value> eager = this->get_config("eagerModules");
+	if (eager->IsArray()) {
+		/* resolve only when the list, the paths or the root changed (first request, config reload) */
+		v8::Local<v8::Array> arr = v8::Local<v8::Array>::Cast(eager);
+		v8::String::Utf8Value names(JS_ISOLATE, arr);
+		v8::String::Utf8Value dirs(JS_ISOLATE, paths);
+		std::string key = root + "\n" + (*dirs ? *dirs : "") + "\n" + (*names ? *names : "");
+		if (key != this->eager_key) {
+			this->eager_key = key;
+			for (unsigned int i=0; i<arr->Length(); i++) {
+				v8::String::Utf8Value name(JS_ISOLATE, arr->Get(JS_CONTEXT, i).ToLocalChecked());
+				modulefiles files = this->resolve_module(*name, root);
+				for (unsigned int j=0; j<files.size(); j++) { this->cache.setEager(files[j]); }
+			}
+		}
+	}
+
+	v8::Local<v8::Value> idle_time = this->get_config("gcIdleTime");
+	v8::Local<v8::Value> heap_growth = this->get_config("gcHeapGrowth");
+	this->gc_idle_time = (idle_time->IsNumber() ? idle_time->NumberValue(JS_CONTEXT).ToChecked() : 0);
+	this->gc_heap_growth = (heap_growth->IsNumber() ? (size_t) (heap_growth->NumberValue(JS_CONTEXT).ToChecked() * 1024 * 1024) : 0);
+
+	v8::String::Utf8Value profile_dir(JS_ISOLATE, this->get_config("profileDir"));
+	v8::String::Utf8Value profile_format(JS_ISOLATE, this->get_config("profileFormat"));
+	v8::String::Utf8Value profile_env(JS_ISOLATE, this->get_config("profileEnv"));
+	v8::Local<v8::Value> profile_every = this->get_config("profileEvery");
+	v8::Local<v8::Value> profile_interval = this->get_config("profileInterval");
+	v8::Local<v8::Value> heap_sampling = this->get_config("heapSampling");
+	v8::Local<v8::Value> heap_interval = this->get_config("heapSamplingInterval");
+	this->profiler.dir = (*profile_dir && this->get_config("profileDir")->IsString() ? *profile_dir : "");
+	this->profiler.format = (*profile_format && std::string(*profile_format) == "folded" ? Profiler::FOLDED : Profiler::CPUPROFILE);
+	this->profiler.every = (profile_every->IsNumber() ? (unsigned int) profile_every->NumberValue(JS_CONTEXT).ToChecked() : 0);
+	this->profiler.interval = (profile_interval->IsNumber() ? (int) profile_interval->NumberValue(JS_CONTEXT).ToChecked() : 1000);
+	this->profile_env = (*profile_env && this->get_config("profileEnv")->IsString() ? *profile_env : "");
+	if (heap_interval->IsNumber()) { this->profiler.heap_interval = (uint64_t) heap_interval->NumberValue(JS_CONTEXT).ToChecked(); }
+	if (heap_sampling->IsTrue() && !this->heap_sampling_started) { /* once per process; SIGUSR2 stops it */
+		this->heap_sampling_started = true;
+		this->profiler.start_heap_sampling(JS_ISOLATE);
+	}
+
+	v8::String::Utf8Value metrics_dir(JS_ISOLATE, this->get_config("metricsDir"));
+	this->metrics_dir = (*metrics_dir && this->get_config("metricsDir")->IsString() ? *metrics_dir : "");
+
 	setup_teajs(g);
 	setup_system(g, envp, this->mainfile, this->mainfile_args);
 }
@@ -178,18 +244,25 @@ void TeaJS_App::execute(char ** envp) {
 	v8::Isolate::Scope isolate_scope(isolate);
 	v8::HandleScope handle_scope(isolate);
 
+#ifndef CONTEXT_POOL /* pooled contexts are entered directly by create_context */
 	// Create a new context.
 	v8::Local<v8::Context> root_context = v8::Context::New(isolate);
 
 	v8::Context::Scope context_scope(root_context);
+#endif
 
 
 	//v8::Locker locker(JS_ISOLATE);
 	//v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
 
 	std::string caught;
+	double start = Metrics::now();
+	double time = start;
+	this->gc.request_start();
+	this->cache.poll();
 	this->create_context();
 	this->mainModule.Reset(JS_ISOLATE, v8::Object::New(JS_ISOLATE));
+	time = this->phase(Metrics::CONTEXT, time);
 
 	// vahvarh throw
 	try {
@@ -199,6 +272,8 @@ void TeaJS_App::execute(char ** envp) {
 		if (tc.HasCaught()) {
 			throw this->format_exception(&tc); // here can use normal throw because it in try/catch
 		} /* uncaught exception when loading config file */
+		time = this->phase(Metrics::PREPARE, time);
+		this->profiler.start(JS_ISOLATE, this->profile_requested(envp));
 		
 		if (this->mainfile == "") {
 			throw std::string("Nothing to do :)"); // here can use normal throw because it in try/catch
@@ -209,38 +284,143 @@ void TeaJS_App::execute(char ** envp) {
 		if (tc.HasCaught() && tc.CanContinue()) {
 			throw this->format_exception(&tc); // here can use normal throw because it in try/catch
 		} /* uncaught exception when executing main file */
+		time = this->phase(Metrics::MAIN, time);
 
 	} catch (std::string e) {
 		this->exit_code = 1;
 		caught = e;
+		time = Metrics::now();
 	}
 	
-	this->finish();
+	bool responded = this->finish(caught);
+	this->phase(Metrics::FINISH, time);
+	this->metrics.request.observe(Metrics::now() - start);
+	this->metrics.requests++;
+	if (caught.length()) { this->metrics.errors++; }
 	
-	if (caught.length()) {
+	if (caught.length() && !responded) {
 		throw caught; // cannot be caught in JS (after this->finish()), so using normal
 	} // rethrow
 }
 
 /**
- * End request
+ * Load modules listed in Config.preloadModules in a scratch context, so that their
+ * libraries are mapped, relocated and initialized before any client is waiting.
+ * Failures are reported to stderr; the modules are then loaded lazily as usual.
+ * @param {char**} envp Environment
  */
-void TeaJS_App::finish() {
+void TeaJS_App::preload(char ** envp) {
+	v8::Isolate::Scope isolate_scope(isolate);
+	v8::HandleScope handle_scope(isolate);
+
+#ifndef CONTEXT_POOL
+	v8::Local<v8::Context> root_context = v8::Context::New(isolate);
+	v8::Context::Scope context_scope(root_context);
+#endif
+
+	this->create_context();
+	this->mainModule.Reset(JS_ISOLATE, v8::Object::New(JS_ISOLATE));
+
+	try {
+		v8::TryCatch tc(JS_ISOLATE);
+
+		this->prepare(envp);
+		if (tc.HasCaught()) { throw this->format_exception(&tc); }
+
+		v8::Local<v8::Value> preload = this->get_config("preloadModules");
+		if (preload->IsArray()) {
+			std::string root = path_getcwd();
+			v8::Local<v8::Array> arr = v8::Local<v8::Array>::Cast(preload);
+			for (unsigned int i=0; i<arr->Length(); i++) {
+				v8::String::Utf8Value name(JS_ISOLATE, arr->Get(JS_CONTEXT, i).ToLocalChecked());
+				modulefiles files = this->resolve_module(*name, root);
+				for (unsigned int j=0; j<files.size(); j++) {
+					std::string ext = files[j].substr(files[j].find_last_of('.')+1, std::string::npos);
+					if (ext == STRING(DSO_EXT)) { this->cache.getHandle(files[j], true); }
+				}
+				this->require(*name, root); /* runs the module's init, compiles its JS part */
+				if (tc.HasCaught()) { throw this->format_exception(&tc); }
+			}
+		}
+	} catch (std::string e) {
+		std::string error = "Preloading modules failed: ";
+		error += e;
+		error += "\n";
+		fwrite((void *) error.c_str(), sizeof(char), error.length(), stderr);
+	}
+
+	this->cleanup();
+}
+
+/**
+ * Record the duration of a request phase
+ * @param {double} start when the phase started, see Metrics::now()
+ * @returns {double} now, i.e. when the next phase starts
+ */
+double TeaJS_App::phase(Metrics::phase_t phase, double start) {
+	double now = Metrics::now();
+	this->metrics.phases[phase].observe(now - start);
+	return now;
+}
+
+/**
+ * Response is not sent early by default
+ */
+bool TeaJS_App::end_response(const std::string & error) {
+	return false;
+}
+
+/**
+ * End request: response first, then deferred work (onexit callbacks, context teardown, GC)
+ * @returns {bool} whether end_response() delivered the response
+ */
+bool TeaJS_App::finish(const std::string & error) {
 	v8::Local<v8::Value> show = this->get_config("showErrors");
 	this->show_errors = show->ToBoolean(JS_ISOLATE)->IsTrue();
 
+	bool responded = this->end_response(error);
+	this->gc.request_end();
+
 	/* user callbacks */
 	for (unsigned int i=0; i<this->onexit.size(); i++) {
 		v8::Local<v8::Function> onexit = v8::Local<v8::Function>::New(JS_ISOLATE, this->onexit[i]);
 		(void)onexit->Call(JS_CONTEXT,JS_GLOBAL, 0, NULL);
-		this->onexit[i].Reset();
 	}
+	this->profiler.stop(JS_ISOLATE);
+
+	this->cleanup();
+	return responded;
+}
+
+/**
+ * Context teardown shared by finish() and preload(): forget onexit callbacks,
+ * clear the export cache, delete the context and report native memory to V8
+ */
+void TeaJS_App::cleanup() {
+	for (unsigned int i=0; i<this->onexit.size(); i++) { this->onexit[i].Reset(); }
 	this->onexit.clear();
 
 	/* export cache */
+#ifdef REUSE_CONTEXT
+	this->cache.clearExports(true);
+#else
 	this->cache.clearExports();
-	
+#endif
+
 	this->delete_context();
+	Metrics::report_external(); /* counted by allocators during the request */
+}
+
+/**
+ * Whether the request environment contains Config.profileEnv with a non-empty value
+ */
+bool TeaJS_App::profile_requested(char ** envp) {
+	if (!this->profile_env.length()) { return false; }
+	std::string prefix = this->profile_env + "=";
+	for (int i=0; envp[i] != NULL; i++) {
+		if (!strncmp(envp[i], prefix.c_str(), prefix.length())) { return envp[i][prefix.length()] != '\0'; }
+	}
+	return false;
 }
 
 /**
@@ -272,10 +452,14 @@ v8::Persistent<v8::Object, v8::CopyablePersistentTraits<v8::Object> > TeaJS_App:
 	modulename = modulename.substr(0,	modulename.find_last_of('.'));
 
 	v8::Persistent<v8::Object, v8::CopyablePersistentTraits<v8::Object> > exports = this->cache.getExports(modulename);
-	/* check if exports are cached */
-	if (!exports.IsEmpty()) { return exports; }
+	/* check if exports are cached; persistent ones only as long as their files did not change */
+	if (!exports.IsEmpty()) {
+		if (!this->cache.isPersistent(modulename) || this->cache.isCurrent(files)) { return exports; }
+		this->cache.removeExports(modulename);
+	}
 	
 	/* create module-specific require */
+	double time = Metrics::now();
 	v8::Local<v8::Function> require = this->build_require(modulename, _require);
 
 	/* add new blank exports to cache */
@@ -302,6 +486,12 @@ v8::Persistent<v8::Object, v8::CopyablePersistentTraits<v8::Object> > TeaJS_App:
 		}
 		
 	}
+	if (name != this->mainfile) { this->metrics.modules.observe(Metrics::now() - time); }
+
+	/* opt-in: module does not depend on request state (honoured only when the context is reused) */
+	if (name != this->mainfile && module->Get(JS_CONTEXT,JS_STR("persistent")).ToLocalChecked()->IsTrue()) {
+		this->cache.setPersistent(modulename);
+	}
 
 	exports.Reset(JS_ISOLATE, _exports);
 	return exports;
@@ -321,10 +511,7 @@ int TeaJS_App::load_js(std::string filename, v8::Local<v8::Function> require, v8
 
 	/* compiled script wrapped in anonymous function */
 
-	v8::Persistent<v8::Script, v8::CopyablePersistentTraits<v8::Script> > script_ml=this->cache.getScript(filename);
-	if (script_ml.IsEmpty()) return 1;
-	v8::Local<v8::Script> script = v8::Local<v8::Script>::New(JS_ISOLATE, script_ml);
-
+	v8::Local<v8::Script> script = this->cache.getScript(filename);
 	if (script.IsEmpty()) { return 1; } /* compilation error? */
 	/* run the script, no error should happen here */
 	v8::Local<v8::Value> wrapped = script->Run(JS_CONTEXT).ToLocalChecked();
@@ -349,6 +536,25 @@ int TeaJS_App::load_js(std::string filename, v8::Local<v8::Function> require, v8
 	return (result.IsEmpty() ? 1 : 0);
 }
 
+/**
+ * Give anonymous native functions (and their prototype methods) the name they are exported as,
+ * so that CPU and heap profiles can tell them apart
+ */
+static void name_natives(v8::Local<v8::Object> exports, bool methods) {
+	v8::Local<v8::Array> keys = exports->GetOwnPropertyNames(JS_CONTEXT).ToLocalChecked();
+	for (unsigned int i=0; i<keys->Length(); i++) {
+		v8::Local<v8::Value> key = keys->Get(JS_CONTEXT, i).ToLocalChecked();
+		v8::Local<v8::Value> value = exports->Get(JS_CONTEXT, key).ToLocalChecked();
+		if (!key->IsString() || !value->IsFunction()) { continue; }
+		v8::Local<v8::Function> func = v8::Local<v8::Function>::Cast(value);
+		if (func->GetName()->ToString(JS_CONTEXT).ToLocalChecked()->Length() == 0) { func->SetName(v8::Local<v8::String>::Cast(key)); }
+		if (!methods) { continue; }
+
+		v8::Local<v8::Value> proto = func->Get(JS_CONTEXT, JS_STR("prototype")).ToLocalChecked();
+		if (proto->IsObject()) { name_natives(v8::Local<v8::Object>::Cast(proto), false); }
+	}
+}
+
 /**
  * Include a DSO module
  */
@@ -371,13 +577,47 @@ void TeaJS_App::load_dso(std::string filename, v8::Local<v8::Function> require,
 	}
 	
 	func(require, exports, module);
+	if (!this->profiler.dir.empty()) { name_natives(exports, true); } /* init reruns per request: only pay for names when profiles are written */
 }
 
 /**
- * Fully expand/resolve module name
+ * Fully expand/resolve module name, remembering the result when the cache mode allows it
  */
 TeaJS_App::modulefiles TeaJS_App::resolve_module(std::string name, std::string relativeRoot) {
 	if (!name.length()) { return modulefiles(); }
+	if (this->cache.getMode() == Cache::STAT) { return this->find_module(name, relativeRoot); }
+
+	/* the key covers everything the lookup depends on; dirs are what find_module reads */
+	std::string key = name;
+	std::vector<std::string> dirs;
+	if (path_isabsolute(name)) {
+		dirs.push_back(path_dirname(name));
+	} else if (name.at(0) == '.') {
+		key += '\0';
+		key += relativeRoot;
+		dirs.push_back(path_dirname(relativeRoot + "/" + name));
+	} else {
+		v8::Local<v8::Array> arr = v8::Local<v8::Array>::New(JS_ISOLATE, this->paths);
+		int length = arr->Length();
+		for (int i=0;i<length;i++) {
+			v8::String::Utf8Value pfx(JS_ISOLATE,arr->Get(JS_CONTEXT,JS_INT(i)).ToLocalChecked());
+			key += '\0';
+			key += *pfx;
+			dirs.push_back(path_dirname(std::string(*pfx) + "/" + name));
+		}
+	}
+
+	modulefiles result;
+	if (this->cache.getResolved(key, result)) { return result; }
+	result = this->find_module(name, relativeRoot);
+	this->cache.setResolved(key, result, dirs);
+	return result;
+}
+
+/**
+ * Probe the file system for a module
+ */
+TeaJS_App::modulefiles TeaJS_App::find_module(std::string name, std::string relativeRoot) {
 
 	if (path_isabsolute(name)) {
 		/* TeaJS non-standard extension - absolute path */
@@ -480,18 +720,71 @@ std::string TeaJS_App::format_exception(v8::TryCatch* try_catch) {
 	return msgstring;
 }
 
+/**
+ * Template for all global objects; internal fields hold the app, GC and metrics pointers
+ */
+v8::Local<v8::ObjectTemplate> TeaJS_App::global_template() {
+	if (this->globalt.IsEmpty()) {
+		v8::Local<v8::ObjectTemplate> globalt = v8::ObjectTemplate::New(JS_ISOLATE);
+		globalt->SetInternalFieldCount(3);
+		this->globalt.Reset(JS_ISOLATE, globalt);
+	}
+	return v8::Local<v8::ObjectTemplate>::New(JS_ISOLATE, this->globalt);
+}
+
+/**
+ * Top up the context pool. No-op unless built with CONTEXT_POOL.
+ */
+void TeaJS_App::fill_pool() {
+#ifdef CONTEXT_POOL
+	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
+	v8::Local<v8::ObjectTemplate> globalt = this->global_template();
+	while (this->pool.size() < CONTEXT_POOL_SIZE) {
+		this->pool.emplace_back(JS_ISOLATE, v8::Context::New(JS_ISOLATE, NULL, globalt));
+	}
+#endif
+}
+
+/**
+ * Work that would otherwise land inside the next request: new pooled
+ * contexts and garbage collection, limited by the configured budget.
+ */
+void TeaJS_App::idle() {
+	this->fill_pool();
+	this->cache.poll();
+	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
+	this->gc.idle(this->platform.get(), this->gc_idle_time / 1000, this->gc_heap_growth);
+	this->metrics.dump(this->metrics_dir, JS_ISOLATE, this->gc);
+
+	if (heap_sampling_toggle) {
+		heap_sampling_toggle = 0;
+		if (this->profiler.heap_sampling()) {
+			this->profiler.stop_heap_sampling(JS_ISOLATE);
+		} else {
+			this->profiler.start_heap_sampling(JS_ISOLATE);
+		}
+	}
+}
+
 /**
  * Creates a new context
  */
 void TeaJS_App::create_context() {
 	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
 
+#ifdef CONTEXT_POOL
+	v8::Local<v8::Context> context;
+	if (this->pool.empty()) { /* requests came faster than fill_pool() */
+		context = v8::Context::New(JS_ISOLATE, NULL, this->global_template());
+	} else {
+		context = v8::Local<v8::Context>::New(JS_ISOLATE, this->pool.front());
+		this->pool.pop_front();
+	}
+	context->Enter();
+	this->context.Reset(JS_ISOLATE, context);
+#else
 	if (this->global.IsEmpty()) { /* first time */
-		v8::Local<v8::ObjectTemplate> globalt = v8::ObjectTemplate::New(JS_ISOLATE);
-		globalt->SetInternalFieldCount(2);
-		this->globalt.Reset(JS_ISOLATE, globalt);
-
-		v8::Local<v8::Context> context = v8::Context::New(JS_ISOLATE, NULL, globalt);
+		v8::Local<v8::Context> context = v8::Context::New(JS_ISOLATE, NULL, this->global_template());
 		context->Enter();
 		this->context.Reset(JS_ISOLATE, context);
 
@@ -502,15 +795,16 @@ void TeaJS_App::create_context() {
 		context->Enter();
 		this->clear_global(); /* reuse - just clear */
 #else
-		v8::Local<v8::ObjectTemplate> globalt = v8::Local<v8::ObjectTemplate>::New(JS_ISOLATE, this->globalt);
 		v8::Local<v8::Value> global = v8::Local<v8::Value>::New(JS_ISOLATE, this->global);
-		v8::Local<v8::Context> context = v8::Context::New(JS_ISOLATE, NULL, globalt, global);
+		v8::Local<v8::Context> context = v8::Context::New(JS_ISOLATE, NULL, this->global_template(), global);
 		context->Enter();
 		this->context.Reset(JS_ISOLATE, context);
 #endif
 	}
+#endif
 	GLOBAL_PROTO->SetInternalField(0, v8::External::New(JS_ISOLATE, (void *) this));
 	GLOBAL_PROTO->SetInternalField(1, v8::External::New(JS_ISOLATE, (void *) &(this->gc)));
+	GLOBAL_PROTO->SetInternalField(2, v8::External::New(JS_ISOLATE, (void *) &(this->metrics)));
 
 }
 
@@ -520,7 +814,10 @@ void TeaJS_App::create_context() {
 void TeaJS_App::delete_context() {
 	v8::Local<v8::Context> context = v8::Local<v8::Context>::New(JS_ISOLATE, this->context);
 	context->Exit();
-#ifndef REUSE_CONTEXT
+#ifdef CONTEXT_POOL
+	this->context.Reset();
+	JS_ISOLATE->ContextDisposedNotification(); /* lets V8 collect it at the next opportunity */
+#elif !defined(REUSE_CONTEXT)
 	this->context.Reset();
 #endif
 }
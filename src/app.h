@@ -4,11 +4,16 @@
 #include <utility>
 #include <vector>
 #include <list>
+#include <csignal>
 #include <v8.h>
 #include "cache.h"
 #include "gc.h"
+#include "profiler.h"
+#include "metrics.h"
 
 extern int fcgi_pre_accepted;
+/* set by a signal handler; idle() then starts or stops heap sampling */
+extern volatile sig_atomic_t heap_sampling_toggle;
 /**
  * This class defines a basic v8-based application.
  */
@@ -24,7 +29,19 @@ public:
 	virtual void init(int argc, char ** argv); 
 	/* once per request */
 	void execute(char ** envp); 
+	/* once per app lifetime, before the first request: load Config.preloadModules */
+	void preload(char ** envp);
 	v8::Persistent<v8::Object, v8::CopyablePersistentTraits<v8::Object> > require(std::string name, std::string moduleId);
+	/* create pristine contexts for upcoming requests (CONTEXT_POOL builds); call when idle */
+	void fill_pool();
+	/* between requests: fill_pool() plus scheduled GC work */
+	void idle();
+	/* GC notification engine */
+	GC gc;
+	/* per-request CPU profiles */
+	Profiler profiler;
+	/* request metrics */
+	Metrics metrics;
 	
 	/* list of "onexit" functions */
 	funcvector onexit;
@@ -35,6 +52,13 @@ public:
 protected:
 	/* env. preparation */
 	virtual void prepare(char ** envp);
+	/**
+	 * Called when the request is done, before onexit callbacks and context teardown.
+	 * An implementation which delivers the response (including "error", if non-empty)
+	 * returns true; the remaining work then no longer delays the client.
+	 * Returning false keeps the error to be thrown from execute().
+	 */
+	virtual bool end_response(const std::string & error);
 
 	/* config file */
 	std::string cfgfile;
@@ -61,19 +85,34 @@ private:
 	
 	v8::Persistent<v8::Value, v8::CopyablePersistentTraits<v8::Value> > global;
 	v8::Persistent<v8::ObjectTemplate, v8::CopyablePersistentTraits<v8::ObjectTemplate> > globalt;
+	/* unused contexts, handed out one per request */
+	std::list<v8::Global<v8::Context> > pool;
+	v8::Local<v8::ObjectTemplate> global_template();
 	
 	/* get configuration option */
 	v8::Local<v8::Value> get_config(std::string name);
 
 	/* cache */
 	Cache cache;
-	/* GC notification engine */
-	GC gc;
+	/* idle GC settings, from Config.gcIdleTime (ms) and Config.gcHeapGrowth (MB) */
+	double gc_idle_time;
+	size_t gc_heap_growth;
+	/* environment variable which asks for a profile of this request, from Config.profileEnv */
+	std::string profile_env;
+	bool profile_requested(char ** envp);
+	/* where idle() dumps metrics, from Config.metricsDir */
+	std::string metrics_dir;
+	/* root, require.paths and Config.eagerModules when the eager modules were last resolved */
+	std::string eager_key;
+	/* Config.heapSampling was applied */
+	bool heap_sampling_started;
+	double phase(Metrics::phase_t phase, double start);
 
 	std::string format_exception(v8::TryCatch* try_catch);
 	void findmain();
 	void js_error(std::string message);
-	void finish();
+	bool finish(const std::string & error);
+	void cleanup();
 	void clear_global();
 	
 	/* instance type info */
@@ -81,6 +120,7 @@ private:
 	virtual const char * executableName() = 0;
 
 	modulefiles resolve_module(std::string name, std::string relativeRoot);
+	modulefiles find_module(std::string name, std::string relativeRoot);
 	modulefiles resolve_extension(std::string path);
 	int load_js(std::string filename, v8::Local<v8::Function> require, v8::Local<v8::Object> exports, v8::Local<v8::Object> module);
 	void load_dso(std::string filename, v8::Local<v8::Function> require, v8::Local<v8::Object> exports, v8::Local<v8::Object> module);
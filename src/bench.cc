@@ -0,0 +1,192 @@
+/**
+ * TeaJS - benchmark runner. Runs pages through the same request cycle as the
+ * FastCGI binary (execute, end_response, idle) with a fixed CGI environment
+ * in place of a web server, and prints one JSON object per page to stdout.
+ */
+
+#include <v8.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include "app.h"
+#include "macros.h"
+#include "path.h"
+
+extern char ** environ;
+
+static const char * const bench_usage = "tea-bench [-n requests] [-w warmup] page.js [page.js ...]";
+
+class TeaJS_Bench : public TeaJS_App {
+public:
+	/* error of the last request, empty when it succeeded */
+	std::string error;
+	/* when end_response() delivered the last response, see Metrics::now() */
+	double responded;
+
+	/**
+	 * One request, as in the FastCGI main loop; the caller runs idle() afterwards
+	 */
+	void request(std::string file, char ** envp) {
+		this->mainfile = file;
+		this->exit_code = 0;
+		this->error = "";
+		this->responded = 0;
+		try {
+			this->execute(envp);
+		} catch (std::string e) {
+			this->error = e;
+		}
+	}
+
+private:
+	const char * instanceType() {
+		return "bench";
+	}
+
+	const char * executableName() {
+		return "tea-bench";
+	}
+
+	/**
+	 * The response goes to stdout, which main() points to /dev/null
+	 */
+	bool end_response(const std::string & error) {
+		this->error = error;
+		fflush(stdout);
+		this->responded = Metrics::now();
+		return true;
+	}
+};
+
+/**
+ * Environment of a GET request from a local client, plus the process environment
+ */
+static std::vector<std::string> cgi_env(std::string file) {
+	std::vector<std::string> env;
+	env.push_back("GATEWAY_INTERFACE=CGI/1.1");
+	env.push_back("SERVER_SOFTWARE=tea-bench");
+	env.push_back("SERVER_PROTOCOL=HTTP/1.1");
+	env.push_back("SERVER_NAME=localhost");
+	env.push_back("SERVER_PORT=80");
+	env.push_back("REQUEST_METHOD=GET");
+	env.push_back("REQUEST_URI=/" + path_filename(file));
+	env.push_back("QUERY_STRING=a=1&b=2");
+	env.push_back("SCRIPT_FILENAME=" + file);
+	env.push_back("REMOTE_ADDR=127.0.0.1");
+	env.push_back("HTTP_HOST=localhost");
+	env.push_back("HTTP_ACCEPT=text/html");
+	env.push_back("HTTP_COOKIE=V8SID=bench");
+	for (int i=0; environ[i] != NULL; i++) { env.push_back(environ[i]); }
+	return env;
+}
+
+/**
+ * Nearest-rank percentile of sorted values
+ */
+static double percentile(const std::vector<double> & sorted, double p) {
+	if (!sorted.size()) { return 0; }
+	size_t index = (size_t) (p / 100 * sorted.size());
+	if (index >= sorted.size()) { index = sorted.size() - 1; }
+	return sorted[index];
+}
+
+static std::string json_escape(const std::string & str) {
+	std::string result;
+	for (size_t i=0; i<str.length(); i++) {
+		unsigned char ch = (unsigned char) str[i];
+		if (ch == '"' || ch == '\\') {
+			result += '\\';
+			result += ch;
+		} else if (ch < 0x20) {
+			result += ' ';
+		} else {
+			result += ch;
+		}
+	}
+	return result;
+}
+
+int main(int argc, char ** argv) {
+	int requests = 1000;
+	int warmup = 50;
+	std::vector<std::string> pages;
+
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "-n" || arg == "-w") && i+1 < argc) {
+			(arg == "-n" ? requests : warmup) = atoi(argv[++i]);
+		} else if (arg.length() && arg.at(0) == '-') {
+			fprintf(stderr, "Usage: %s\n", bench_usage);
+			return 1;
+		} else {
+			pages.push_back(path_isabsolute(arg) ? arg : path_normalize(path_getcwd() + "/" + arg));
+		}
+	}
+	if (!pages.size() || requests < 1) {
+		fprintf(stderr, "Usage: %s\n", bench_usage);
+		return 1;
+	}
+
+	/* results keep the real stdout; page output is discarded */
+	fflush(stdout);
+	FILE * results = fdopen(dup(STDOUT_FILENO), "w");
+	int devnull = open("/dev/null", O_WRONLY);
+	dup2(devnull, STDOUT_FILENO);
+	close(devnull);
+
+	TeaJS_Bench bench;
+	bench.init(argc, argv);
+
+	for (unsigned int i=0; i<pages.size(); i++) {
+		std::string file = pages[i];
+		std::vector<std::string> env = cgi_env(file);
+		std::vector<char *> envp;
+		for (unsigned int j=0; j<env.size(); j++) { envp.push_back((char *) env[j].c_str()); }
+		envp.push_back(NULL);
+
+		for (int j=0; j<warmup; j++) {
+			bench.request(file, &envp[0]);
+			bench.idle();
+		}
+
+		std::vector<double> times;
+		unsigned int errors = 0;
+		std::string error;
+		double start = Metrics::now();
+		for (int j=0; j<requests; j++) {
+			double t = Metrics::now();
+			bench.request(file, &envp[0]);
+			/* latency as seen by the client: onexit callbacks and context teardown come later */
+			times.push_back((bench.responded ? bench.responded : Metrics::now()) - t);
+			bench.idle();
+			if (bench.error.length()) {
+				errors++;
+				if (!error.length()) { error = bench.error; }
+			}
+		}
+		double total = Metrics::now() - start; /* includes idle() work, like a real worker */
+		std::sort(times.begin(), times.end());
+
+		v8::HeapStatistics stats;
+		v8::Isolate::GetCurrent()->GetHeapStatistics(&stats);
+
+		std::string name = path_filename(file);
+		name = name.substr(0, name.find_last_of('.'));
+		fprintf(results, "{\"page\":\"%s\",\"requests\":%d,\"errors\":%u,\"rps\":%.1f,"
+			"\"p50_ms\":%.3f,\"p90_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f,\"heap_used\":%lu",
+			json_escape(name).c_str(), requests, errors, requests / total * 1000,
+			percentile(times, 50), percentile(times, 90), percentile(times, 99), times.back(),
+			(unsigned long) stats.used_heap_size());
+		if (error.length()) { fprintf(results, ",\"error\":\"%s\"", json_escape(error).c_str()); }
+		fprintf(results, "}\n");
+		fflush(results);
+	}
+
+	fclose(results);
+	return 0;
+}
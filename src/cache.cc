@@ -6,6 +6,14 @@
 #include "macros.h"
 #include "cache.h"
 #include "common.h"
+#include "path.h"
+
+#ifdef __linux__
+#   include <sys/inotify.h>
+#   include <unistd.h>
+#   include <fcntl.h>
+#   define HAVE_INOTIFY
+#endif
 
 #ifndef windows
 #   include <dlfcn.h>
@@ -15,10 +23,117 @@
 #   define dlclose(x) FreeLibrary((HMODULE)x)
 #endif
 
+Cache::Cache() : mode(STAT), notify_fd(-1) {
+}
+
+Cache::~Cache() {
+#ifdef HAVE_INOTIFY
+	if (this->notify_fd != -1) { close(this->notify_fd); }
+#endif
+}
+
+void Cache::setMode(Mode mode) {
+	if (mode == this->mode) { return; }
+#ifdef HAVE_INOTIFY
+	if (mode == INOTIFY) {
+		this->notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (this->notify_fd == -1) { mode = STAT; }
+		/* files cached so far were validated by stat; watch them from now on */
+		for (TimeValue::iterator it = modified.begin(); it != modified.end(); it++) { this->watch(path_dirname(it->first)); }
+	} else if (this->notify_fd != -1) {
+		close(this->notify_fd);
+		this->notify_fd = -1;
+		this->watches.clear();
+	}
+#else
+	if (mode == INOTIFY) { mode = STAT; }
+#endif
+	if (mode == STAT) { this->resolved.clear(); }
+	this->mode = mode;
+}
+
+void Cache::watch(std::string dir) {
+#ifdef HAVE_INOTIFY
+	if (this->notify_fd == -1) { return; }
+	int wd = inotify_add_watch(this->notify_fd, dir.c_str(), IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+	if (wd != -1) { this->watches[wd] = dir; }
+#endif
+}
+
+/**
+ * Forget all cached files and start over with a fresh inotify queue;
+ * files and directories are watched again as they get cached.
+ */
+void Cache::rewatch() {
+#ifdef HAVE_INOTIFY
+	close(this->notify_fd);
+	this->watches.clear();
+	this->notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (this->notify_fd == -1) { this->mode = STAT; }
+#endif
+	this->resolved.clear();
+	TimeValue::iterator it = modified.begin();
+	while (it != modified.end()) { this->erase((it++)->first); }
+}
+
+/**
+ * Drop everything the change notifications refer to
+ */
+void Cache::poll() {
+#ifdef HAVE_INOTIFY
+	if (this->notify_fd == -1) { return; }
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t length;
+	while ((length = read(this->notify_fd, buffer, sizeof(buffer))) > 0) {
+		this->resolved.clear(); /* any change may affect resolution */
+		for (char * ptr = buffer; ptr < buffer + length; ) {
+			struct inotify_event * event = (struct inotify_event *) ptr;
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) { /* events were lost: trust nothing */
+				this->rewatch();
+				return;
+			}
+			std::map<int, std::string>::iterator it = this->watches.find(event->wd);
+			if (it == this->watches.end()) { continue; }
+			if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) { /* directory is gone: forget all files in it */
+				std::string prefix = it->second + "/";
+				TimeValue::iterator f = modified.begin();
+				while (f != modified.end()) {
+					std::string name = (f++)->first;
+					if (name.compare(0, prefix.length(), prefix) == 0) { this->erase(name); }
+				}
+				if (event->mask & IN_IGNORED) { this->watches.erase(it); }
+				continue;
+			}
+			if (event->len) { this->erase(it->second + "/" + event->name); }
+		}
+	}
+#endif
+}
+
+bool Cache::getResolved(std::string key, std::vector<std::string> & files) {
+	if (this->mode == STAT) { return false; }
+	std::map<std::string, std::vector<std::string> >::iterator it = this->resolved.find(key);
+	if (it == this->resolved.end()) { return false; }
+	files = it->second;
+	return true;
+}
+
+void Cache::setResolved(std::string key, std::vector<std::string> files, std::vector<std::string> dirs) {
+	if (this->mode == STAT || !files.size()) { return; } /* failures are not cached: the file may appear later */
+	for (unsigned int i=0; i<dirs.size(); i++) { this->watch(dirs[i]); }
+	this->resolved[key] = files;
+}
+
 /**
  * Is this file already cached?
  */
 bool Cache::isCached(std::string filename) {
+	if (this->mode != STAT) { /* validity is maintained by poll() or assumed */
+		return (modified.find(filename) != modified.end());
+	}
+
 	struct stat st;
 	int result = stat(filename.c_str(), &st);
 	if (result != 0) { return false; }
@@ -40,17 +155,34 @@ void Cache::mark(std::string filename) {
 	struct stat st;
 	stat(filename.c_str(), &st);
 	modified[filename] = st.st_mtime;
+	if (this->mode == INOTIFY) { this->watch(path_dirname(filename)); }
+}
+
+/**
+ * Has the file changed (or disappeared) since it was marked as cached?
+ */
+bool Cache::changed(std::string filename) {
+	TimeValue::iterator it = modified.find(filename);
+	struct stat st;
+	return (it == modified.end() || stat(filename.c_str(), &st) != 0 || st.st_mtime != it->second);
 }
 
 /**
- * Remove file from all available caches
+ * Remove file from all available caches. A DSO is dlclosed and loaded again
+ * only when the file really changed: objects created by the old library must
+ * not outlive the request in which it is replaced.
  */
 void Cache::erase(std::string filename) {
 	HandleValue::iterator it2 = handles.find(filename);
-	if (it2 != handles.end()) { 
+	if (it2 != handles.end()) {
+		if (!this->changed(filename)) { /* touched, or rewatch(): keep the loaded library */
+			if (this->mode == INOTIFY) { this->watch(path_dirname(filename)); }
+			return;
+		}
 		dlclose(it2->second);
-		handles.erase(it2); 
+		handles.erase(it2);
 	}
+	modified.erase(filename);
 	
 	ScriptValue::iterator it3 = scripts.find(filename);
 	if (it3 != scripts.end()) { 
@@ -59,46 +191,87 @@ void Cache::erase(std::string filename) {
 	}
 }
 
+#define WRAP_PREFIX "(function(require,exports,module){"
+#define WRAP_SUFFIX "\n})"
+
+/**
+ * Module source owned by V8: the file is read once into a buffer which
+ * already has room for the exports envelope, so nothing is concatenated
+ * or copied afterwards.
+ */
+class SourceResource : public v8::String::ExternalOneByteStringResource {
+public:
+	SourceResource(char * data, size_t length) : _data(data), _length(length) {}
+	~SourceResource() { free(this->_data); }
+	const char * data() const { return this->_data; }
+	size_t length() const { return this->_length; }
+private:
+	char * _data;
+	size_t _length;
+};
+
+static bool is_ascii(const char * data, size_t length) {
+	unsigned char bits = 0;
+	for (size_t i=0; i<length; i++) { bits |= (unsigned char) data[i]; }
+	return !(bits & 0x80);
+}
+
 /**
- * Return source code for a given file
+ * Return wrapped source code for a given file
  */
-std::string Cache::getSource(std::string filename) {
+v8::Local<v8::String> Cache::getSource(std::string filename) {
+	std::string error = "Error reading '";
+	error += filename;
+	error += "'";
+
 	FILE * file = fopen(filename.c_str(), "rb");
-	if (file == NULL) { 
-		std::string s = "Error reading '";
-		s += filename;
-		s += "'";
-		
-		throw s; 
-	}
+	if (file == NULL) { throw error; }
 	
-	fseek(file, 0, SEEK_END);
-	size_t size = ftell(file);
+	long end = (fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1);
+	if (end < 0) { /* not seekable, e.g. a directory */
+		fclose(file);
+		throw error;
+	}
+	size_t size = (size_t) end;
 	rewind(file);
-	char* chars = new char[size + 1];
-	chars[size] = '\0';
-	for (unsigned int i = 0; i < size;) {
-		size_t read = fread(&chars[i], 1, size - i, file);
-		i += read;
+
+	size_t prefix = sizeof(WRAP_PREFIX) - 1;
+	size_t suffix = sizeof(WRAP_SUFFIX) - 1;
+	size_t length = prefix + size + suffix;
+	char * chars = (char *) malloc(length);
+	if (chars == NULL) {
+		fclose(file);
+		throw error;
+	}
+	memcpy(chars, WRAP_PREFIX, prefix);
+	size_t total = 0;
+	while (total < size) {
+		size_t read = fread(&chars[prefix + total], 1, size - total, file);
+		if (!read) { break; }
+		total += read;
 	}
 	fclose(file);
-	std::string source = chars;
-	delete[] chars;
-
-	/* remove shebang line */
-	if (source.find('#',0) == 0 && source.find('!',1) == 1 ) {
-		long pfix = source.find('\n',0);
-		source.erase(0,pfix);
-	};
-	
-	source = this->wrapExports(source);
+	length = prefix + total + suffix;
+	memcpy(&chars[prefix + total], WRAP_SUFFIX, suffix);
+
+	/* comment out shebang line, keeping line numbers */
+	if (total > 1 && chars[prefix] == '#' && chars[prefix+1] == '!') {
+		chars[prefix] = '/';
+		chars[prefix+1] = '/';
+	}
+
+	if (is_ascii(chars, length)) {
+		return v8::String::NewExternalOneByte(JS_ISOLATE, new SourceResource(chars, length)).ToLocalChecked();
+	}
+	v8::Local<v8::String> source = JS_STR_LEN(chars, (int) length);
+	free(chars);
 	return source;
 }
 
 /**
  * Return dlopen handle for a given file
  */
-void * Cache::getHandle(std::string filename) {
+void * Cache::getHandle(std::string filename, bool now) {
 #ifdef VERBOSE
 	printf("[getHandle] cache try for '%s' .. ", filename.c_str()); 
 #endif	
@@ -116,7 +289,7 @@ void * Cache::getHandle(std::string filename) {
 #ifdef windows
 		SetErrorMode(SEM_FAILCRITICALERRORS);
 #endif
-		void * handle = dlopen(filename.c_str(), RTLD_LAZY);
+		void * handle = dlopen(filename.c_str(), (now ? RTLD_NOW : RTLD_LAZY));
 		if (!handle) { 
 			std::string error = "Error opening shared library '";
 			error += filename;
@@ -149,9 +322,9 @@ void * Cache::getHandle(std::string filename) {
 }
 
 /**
- * Return compiled script from a given file
+ * Return compiled script from a given file, bound to the current context
  */
-v8::Persistent<v8::Script, v8::CopyablePersistentTraits<v8::Script> > Cache::getScript(std::string filename) {
+v8::Local<v8::Script> Cache::getScript(std::string filename) {
 #ifdef VERBOSE
 	printf("[getScript] cache try for '%s' .. ", filename.c_str()); 
 #endif	
@@ -160,32 +333,33 @@ v8::Persistent<v8::Script, v8::CopyablePersistentTraits<v8::Script> > Cache::get
 		printf("[getScript] cache hit\n"); 
 #endif	
 		ScriptValue::iterator it = scripts.find(filename);
-		return it->second;
+		return v8::Local<v8::UnboundScript>::New(JS_ISOLATE, it->second)->BindToCurrentContext();
 	} else {
 #ifdef VERBOSE
 		printf("[getScript] cache miss\n"); 
 #endif
-		std::string source = this->getSource(filename);
 		/* context-independent compiled script */
 		v8::ScriptOrigin origin(JS_ISOLATE,JS_STR(filename.c_str()));
-		//v8::Local<v8::Script> script = v8::Script::Compile(JS_CONTEXT,JS_STR(source.c_str()),&origin).ToLocalChecked();
-		v8::MaybeLocal<v8::Script> script_ml = v8::Script::Compile(JS_CONTEXT,JS_STR(source.c_str()),&origin);
-		v8::Persistent<v8::Script, v8::CopyablePersistentTraits<v8::Script> > _script;
-		if (script_ml.IsEmpty()) {
-			return _script;
+		v8::ScriptCompiler::Source src(this->getSource(filename), origin);
+		v8::ScriptCompiler::CompileOptions options = (eager.count(filename) ? v8::ScriptCompiler::kEagerCompile : v8::ScriptCompiler::kNoCompileOptions);
+		v8::Local<v8::UnboundScript> script;
+		if (!v8::ScriptCompiler::CompileUnboundScript(JS_ISOLATE, &src, options).ToLocal(&script)) {
+			return v8::Local<v8::Script>();
 		}
-		v8::Local<v8::Script> script = script_ml.ToLocalChecked();
-		_script.Reset(JS_ISOLATE, script);
 
-		if (!script.IsEmpty()) {
-			this->mark(filename); /* mark as cached */
-			scripts[filename] = _script;
-			return _script;
-		}
-		return _script;
+		this->mark(filename); /* mark as cached */
+		scripts[filename].Reset(JS_ISOLATE, script);
+		return script->BindToCurrentContext();
 	}
 }
 
+/**
+ * Mark a file for eager compilation; takes effect when it is (re)compiled
+ */
+void Cache::setEager(std::string filename) {
+	if (eager.insert(filename).second) { this->erase(filename); }
+}
+
 /**
  * Return exports object for a given file
  */
@@ -229,26 +403,39 @@ void Cache::removeExports(std::string filename) {
 		it->second.Reset();
 		exports.erase(it);
 	}
+	persistent.erase(filename);
 }
 
 /**
  * Remove all cached exports
  */
-void Cache::clearExports() {
-	ExportsValue::iterator it;
-	for (it=exports.begin(); it != exports.end(); it++) {
+void Cache::clearExports(bool keepPersistent) {
+	ExportsValue::iterator it = exports.begin();
+	while (it != exports.end()) {
+		if (keepPersistent && persistent.count(it->first)) {
+			it++;
+			continue;
+		}
 		it->second.Reset();
+		exports.erase(it++);
 	}
-	exports.clear();
+	if (!keepPersistent) { persistent.clear(); }
 }
 
 /**
- * Wrap a string with exports envelope
+ * Mark module as request-independent
  */
-std::string Cache::wrapExports(std::string code) {
-	std::string result = "";
-	result += "(function(require,exports,module){";
-	result += code;
-	result += "\n})";
-	return result;
+void Cache::setPersistent(std::string filename) {
+	persistent.insert(filename);
+}
+
+bool Cache::isPersistent(std::string filename) {
+	return (persistent.count(filename) > 0);
+}
+
+bool Cache::isCurrent(std::vector<std::string> filenames) {
+	for (unsigned int i=0; i<filenames.size(); i++) {
+		if (!this->isCached(filenames[i])) { return false; }
+	}
+	return true;
 }
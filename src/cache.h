@@ -1,33 +1,64 @@
 /*
  * There are multiple caching levels in TeaJS.
  * - getHandle checks file's MTIME and provides source code / DSO handle
- * - getScript checks file's MTIME and provides compiled source code
+ * - getScript checks file's MTIME and provides compiled source code; compiled once, bound to each context
  * - getExports returns module's "exports" object. No checks are performed, exports are valid through whole request.
+ *   Modules which set "module.persistent = true" keep their exports across requests when the context is reused.
+ * - getResolved/setResolved remember module name resolution (only in INOTIFY and PRODUCTION modes)
+ *
+ * The mode (Config.moduleCache) decides how cached files are validated:
+ * - STAT: stat every file on every use (default)
+ * - INOTIFY: watch directories of cached files, drop entries when something changes there (Linux only; elsewhere STAT)
+ * - PRODUCTION: never check, files are assumed not to change while the process runs
  */
 
 #ifndef _JS_CACHE_H
 #define _JS_CACHE_H
 
 #include <string>
+#include <vector>
 #include <map>
+#include <set>
 #include "v8.h"
 //#include "v8-util.h"
 
 class Cache {
 public:
-	void * getHandle(std::string filename);
-	v8::Persistent<v8::Script, v8::CopyablePersistentTraits<v8::Script> > getScript(std::string filename);
+	enum Mode { STAT, INOTIFY, PRODUCTION };
+
+	Cache();
+	~Cache();
+	void setMode(Mode mode);
+	Mode getMode() { return this->mode; }
+	/* process pending change notifications; call once per request */
+	void poll();
+
+	bool getResolved(std::string key, std::vector<std::string> & files);
+	/* dirs: directories whose content decides the resolution */
+	void setResolved(std::string key, std::vector<std::string> files, std::vector<std::string> dirs);
+
+	/* @param {bool} now resolve all symbols at load time (RTLD_NOW) */
+	void * getHandle(std::string filename, bool now = false);
+	/* empty when compilation failed (exception is pending) */
+	v8::Local<v8::Script> getScript(std::string filename);
+	/* compile this file eagerly (all inner functions) instead of lazily */
+	void setEager(std::string filename);
 	v8::Persistent<v8::Object, v8::CopyablePersistentTraits<v8::Object> > getExports(std::string filename);
 	//v8::Global<v8::Script, v8::CopyablePersistentTraits<v8::Script> > getScript(std::string filename);
 	//v8::Global<v8::Object, v8::CopyablePersistentTraits<v8::Object> > getExports(std::string filename);
-	void clearExports();
+	/* keepPersistent: leave exports of persistent modules in place (reused context) */
+	void clearExports(bool keepPersistent = false);
+	void setPersistent(std::string filename);
+	bool isPersistent(std::string filename);
+	/* are all these files still the ones which were loaded? */
+	bool isCurrent(std::vector<std::string> filenames);
 	void addExports(std::string filename, v8::Local<v8::Object> obj);
 	void removeExports(std::string filename);
 
 private:
 	typedef std::map<std::string, time_t> TimeValue;
 	typedef std::map<std::string, void*> HandleValue;
-	typedef std::map<std::string, v8::Persistent<v8::Script, v8::CopyablePersistentTraits<v8::Script> > > ScriptValue;
+	typedef std::map<std::string, v8::Global<v8::UnboundScript> > ScriptValue;
 	typedef std::map<std::string, v8::Persistent<v8::Object, v8::CopyablePersistentTraits<v8::Object> > > ExportsValue;
 	//typedef std::map<std::string, v8::Global<v8::Script, v8::CopyablePersistentTraits<v8::Script> > > ScriptValue;
 	//typedef std::map<std::string, v8::Global<v8::Object, v8::CopyablePersistentTraits<v8::Object> > > ExportsValue;
@@ -40,13 +71,25 @@ private:
 	HandleValue handles;
 	/* compiled scripts */
 	ScriptValue scripts;
+	/* files with the eager compile hint */
+	std::set<std::string> eager;
+	/* modules whose exports survive clearExports(true) */
+	std::set<std::string> persistent;
 	/* exports */
 	ExportsValue exports;
+	/* resolved module names */
+	std::map<std::string, std::vector<std::string> > resolved;
+
+	Mode mode;
+	int notify_fd; /* inotify descriptor, -1 when not watching */
+	std::map<int, std::string> watches; /* watch descriptor => directory */
+	void watch(std::string dir);
+	void rewatch();
 	
-	std::string getSource(std::string filename);
-	std::string wrapExports(std::string code);
+	v8::Local<v8::String> getSource(std::string filename);
 	void mark(std::string filename);
 	bool isCached(std::string filename);
+	bool changed(std::string filename);
 	void erase(std::string filename);
 };
 
@@ -3,9 +3,15 @@
  * when its JS representation gets GC'ed.
  */
 
+#include <chrono>
+#include <libplatform/libplatform.h>
 #include "gc.h"
 #include "macros.h"
 
+static double now_ms() {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 void GC::WeakCallback(const v8::WeakCallbackInfo<GCObject>& data) {
 	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
 	
@@ -80,9 +86,69 @@ void GC::add(v8::Local<v8::Value> object, GC_dtor_v dtor,int internal_index)
 }
 
 
+GC::GC() {
+	this->inside.count = 0;
+	this->inside.time = 0;
+	this->outside.count = 0;
+	this->outside.time = 0;
+	this->idle_collections = 0;
+	this->in_request = false;
+	this->pause_start = 0;
+	this->baseline = 0;
+}
+
 GC::~GC() {
 }
 
+void GC::install(v8::Isolate * isolate) {
+	isolate->AddGCPrologueCallback(GC::prologue, this);
+	isolate->AddGCEpilogueCallback(GC::epilogue, this);
+}
+
+void GC::prologue(v8::Isolate * isolate, v8::GCType type, v8::GCCallbackFlags flags, void * data) {
+	((GC *) data)->pause_start = now_ms();
+}
+
+void GC::epilogue(v8::Isolate * isolate, v8::GCType type, v8::GCCallbackFlags flags, void * data) {
+	GC * gc = (GC *) data;
+	pauses_t & pauses = (gc->in_request ? gc->inside : gc->outside);
+	pauses.count++;
+	pauses.time += now_ms() - gc->pause_start;
+}
+
+void GC::request_start() {
+	this->in_request = true;
+}
+
+void GC::request_end() {
+	this->in_request = false;
+}
+
+void GC::idle(v8::Platform * platform, double budget, size_t growth) {
+	v8::Isolate * isolate = JS_ISOLATE;
+	v8::HeapStatistics stats;
+	isolate->GetHeapStatistics(&stats);
+	size_t used = stats.used_heap_size();
+	if (used < this->baseline) { this->baseline = used; } /* a regular GC shrank the heap */
+
+	if (growth && used > this->baseline + growth) {
+		/* the heap grew a lot; pay for a full collection now rather than mid-request */
+		isolate->LowMemoryNotification();
+		this->idle_collections++;
+		isolate->GetHeapStatistics(&stats);
+		this->baseline = stats.used_heap_size();
+	} else if (budget > 0) {
+		/* advance incremental marking and run pending GC tasks until the budget is spent */
+		double deadline = platform->MonotonicallyIncreasingTime() + budget;
+		if (growth && used > this->baseline + growth / 2) {
+			/* halfway there: let V8 start marking before a full collection is due */
+			isolate->MemoryPressureNotification(v8::MemoryPressureLevel::kModerate);
+		}
+		isolate->IdleNotificationDeadline(deadline);
+		while (platform->MonotonicallyIncreasingTime() < deadline && v8::platform::PumpMessageLoop(platform, isolate)) {}
+	}
+}
+
 GCObject::GCObject()
 {
 	dtor_t_ptr=NULL;
@@ -28,6 +28,7 @@ class GCObject {
 
 class GC {
 public:
+	GC();
 	virtual ~GC();
 
 	// vahvarh
@@ -38,6 +39,39 @@ public:
 	virtual void add(v8::Local<v8::Value> object, const char *name);
 	virtual void add(v8::Local<v8::Value> object, GC_dtor_v dtor,void*ptr);*/
 	virtual void add(v8::Local<v8::Value> object, GC_dtor_v dtor,int internal_index);
+
+	/**
+	 * Scheduling: GC pauses are counted separately for time spent inside
+	 * a request and between requests; idle() does collection work while
+	 * no client is waiting.
+	 */
+	typedef struct {
+		unsigned int count;
+		double time; /* ms */
+	} pauses_t;
+
+	pauses_t inside;
+	pauses_t outside;
+	unsigned int idle_collections; /* full collections started by idle() */
+
+	/* register pause counters with the isolate */
+	void install(v8::Isolate * isolate);
+	void request_start();
+	void request_end();
+	/**
+	 * @param {v8::Platform *} platform for running GC tasks
+	 * @param {double} budget seconds we may spend; 0 = no incremental work
+	 * @param {size_t} growth bytes of heap growth since the last idle GC that warrant a full collection; 0 = never
+	 */
+	void idle(v8::Platform * platform, double budget, size_t growth);
+
+private:
+	bool in_request;
+	double pause_start;
+	size_t baseline; /* used heap after the last idle() collection, lowered when the heap shrinks */
+
+	static void prologue(v8::Isolate * isolate, v8::GCType type, v8::GCCallbackFlags flags, void * data);
+	static void epilogue(v8::Isolate * isolate, v8::GCType type, v8::GCCallbackFlags flags, void * data);
 };
 
 #endif
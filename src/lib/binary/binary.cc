@@ -4,6 +4,7 @@
 #include "macros.h"
 #include "gc.h"
 #include "bytestorage.h"
+#include "textcodec.h"
 
 #define BS_OTHER(object) LOAD_PTR_FROM(object, 0, ByteStorage *)
 #define BS_THIS BS_OTHER(args.This())
@@ -82,6 +83,18 @@ void Buffer_fromString(const v8::FunctionCallbackInfo<v8::Value>& args) {
 	v8::String::Utf8Value str(JS_ISOLATE,args[0]);
 	v8::String::Utf8Value charset(JS_ISOLATE,args[1]);
 	
+	textcodec_t codec = textcodec_find(*charset);
+	if (codec != TEXTCODEC_NONE) {
+		try {
+			ByteStorage * bs = textcodec_decode(codec, *str, str.length());
+			SAVE_PTR(0, bs);
+			args.GetReturnValue().Set(v8::Local<v8::Value>());
+		} catch (std::string e) {
+			JS_ERROR(e);
+		}
+		return;
+	}
+
 	ByteStorage bs_tmp((char *) (*str), str.length());
 	try
 	{
@@ -182,6 +195,17 @@ JS_METHOD(Buffer_toString) {
 	size_t index1 = firstIndex(args[1], bs->getLength());
 	size_t index2 = lastIndex(args[2], bs->getLength());
 	if (index1>index2) { WRONG_START_STOP; return; }
+
+	textcodec_t codec = textcodec_find(*charset);
+	if (codec != TEXTCODEC_NONE) { /* ASCII output, no iconv round trip */
+		size_t length = textcodec_encoded_length(codec, index2 - index1);
+		if (length > (size_t) v8::String::kMaxLength) { WRONG_SIZE; return; }
+		std::string result(length, '\0');
+		textcodec_encode(codec, (const unsigned char *) bs->getData() + index1, index2 - index1, &result[0]);
+		args.GetReturnValue().Set(v8::String::NewFromOneByte(JS_ISOLATE, (const uint8_t *) result.data(), v8::NewStringType::kNormal, (int) length).ToLocalChecked());
+		return;
+	}
+
 	ByteStorage view(bs, index1, index2);
 	
 	// TODO vahvarh try
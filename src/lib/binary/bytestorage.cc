@@ -6,6 +6,7 @@
 #include <cstdlib>
 #include "bytestorage.h"
 #include "macros.h"
+#include "metrics.h"
 
 #define ALLOC_ERROR throw std::string("Cannot allocate enough memory")
 
@@ -28,24 +29,38 @@ ByteStorageData::ByteStorageData(size_t _length, size_t _allocated_length)
 	this->length=_length;
 	this->allocated_length=_allocated_length;
 	this->instances = 1;
+	this->owned = true;
 	if (allocated_length) {
 		this->data = (char *) malloc(this->allocated_length);
-		//JS_ISOLATE->AdjustAmountOfExternalAllocatedMemory(allocated_length);
 		if (!this->data) {
 			//fprintf(stderr,"ByteStorageData::ByteStorageData() - Cannot allocate enough memory");
 			//exit(1);
 			ALLOC_ERROR;
 		}
+		Metrics::external(Metrics::BUFFER, this->allocated_length);
 		this->data[this->allocated_length - 1] = '\0';
 	} else {
 		this->data = NULL;
 	}
 }
 
+/**
+ * Wrap memory which is managed elsewhere (e.g. a shared mapping); such data is never reallocated nor freed
+ */
+ByteStorageData::ByteStorageData(char * _data, size_t _length, bool _owned)
+{
+	this->data = _data;
+	this->length = _length;
+	this->allocated_length = (_owned ? _length : 0);
+	this->instances = 1;
+	this->owned = _owned;
+	if (_owned) { Metrics::external(Metrics::BUFFER, _length); } /* freed by the destructor */
+}
+
 ByteStorageData::~ByteStorageData()
 {
-	if (this->data) {
-		//JS_ISOLATE->AdjustAmountOfExternalAllocatedMemory(-allocated_length);
+	if (this->data && this->owned) {
+		Metrics::external(Metrics::BUFFER, -(int64_t) this->allocated_length);
 		free(this->data);
 	}
 }
@@ -75,11 +90,17 @@ size_t ByteStorageData::getAllocatedLength()
 	return this->allocated_length;
 }
 
+bool ByteStorageData::isOwned()
+{
+	return this->owned;
+}
+
 void ByteStorageData::add(const char *add, size_t _length)
 {
 	//printf("ByteStorageData::add(const char *add,%d) this->length=%d,this->allocated_length=%d\n",_length,this->length,this->allocated_length);
 	if (this->length + _length >= this->allocated_length) {
-		//JS_ISOLATE->AdjustAmountOfExternalAllocatedMemory(-allocated_length);
+		if (!this->owned) { throw std::string("Cannot resize external byte storage"); }
+		size_t previous = this->allocated_length;
 		if (!this->allocated_length) {
 			this->allocated_length = 1;
 		}
@@ -96,7 +117,7 @@ void ByteStorageData::add(const char *add, size_t _length)
 			ALLOC_ERROR;
 		}
 		this->data[this->allocated_length - 1] = '\0';
-		//JS_ISOLATE->AdjustAmountOfExternalAllocatedMemory(allocated_length);
+		Metrics::external(Metrics::BUFFER, (int64_t) this->allocated_length - (int64_t) previous);
 		memmove(this->data,tmp,this->length);
 		free(tmp);
 	}
@@ -125,7 +146,6 @@ void ByteStorageData::pop_back(size_t _length)
 ByteStorage::ByteStorage(size_t length) {
 	this->length = length;
 	this->storage = new ByteStorageData(length);
-	JS_ISOLATE->AdjustAmountOfExternalAllocatedMemory(length);
 	this->data = this->storage->getData();
 }
 
@@ -134,7 +154,6 @@ ByteStorage::ByteStorage(ByteStorageData *_data)
 	//printf("ByteStorage::ByteStorage(ByteStorageData) length=%d, allocated_length=%d\n",_data->length,_data->allocated_length);
 	this->length=_data->getLength();
 	this->storage=_data;
-	JS_ISOLATE->AdjustAmountOfExternalAllocatedMemory(_data->getAllocatedLength());
 	this->data = this->storage->getData();
 }
 
@@ -144,7 +163,6 @@ ByteStorage::ByteStorage(ByteStorageData *_data)
 ByteStorage::ByteStorage(const char* data, size_t length) {
 	this->length = length;
 	this->storage = new ByteStorageData(length);
-	JS_ISOLATE->AdjustAmountOfExternalAllocatedMemory(length);
 	this->data = this->storage->getData();
 	
 	if (length) { memcpy(this->data, data, length); }
@@ -162,10 +180,7 @@ ByteStorage::~ByteStorage() {
 	size_t inst = this->storage->getInstances();
 	inst--;
 	this->storage->setInstances(inst);
-	if (!inst) { 
-		delete this->storage;
-		JS_ISOLATE->AdjustAmountOfExternalAllocatedMemory(-length);
-	} /* last reference */
+	if (!inst) { delete this->storage; } /* last reference; ByteStorageData reports the memory */
 	
 	this->storage = NULL;
 }
@@ -9,12 +9,14 @@ class ByteStorageData {
 public:
 	//ByteStorageData(size_t _length);
 	ByteStorageData(size_t _length,size_t _allocated_length=0);
+	ByteStorageData(char * _data, size_t _length, bool _owned); /* wrap existing memory, free() it only when owned */
 	~ByteStorageData();
 	size_t getInstances();
 	void setInstances(size_t instances);
 	char * getData();
 	size_t getLength();
 	size_t getAllocatedLength();
+	bool isOwned();
 	void add(const char *add, size_t _length);
 	void pop_back(size_t _length = 1);
 private:
@@ -22,6 +24,7 @@ private:
 	size_t length;
 	size_t allocated_length;
 	size_t instances;
+	bool owned;
 
 	friend ByteStorage;
 };
@@ -0,0 +1,347 @@
+/**
+ * Base64 and hex codecs for Buffer. Large inputs go through AVX2 kernels
+ * (Mula & Lemire, "Faster Base64 Encoding and Decoding using AVX2
+ * Instructions"); everything else, including the tails and blocks with
+ * whitespace or base64url characters, is handled by table-driven scalar code.
+ */
+
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <strings.h>
+#include <string>
+#include <stdint.h>
+#include "bytestorage.h"
+#include "textcodec.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  include <immintrin.h>
+#  define HAVE_AVX2_TARGET
+#endif
+
+#define ALLOC_ERROR throw std::string("Cannot allocate enough memory")
+
+/* decode table markers; values 0-63 are sextets */
+#define D_INVALID 0xFF
+#define D_SPACE 0xFE
+#define D_PAD 0xFD
+
+namespace {
+
+const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+const char base64url_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+const char hex_alphabet[] = "0123456789abcdef";
+
+unsigned char base64_table[256];
+unsigned char hex_table[256];
+bool tables_ready = false;
+
+void init_tables() {
+	if (tables_ready) { return; }
+	memset(base64_table, D_INVALID, sizeof(base64_table));
+	memset(hex_table, D_INVALID, sizeof(hex_table));
+	for (int i=0; i<64; i++) {
+		base64_table[(unsigned char) base64_alphabet[i]] = i;
+		base64_table[(unsigned char) base64url_alphabet[i]] = i;
+	}
+	base64_table[(unsigned char) '='] = D_PAD;
+	const char * space = " \t\r\n";
+	for (; *space; space++) {
+		base64_table[(unsigned char) *space] = D_SPACE;
+		hex_table[(unsigned char) *space] = D_SPACE;
+	}
+	for (int i=0; i<16; i++) {
+		hex_table[(unsigned char) hex_alphabet[i]] = i;
+		if (i > 9) { hex_table['A' + i - 10] = i; }
+	}
+	tables_ready = true;
+}
+
+std::string malformed(const char * name, size_t position) {
+	char tmp[32];
+	snprintf(tmp, sizeof(tmp), "%lu", (unsigned long) position);
+	return std::string("Malformed ") + name + " sequence at char " + tmp;
+}
+
+#ifdef HAVE_AVX2_TARGET
+bool has_avx2() {
+	static int supported = -1;
+	if (supported == -1) { supported = (__builtin_cpu_supports("avx2") ? 1 : 0); }
+	return supported == 1;
+}
+
+/* spread 3 bytes into four 6-bit fields, one per byte (per 32-bit lane) */
+__attribute__((target("avx2")))
+inline __m256i base64_reshuffle(__m256i in) {
+	in = _mm256_shuffle_epi8(in, _mm256_set_epi8(
+		10, 11,  9, 10,  7,  8,  6,  7,  4,  5,  3,  4,  1,  2,  0,  1,
+		14, 15, 13, 14, 11, 12, 10, 11,  8,  9,  7,  8,  5,  6,  4,  5));
+	__m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00));
+	__m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+	__m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0));
+	__m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+	return _mm256_or_si256(t1, t3);
+}
+
+/* sextets to ASCII: add a per-range offset picked by pshufb */
+__attribute__((target("avx2")))
+inline __m256i base64_translate(__m256i in, __m256i lut) {
+	__m256i indices = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+	__m256i mask = _mm256_cmpgt_epi8(in, _mm256_set1_epi8(25));
+	indices = _mm256_sub_epi8(indices, mask);
+	return _mm256_add_epi8(in, _mm256_shuffle_epi8(lut, indices));
+}
+
+/**
+ * Encodes 24 input bytes into 32 characters per round; every load reads
+ * 32 bytes, so at least that many must remain.
+ * @returns {size_t} number of input bytes consumed
+ */
+__attribute__((target("avx2")))
+size_t base64_encode_avx2(const unsigned char * input, size_t length, char * output, bool url) {
+	/* offsets for 'A', 'a', '0'..'9', then the two alphabet-specific characters */
+	__m256i lut = url
+		? _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -17, 32, 0, 0,
+			65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -17, 32, 0, 0)
+		: _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+			65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+	size_t i = 0;
+	if (length < 32) { return 0; }
+
+	/* first round cannot read 4 bytes before input; shift the lanes instead */
+	__m256i in = _mm256_loadu_si256((const __m256i *) input);
+	in = _mm256_permutevar8x32_epi32(in, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6));
+	_mm256_storeu_si256((__m256i *) output, base64_translate(base64_reshuffle(in), lut));
+	i += 24;
+	output += 32;
+
+	for (; i + 28 <= length; i += 24) {
+		in = _mm256_loadu_si256((const __m256i *) (input + i - 4));
+		_mm256_storeu_si256((__m256i *) output, base64_translate(base64_reshuffle(in), lut));
+		output += 32;
+	}
+	return i;
+}
+
+/**
+ * Decodes 32 characters into 24 bytes per round (writing 32), stopping at
+ * the first block with anything outside the standard alphabet.
+ * @returns {size_t} number of input characters consumed
+ */
+__attribute__((target("avx2")))
+size_t base64_decode_avx2(const unsigned char * input, size_t length, unsigned char * output) {
+	const __m256i lut_lo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m256i lut_hi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i mask_2F = _mm256_set1_epi8(0x2F);
+
+	size_t i = 0;
+	for (; i + 32 <= length; i += 32) {
+		__m256i str = _mm256_loadu_si256((const __m256i *) (input + i));
+		__m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2F);
+		__m256i lo_nibbles = _mm256_and_si256(str, mask_2F);
+		__m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+		__m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+		if (!_mm256_testz_si256(lo, hi)) { break; }
+
+		__m256i eq_2F = _mm256_cmpeq_epi8(str, mask_2F);
+		__m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2F, hi_nibbles));
+		str = _mm256_add_epi8(str, roll);
+
+		/* pack four sextets into three bytes */
+		__m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+		__m256i out = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+		out = _mm256_shuffle_epi8(out, _mm256_setr_epi8(
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		out = _mm256_permutevar8x32_epi32(out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+		_mm256_storeu_si256((__m256i *) output, out);
+		output += 24;
+	}
+	return i;
+}
+
+/* 32 bytes into 64 hex digits per round */
+__attribute__((target("avx2")))
+size_t hex_encode_avx2(const unsigned char * input, size_t length, char * output) {
+	const __m256i lut = _mm256_setr_epi8(
+		'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+		'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	size_t i = 0;
+	for (; i + 32 <= length; i += 32) {
+		__m256i in = _mm256_loadu_si256((const __m256i *) (input + i));
+		__m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(in, 4), nibble));
+		__m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(in, nibble));
+		/* unpack works per 128-bit lane: a = bytes 0-7|16-23, b = 8-15|24-31 */
+		__m256i a = _mm256_unpacklo_epi8(hi, lo);
+		__m256i b = _mm256_unpackhi_epi8(hi, lo);
+		_mm256_storeu_si256((__m256i *) (output + 2*i), _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256((__m256i *) (output + 2*i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+	}
+	return i;
+}
+#endif
+
+void base64_encode(const unsigned char * input, size_t length, char * output, bool url) {
+	const char * alphabet = (url ? base64url_alphabet : base64_alphabet);
+	size_t i = 0;
+#ifdef HAVE_AVX2_TARGET
+	if (length >= 64 && has_avx2()) {
+		i = base64_encode_avx2(input, length, output, url);
+		output += (i / 3) * 4;
+	}
+#endif
+	for (; i + 3 <= length; i += 3) {
+		uint32_t triple = (input[i] << 16) | (input[i+1] << 8) | input[i+2];
+		*output++ = alphabet[(triple >> 18) & 0x3F];
+		*output++ = alphabet[(triple >> 12) & 0x3F];
+		*output++ = alphabet[(triple >> 6) & 0x3F];
+		*output++ = alphabet[triple & 0x3F];
+	}
+	size_t rest = length - i;
+	if (!rest) { return; }
+	uint32_t triple = (input[i] << 16) | (rest > 1 ? input[i+1] << 8 : 0);
+	*output++ = alphabet[(triple >> 18) & 0x3F];
+	*output++ = alphabet[(triple >> 12) & 0x3F];
+	if (rest > 1) { *output++ = alphabet[(triple >> 6) & 0x3F]; }
+	if (url) { return; }
+	if (rest == 1) { *output++ = '='; }
+	*output++ = '=';
+}
+
+void hex_encode(const unsigned char * input, size_t length, char * output) {
+	size_t i = 0;
+#ifdef HAVE_AVX2_TARGET
+	if (length >= 64 && has_avx2()) { i = hex_encode_avx2(input, length, output); }
+#endif
+	for (; i < length; i++) {
+		output[2*i] = hex_alphabet[input[i] >> 4];
+		output[2*i+1] = hex_alphabet[input[i] & 0x0F];
+	}
+}
+
+/**
+ * @returns {size_t} number of bytes written; output needs 3/4 of length plus 32 bytes of slack
+ */
+size_t base64_decode(const unsigned char * input, size_t length, unsigned char * output) {
+	unsigned char * start = output;
+	uint32_t quad = 0;
+	int count = 0; /* sextets in quad */
+	bool padded = false;
+#ifdef HAVE_AVX2_TARGET
+	bool avx2 = (length >= 64 && has_avx2());
+#endif
+
+	size_t i = 0;
+	while (i < length) {
+#ifdef HAVE_AVX2_TARGET
+		/* resume the vector loop whenever we are back on a quad boundary */
+		if (avx2 && count == 0 && !padded && i + 32 <= length) {
+			size_t done = base64_decode_avx2(input + i, length - i, output);
+			output += (done / 4) * 3;
+			i += done;
+			if (i >= length) { break; }
+		}
+#endif
+		unsigned char value = base64_table[input[i]];
+		if (value < 64) {
+			if (padded) { throw malformed("base64", i); }
+			quad = (quad << 6) | value;
+			if (++count == 4) {
+				*output++ = (unsigned char) (quad >> 16);
+				*output++ = (unsigned char) (quad >> 8);
+				*output++ = (unsigned char) quad;
+				quad = 0;
+				count = 0;
+			}
+		} else if (value == D_PAD) {
+			if (count < 2) { throw malformed("base64", i); }
+			padded = true;
+		} else if (value != D_SPACE) {
+			throw malformed("base64", i);
+		}
+		i++;
+	}
+
+	if (count == 1) { throw malformed("base64", length); }
+	if (count == 2) {
+		*output++ = (unsigned char) (quad >> 4);
+	} else if (count == 3) {
+		*output++ = (unsigned char) (quad >> 10);
+		*output++ = (unsigned char) (quad >> 2);
+	}
+	return output - start;
+}
+
+size_t hex_decode(const unsigned char * input, size_t length, unsigned char * output) {
+	unsigned char * start = output;
+	int high = -1;
+	for (size_t i=0; i<length; i++) {
+		unsigned char value = hex_table[input[i]];
+		if (value == D_SPACE) { continue; }
+		if (value == D_INVALID) { throw malformed("hex", i); }
+		if (high == -1) {
+			high = value;
+		} else {
+			*output++ = (unsigned char) ((high << 4) | value);
+			high = -1;
+		}
+	}
+	if (high != -1) { throw malformed("hex", length); }
+	return output - start;
+}
+
+} /* end namespace */
+
+textcodec_t textcodec_find(const char * charset) {
+	if (!strcasecmp(charset, "base64")) { return TEXTCODEC_BASE64; }
+	if (!strcasecmp(charset, "base64url")) { return TEXTCODEC_BASE64URL; }
+	if (!strcasecmp(charset, "hex")) { return TEXTCODEC_HEX; }
+	return TEXTCODEC_NONE;
+}
+
+size_t textcodec_encoded_length(textcodec_t codec, size_t length) {
+	switch (codec) {
+		case TEXTCODEC_BASE64: return ((length + 2) / 3) * 4;
+		case TEXTCODEC_BASE64URL: return (length / 3) * 4 + (length % 3 ? length % 3 + 1 : 0);
+		case TEXTCODEC_HEX: return length * 2;
+		default: return 0;
+	}
+}
+
+void textcodec_encode(textcodec_t codec, const unsigned char * input, size_t length, char * output) {
+	switch (codec) {
+		case TEXTCODEC_BASE64: base64_encode(input, length, output, false); break;
+		case TEXTCODEC_BASE64URL: base64_encode(input, length, output, true); break;
+		case TEXTCODEC_HEX: hex_encode(input, length, output); break;
+		default: break;
+	}
+}
+
+ByteStorage * textcodec_decode(textcodec_t codec, const char * input, size_t length) {
+	init_tables();
+	/* upper bound; the exact size is known only after whitespace and padding are skipped */
+	size_t max = (codec == TEXTCODEC_HEX ? length / 2 : (length / 4) * 3 + 2) + 32;
+	unsigned char * output = (unsigned char *) malloc(max);
+	if (!output) { ALLOC_ERROR; }
+
+	size_t written;
+	try {
+		if (codec == TEXTCODEC_HEX) {
+			written = hex_decode((const unsigned char *) input, length, output);
+		} else {
+			written = base64_decode((const unsigned char *) input, length, output);
+		}
+	} catch (std::string &) {
+		free(output);
+		throw;
+	}
+	return new ByteStorage(new ByteStorageData((char *) output, written, true));
+}
@@ -0,0 +1,36 @@
+#ifndef _TEXTCODEC_H
+#define _TEXTCODEC_H
+
+#include <stddef.h>
+
+class ByteStorage;
+
+/**
+ * Binary-to-text encodings which Buffer handles natively instead of
+ * going through iconv: base64 (RFC 4648 section 4), base64url (section 5,
+ * unpadded) and lowercase hex.
+ */
+typedef enum {
+	TEXTCODEC_NONE = 0,
+	TEXTCODEC_BASE64,
+	TEXTCODEC_BASE64URL,
+	TEXTCODEC_HEX
+} textcodec_t;
+
+/* recognize a charset name (case-insensitive); TEXTCODEC_NONE for anything else */
+textcodec_t textcodec_find(const char * charset);
+
+/* exact number of characters produced by textcodec_encode */
+size_t textcodec_encoded_length(textcodec_t codec, size_t length);
+
+/* writes textcodec_encoded_length() characters to output */
+void textcodec_encode(textcodec_t codec, const unsigned char * input, size_t length, char * output);
+
+/**
+ * Decode text into a new ByteStorage. Whitespace is skipped and base64
+ * accepts both alphabets, with or without padding.
+ * Throws std::string on malformed input.
+ */
+ByteStorage * textcodec_decode(textcodec_t codec, const char * input, size_t length);
+
+#endif
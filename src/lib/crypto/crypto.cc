@@ -0,0 +1,425 @@
+/**
+ * Hashing library. Incremental Hash/Hmac objects atop OpenSSL EVP, one-shot
+ * digests, plus the non-cryptographic CRC32C and xxHash checksums.
+ */
+
+#include <v8.h>
+#include "macros.h"
+#include "common.h"
+
+#include <string>
+#include <cstring>
+#include <stdint.h>
+
+#include <openssl/evp.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  include <nmmintrin.h>
+#  define HAVE_SSE42_TARGET
+#endif
+
+#define HASH_PTR Hash * hash = LOAD_PTR(0, Hash *)
+
+namespace {
+
+/**
+ * Bytes of a JS value: Buffer contents in place, anything else as UTF-8
+ */
+class Bytes {
+public:
+	Bytes(v8::Local<v8::Value> value) {
+		if (IS_BUFFER(value)) {
+			size_t size = 0;
+			this->data = JS_BUFFER_TO_CHAR(value, &size);
+			this->length = size;
+		} else {
+			v8::String::Utf8Value str(JS_ISOLATE, value);
+			this->storage.assign(*str, str.length());
+			this->data = this->storage.data();
+			this->length = this->storage.length();
+		}
+	}
+
+	const char * data;
+	size_t length;
+
+private:
+	std::string storage;
+};
+
+class Hash {
+public:
+	Hash() : ctx(NULL), key(NULL), finished(false) {}
+	~Hash() {
+		if (ctx) { EVP_MD_CTX_free(ctx); }
+		if (key) { EVP_PKEY_free(key); }
+	}
+
+	EVP_MD_CTX * ctx;
+	EVP_PKEY * key; /* HMAC only */
+	bool finished;
+};
+
+void Hash_destroy(void * ptr) {
+	delete (Hash *) ptr;
+}
+
+/**
+ * @returns {Buffer || string} Buffer by default, lowercase hex for "hex"
+ */
+v8::Local<v8::Value> output(const unsigned char * data, size_t length, v8::Local<v8::Value> encoding) {
+	if (!encoding->IsUndefined() && !encoding->IsNull()) {
+		v8::String::Utf8Value name(JS_ISOLATE, encoding);
+		if (strcmp(*name, "hex") == 0) {
+			static const char digits[] = "0123456789abcdef";
+			std::string hex(length * 2, '0');
+			for (size_t i=0; i<length; i++) {
+				hex[2*i] = digits[data[i] >> 4];
+				hex[2*i+1] = digits[data[i] & 0xF];
+			}
+			return JS_STR_LEN(hex.data(), (int) hex.length());
+		}
+	}
+	return JS_BUFFER((const char *) data, length);
+}
+
+const EVP_MD * find_digest(v8::Local<v8::Value> name) {
+	v8::String::Utf8Value algorithm(JS_ISOLATE, name);
+	return EVP_get_digestbyname(*algorithm);
+}
+
+/**
+ * Shared constructor for Hash(algorithm) and Hmac(algorithm, key)
+ */
+bool init_hash(const v8::FunctionCallbackInfo<v8::Value>& args, bool hmac) {
+	const EVP_MD * md = find_digest(args[0]);
+	if (!md) { JS_ERROR("Unknown digest algorithm"); return false; }
+
+	Hash * hash = new Hash();
+	hash->ctx = EVP_MD_CTX_new();
+	int ok;
+	if (hmac) {
+		Bytes key(args[1]);
+		hash->key = EVP_PKEY_new_mac_key(EVP_PKEY_HMAC, NULL, (const unsigned char *) key.data, (int) key.length);
+		ok = (hash->key && EVP_DigestSignInit(hash->ctx, NULL, md, NULL, hash->key) == 1);
+	} else {
+		ok = (EVP_DigestInit_ex(hash->ctx, md, NULL) == 1);
+	}
+	if (!ok) {
+		delete hash;
+		JS_ERROR("Cannot initialize digest");
+		return false;
+	}
+
+	SAVE_PTR(0, hash);
+	GC * gc = GC_PTR;
+	gc->add(args.This(), Hash_destroy, 0);
+	return true;
+}
+
+/**
+ * @param {string} algorithm e.g. "md5", "sha1", "sha256", "sha3-512"
+ */
+JS_METHOD(_hash) {
+	ASSERT_CONSTRUCTOR;
+	if (args.Length() < 1) { JS_TYPE_ERROR("Invalid call format. Use 'new Hash(algorithm)'"); return; }
+	if (!init_hash(args, false)) { return; }
+	args.GetReturnValue().Set(args.This());
+}
+
+/**
+ * @param {string} algorithm
+ * @param {Buffer || string} key
+ */
+JS_METHOD(_hmac) {
+	ASSERT_CONSTRUCTOR;
+	if (args.Length() < 2) { JS_TYPE_ERROR("Invalid call format. Use 'new Hmac(algorithm, key)'"); return; }
+	if (!init_hash(args, true)) { return; }
+	args.GetReturnValue().Set(args.This());
+}
+
+/**
+ * @param {Buffer || string} data
+ * @returns {object} this
+ */
+JS_METHOD(_update) {
+	HASH_PTR;
+	if (hash->finished) { JS_ERROR("Digest already finalized"); return; }
+	Bytes data(args[0]);
+	int ok = (hash->key ? EVP_DigestSignUpdate(hash->ctx, data.data, data.length) : EVP_DigestUpdate(hash->ctx, data.data, data.length));
+	if (ok != 1) { JS_ERROR("Digest update failed"); return; }
+	args.GetReturnValue().Set(args.This());
+}
+
+/**
+ * @param {string} [encoding] "hex" for a string
+ * @returns {Buffer || string}
+ */
+JS_METHOD(_digest) {
+	HASH_PTR;
+	if (hash->finished) { JS_ERROR("Digest already finalized"); return; }
+	unsigned char md[EVP_MAX_MD_SIZE];
+	size_t length = sizeof(md);
+	int ok;
+	if (hash->key) {
+		ok = EVP_DigestSignFinal(hash->ctx, md, &length);
+	} else {
+		unsigned int len = 0;
+		ok = EVP_DigestFinal_ex(hash->ctx, md, &len);
+		length = len;
+	}
+	hash->finished = true;
+	if (ok != 1) { JS_ERROR("Digest finalization failed"); return; }
+	args.GetReturnValue().Set(output(md, length, args[0]));
+}
+
+/**
+ * One-shot digest
+ * @param {string} algorithm
+ * @param {Buffer || string} data
+ * @param {string} [encoding]
+ */
+JS_METHOD(_digest_oneshot) {
+	if (args.Length() < 2) { JS_TYPE_ERROR("Invalid call format. Use 'digest(algorithm, data, [encoding])'"); return; }
+	const EVP_MD * md = find_digest(args[0]);
+	if (!md) { JS_ERROR("Unknown digest algorithm"); return; }
+	Bytes data(args[1]);
+	unsigned char result[EVP_MAX_MD_SIZE];
+	unsigned int length = 0;
+	if (EVP_Digest(data.data, data.length, result, &length, md, NULL) != 1) { JS_ERROR("Digest failed"); return; }
+	args.GetReturnValue().Set(output(result, length, args[2]));
+}
+
+/**
+ * One-shot HMAC
+ * @param {string} algorithm
+ * @param {Buffer || string} key
+ * @param {Buffer || string} data
+ * @param {string} [encoding]
+ */
+JS_METHOD(_hmac_oneshot) {
+	if (args.Length() < 3) { JS_TYPE_ERROR("Invalid call format. Use 'hmac(algorithm, key, data, [encoding])'"); return; }
+	const EVP_MD * md = find_digest(args[0]);
+	if (!md) { JS_ERROR("Unknown digest algorithm"); return; }
+	Bytes key(args[1]);
+	Bytes data(args[2]);
+
+	unsigned char result[EVP_MAX_MD_SIZE];
+	size_t length = sizeof(result);
+	EVP_PKEY * pkey = EVP_PKEY_new_mac_key(EVP_PKEY_HMAC, NULL, (const unsigned char *) key.data, (int) key.length);
+	EVP_MD_CTX * ctx = EVP_MD_CTX_new();
+	int ok = (pkey && ctx
+		&& EVP_DigestSignInit(ctx, NULL, md, NULL, pkey) == 1
+		&& EVP_DigestSignUpdate(ctx, data.data, data.length) == 1
+		&& EVP_DigestSignFinal(ctx, result, &length) == 1);
+	if (ctx) { EVP_MD_CTX_free(ctx); }
+	if (pkey) { EVP_PKEY_free(pkey); }
+	if (!ok) { JS_ERROR("HMAC failed"); return; }
+	args.GetReturnValue().Set(output(result, length, args[3]));
+}
+
+/**
+ * CRC32C (Castagnoli): SSE4.2 instruction when available, table otherwise
+ */
+uint32_t crc32c_table[256];
+bool crc32c_table_ready = false;
+
+uint32_t crc32c_soft(uint32_t crc, const unsigned char * data, size_t length) {
+	if (!crc32c_table_ready) {
+		for (uint32_t i=0; i<256; i++) {
+			uint32_t c = i;
+			for (int k=0; k<8; k++) { c = (c & 1 ? (c >> 1) ^ 0x82F63B78 : c >> 1); }
+			crc32c_table[i] = c;
+		}
+		crc32c_table_ready = true;
+	}
+	for (size_t i=0; i<length; i++) { crc = crc32c_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8); }
+	return crc;
+}
+
+#ifdef HAVE_SSE42_TARGET
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hard(uint32_t crc, const unsigned char * data, size_t length) {
+	size_t i = 0;
+#ifdef __x86_64__
+	uint64_t c = crc;
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		c = _mm_crc32_u64(c, word);
+	}
+	crc = (uint32_t) c;
+#endif
+	for (; i < length; i++) { crc = _mm_crc32_u8(crc, data[i]); }
+	return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t seed, const unsigned char * data, size_t length) {
+	uint32_t crc = ~seed;
+#ifdef HAVE_SSE42_TARGET
+	static int hardware = -1;
+	if (hardware == -1) { hardware = (__builtin_cpu_supports("sse4.2") ? 1 : 0); }
+	if (hardware) { return ~crc32c_hard(crc, data, length); }
+#endif
+	return ~crc32c_soft(crc, data, length);
+}
+
+/**
+ * xxHash (XXH32, XXH64); reads assume a little-endian host
+ */
+#define XXH_PRIME32_1 2654435761U
+#define XXH_PRIME32_2 2246822519U
+#define XXH_PRIME32_3 3266489917U
+#define XXH_PRIME32_4 668265263U
+#define XXH_PRIME32_5 374761393U
+
+#define XXH_PRIME64_1 11400714785074694791ULL
+#define XXH_PRIME64_2 14029467366897019727ULL
+#define XXH_PRIME64_3 1609587929392839161ULL
+#define XXH_PRIME64_4 9650029242287828579ULL
+#define XXH_PRIME64_5 2870177450012600261ULL
+
+inline uint32_t rotl32(uint32_t x, int r) { return (x << r) | (x >> (32 - r)); }
+inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+inline uint32_t read32(const unsigned char * p) { uint32_t v; memcpy(&v, p, 4); return v; }
+inline uint64_t read64(const unsigned char * p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+uint32_t xxh32(const unsigned char * p, size_t length, uint32_t seed) {
+	const unsigned char * end = p + length;
+	uint32_t h;
+	if (length >= 16) {
+		uint32_t v1 = seed + XXH_PRIME32_1 + XXH_PRIME32_2;
+		uint32_t v2 = seed + XXH_PRIME32_2;
+		uint32_t v3 = seed;
+		uint32_t v4 = seed - XXH_PRIME32_1;
+		const unsigned char * limit = end - 16;
+		do {
+			v1 = rotl32(v1 + read32(p) * XXH_PRIME32_2, 13) * XXH_PRIME32_1; p += 4;
+			v2 = rotl32(v2 + read32(p) * XXH_PRIME32_2, 13) * XXH_PRIME32_1; p += 4;
+			v3 = rotl32(v3 + read32(p) * XXH_PRIME32_2, 13) * XXH_PRIME32_1; p += 4;
+			v4 = rotl32(v4 + read32(p) * XXH_PRIME32_2, 13) * XXH_PRIME32_1; p += 4;
+		} while (p <= limit);
+		h = rotl32(v1, 1) + rotl32(v2, 7) + rotl32(v3, 12) + rotl32(v4, 18);
+	} else {
+		h = seed + XXH_PRIME32_5;
+	}
+	h += (uint32_t) length;
+	for (; p + 4 <= end; p += 4) { h = rotl32(h + read32(p) * XXH_PRIME32_3, 17) * XXH_PRIME32_4; }
+	for (; p < end; p++) { h = rotl32(h + (*p) * XXH_PRIME32_5, 11) * XXH_PRIME32_1; }
+	h ^= h >> 15; h *= XXH_PRIME32_2;
+	h ^= h >> 13; h *= XXH_PRIME32_3;
+	h ^= h >> 16;
+	return h;
+}
+
+inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+	acc += input * XXH_PRIME64_2;
+	return rotl64(acc, 31) * XXH_PRIME64_1;
+}
+
+inline uint64_t xxh64_merge(uint64_t acc, uint64_t value) {
+	acc ^= xxh64_round(0, value);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+uint64_t xxh64(const unsigned char * p, size_t length, uint64_t seed) {
+	const unsigned char * end = p + length;
+	uint64_t h;
+	if (length >= 32) {
+		uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+		uint64_t v2 = seed + XXH_PRIME64_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - XXH_PRIME64_1;
+		const unsigned char * limit = end - 32;
+		do {
+			v1 = xxh64_round(v1, read64(p)); p += 8;
+			v2 = xxh64_round(v2, read64(p)); p += 8;
+			v3 = xxh64_round(v3, read64(p)); p += 8;
+			v4 = xxh64_round(v4, read64(p)); p += 8;
+		} while (p <= limit);
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = xxh64_merge(h, v1);
+		h = xxh64_merge(h, v2);
+		h = xxh64_merge(h, v3);
+		h = xxh64_merge(h, v4);
+	} else {
+		h = seed + XXH_PRIME64_5;
+	}
+	h += (uint64_t) length;
+	for (; p + 8 <= end; p += 8) { h = rotl64(h ^ xxh64_round(0, read64(p)), 27) * XXH_PRIME64_1 + XXH_PRIME64_4; }
+	if (p + 4 <= end) { h = rotl64(h ^ ((uint64_t) read32(p) * XXH_PRIME64_1), 23) * XXH_PRIME64_2 + XXH_PRIME64_3; p += 4; }
+	for (; p < end; p++) { h = rotl64(h ^ ((*p) * XXH_PRIME64_5), 11) * XXH_PRIME64_1; }
+	h ^= h >> 33; h *= XXH_PRIME64_2;
+	h ^= h >> 29; h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+/**
+ * @param {Buffer || string} data
+ * @param {int} [seed=0] Previous CRC, to checksum in pieces
+ * @returns {int} Unsigned 32-bit CRC
+ */
+JS_METHOD(_crc32c) {
+	Bytes data(args[0]);
+	uint32_t seed = (args.Length() > 1 ? args[1]->Uint32Value(JS_CONTEXT).FromMaybe(0) : 0);
+	args.GetReturnValue().Set(v8::Integer::NewFromUnsigned(JS_ISOLATE, crc32c(seed, (const unsigned char *) data.data, data.length)));
+}
+
+/**
+ * @param {Buffer || string} data
+ * @param {int} [seed=0]
+ * @returns {int} Unsigned 32-bit hash
+ */
+JS_METHOD(_xxh32) {
+	Bytes data(args[0]);
+	uint32_t seed = (args.Length() > 1 ? args[1]->Uint32Value(JS_CONTEXT).FromMaybe(0) : 0);
+	args.GetReturnValue().Set(v8::Integer::NewFromUnsigned(JS_ISOLATE, xxh32((const unsigned char *) data.data, data.length, seed)));
+}
+
+/**
+ * @param {Buffer || string} data
+ * @param {int} [seed=0]
+ * @param {string} [encoding] "hex" for a string
+ * @returns {Buffer || string} Big-endian 64-bit hash
+ */
+JS_METHOD(_xxh64) {
+	Bytes data(args[0]);
+	uint64_t seed = (args.Length() > 1 ? (uint64_t) args[1]->IntegerValue(JS_CONTEXT).FromMaybe(0) : 0);
+	uint64_t h = xxh64((const unsigned char *) data.data, data.length, seed);
+	unsigned char bytes[8];
+	for (int i=7; i>=0; i--) {
+		bytes[i] = (unsigned char) (h & 0xFF);
+		h >>= 8;
+	}
+	args.GetReturnValue().Set(output(bytes, 8, args[2]));
+}
+
+}
+
+SHARED_INIT() {
+	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
+
+	v8::Local<v8::FunctionTemplate> ht = v8::FunctionTemplate::New(JS_ISOLATE, _hash);
+	ht->SetClassName(JS_STR("Hash"));
+	ht->InstanceTemplate()->SetInternalFieldCount(1); /* hash */
+	v8::Local<v8::ObjectTemplate> hpt = ht->PrototypeTemplate();
+	hpt->Set(JS_ISOLATE, "update"	, v8::FunctionTemplate::New(JS_ISOLATE, _update));
+	hpt->Set(JS_ISOLATE, "digest"	, v8::FunctionTemplate::New(JS_ISOLATE, _digest));
+
+	v8::Local<v8::FunctionTemplate> mt = v8::FunctionTemplate::New(JS_ISOLATE, _hmac);
+	mt->SetClassName(JS_STR("Hmac"));
+	mt->InstanceTemplate()->SetInternalFieldCount(1); /* hash */
+	v8::Local<v8::ObjectTemplate> mpt = mt->PrototypeTemplate();
+	mpt->Set(JS_ISOLATE, "update"	, v8::FunctionTemplate::New(JS_ISOLATE, _update));
+	mpt->Set(JS_ISOLATE, "digest"	, v8::FunctionTemplate::New(JS_ISOLATE, _digest));
+
+	(void)exports->Set(JS_CONTEXT, JS_STR("Hash"), ht->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("Hmac"), mt->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("digest"), v8::FunctionTemplate::New(JS_ISOLATE, _digest_oneshot)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("hmac"), v8::FunctionTemplate::New(JS_ISOLATE, _hmac_oneshot)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("crc32c"), v8::FunctionTemplate::New(JS_ISOLATE, _crc32c)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("xxh32"), v8::FunctionTemplate::New(JS_ISOLATE, _xxh32)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("xxh64"), v8::FunctionTemplate::New(JS_ISOLATE, _xxh64)->GetFunction(JS_CONTEXT).ToLocalChecked());
+}
@@ -0,0 +1,732 @@
+/**
+ * JSON to and from UTF-8 bytes. The serializer writes straight into a
+ * Buffer, or in fixed-size chunks to a stream, so that no intermediate JS
+ * string is built; the parser reads Buffers without decoding them first.
+ *
+ * Semantics follow JSON.stringify / JSON.parse (toJSON, boxed primitives,
+ * skipped undefined/function values, well-formed lone surrogates); the
+ * replacer, indentation and reviver arguments are not supported.
+ */
+
+#include <v8.h>
+#include "macros.h"
+#include "common.h"
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+#define JSON_MAX_DEPTH 1024
+#define DEFAULT_CHUNK (64 * 1024)
+#define MIN_CHUNK 1024
+
+#define ALLOC_ERROR throw std::string("Cannot allocate enough memory")
+
+namespace {
+
+/**
+ * Growable output; in stream mode full chunks are handed to stream.write()
+ */
+class Writer {
+public:
+	Writer(size_t size) : data(NULL), length(0), allocated(0), total(0) {
+		this->grow(size);
+	}
+	~Writer() {
+		if (this->data) { free(this->data); }
+	}
+
+	char * data;
+	size_t length;
+	size_t allocated;
+	size_t total; /* bytes passed to the stream */
+	v8::Local<v8::Object> stream;
+	v8::Local<v8::Function> write;
+
+	/* make room for n more bytes; false when the stream threw */
+	bool reserve(size_t n) {
+		if (this->length + n <= this->allocated) { return true; }
+		if (!this->stream.IsEmpty()) {
+			if (!this->flush()) { return false; }
+			if (n <= this->allocated) { return true; }
+		}
+		size_t size = this->allocated * 2;
+		while (size < this->length + n) { size *= 2; }
+		this->grow(size);
+		return true;
+	}
+
+	bool put(const char * str, size_t n) {
+		while (!this->stream.IsEmpty() && this->length + n > this->allocated) { /* long runs are split across chunks */
+			size_t room = this->allocated - this->length;
+			memcpy(this->data + this->length, str, room);
+			this->length += room;
+			str += room;
+			n -= room;
+			if (!this->flush()) { return false; }
+		}
+		if (!this->reserve(n)) { return false; }
+		memcpy(this->data + this->length, str, n);
+		this->length += n;
+		return true;
+	}
+
+	bool put(char ch) {
+		if (!this->reserve(1)) { return false; }
+		this->data[this->length++] = ch;
+		return true;
+	}
+
+	bool flush() {
+		if (!this->length) { return true; }
+		v8::Local<v8::Value> params[1] = { JS_BUFFER(this->data, this->length) };
+		if (this->write->Call(JS_CONTEXT, this->stream, 1, params).IsEmpty()) { return false; }
+		this->total += this->length;
+		this->length = 0;
+		return true;
+	}
+
+	/* hand the memory over to a ByteStorage */
+	ByteStorage * detach() {
+		ByteStorage * bs = new ByteStorage(new ByteStorageData(this->data, this->length, true));
+		this->data = NULL;
+		return bs;
+	}
+
+private:
+	void grow(size_t size) {
+		char * data = (char *) realloc(this->data, size);
+		if (!data) { ALLOC_ERROR; }
+		this->data = data;
+		this->allocated = size;
+	}
+};
+
+/**
+ * Index of the first byte which needs escaping (control, quote, backslash
+ * or non-ASCII) at or after i
+ */
+size_t plain_ascii(const unsigned char * str, size_t i, size_t length) {
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i space = _mm_set1_epi8(0x20);
+	for (; i + 16 <= length; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (str + i));
+		/* signed compare: bytes >= 0x80 are negative, so they match too */
+		__m128i special = _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+		int mask = _mm_movemask_epi8(special);
+		if (mask) { return i + __builtin_ctz(mask); }
+	}
+#endif
+	for (; i < length; i++) {
+		unsigned char ch = str[i];
+		if (ch < 0x20 || ch >= 0x80 || ch == '"' || ch == '\\') { return i; }
+	}
+	return length;
+}
+
+const char hex_digits[] = "0123456789abcdef";
+
+class Serializer {
+public:
+	Serializer(Writer & out) : out(out) {
+		this->toJSON = v8::String::NewFromUtf8(JS_ISOLATE, "toJSON", v8::NewStringType::kInternalized).ToLocalChecked();
+	}
+
+	/**
+	 * @returns {int} 1 written, 0 nothing to write (undefined), -1 exception pending
+	 */
+	int top(v8::Local<v8::Value> value) {
+		if (!this->resolve(value, JS_STR(""))) { return -1; }
+		if (skipped(value)) { return 0; }
+		return (this->value(value) ? 1 : -1);
+	}
+
+private:
+	Writer & out;
+	v8::Local<v8::String> toJSON;
+	std::vector<v8::Local<v8::Object> > stack; /* cycle detection */
+	std::vector<uint8_t> one_byte;
+	std::vector<uint16_t> two_byte;
+
+	static bool skipped(v8::Local<v8::Value> value) {
+		return value->IsUndefined() || value->IsFunction() || value->IsSymbol();
+	}
+
+	/* apply toJSON and unbox primitive wrappers */
+	bool resolve(v8::Local<v8::Value> & value, v8::Local<v8::Value> key) {
+		if (!value->IsObject()) { return true; }
+		v8::Local<v8::Object> obj = v8::Local<v8::Object>::Cast(value);
+		v8::Local<v8::Value> toJSON;
+		if (!obj->Get(JS_CONTEXT, this->toJSON).ToLocal(&toJSON)) { return false; }
+		if (toJSON->IsFunction()) {
+			v8::Local<v8::String> name;
+			if (!key->ToString(JS_CONTEXT).ToLocal(&name)) { return false; }
+			v8::Local<v8::Value> params[1] = { name };
+			if (!v8::Local<v8::Function>::Cast(toJSON)->Call(JS_CONTEXT, obj, 1, params).ToLocal(&value)) { return false; }
+			if (!value->IsObject()) { return true; }
+		}
+		if (value->IsNumberObject()) {
+			value = JS_FLOAT(v8::Local<v8::NumberObject>::Cast(value)->ValueOf());
+		} else if (value->IsStringObject()) {
+			value = v8::Local<v8::StringObject>::Cast(value)->ValueOf();
+		} else if (value->IsBooleanObject()) {
+			value = JS_BOOL(v8::Local<v8::BooleanObject>::Cast(value)->ValueOf());
+		}
+		return true;
+	}
+
+	bool value(v8::Local<v8::Value> value) {
+		if (value->IsNull()) { return this->out.put("null", 4); }
+		if (value->IsTrue()) { return this->out.put("true", 4); }
+		if (value->IsFalse()) { return this->out.put("false", 5); }
+		if (value->IsString()) { return this->string(v8::Local<v8::String>::Cast(value)); }
+		if (value->IsNumber()) { return this->number(value); }
+		if (value->IsBigInt()) { JS_TYPE_ERROR("Do not know how to serialize a BigInt"); return false; }
+
+		v8::Local<v8::Object> obj = v8::Local<v8::Object>::Cast(value);
+		for (size_t i=0; i<this->stack.size(); i++) {
+			if (this->stack[i]->StrictEquals(obj)) { JS_TYPE_ERROR("Converting circular structure to JSON"); return false; }
+		}
+		if (this->stack.size() >= JSON_MAX_DEPTH) { JS_RANGE_ERROR("Structure is nested too deep"); return false; }
+
+		v8::HandleScope handle_scope(JS_ISOLATE);
+		this->stack.push_back(obj);
+		bool result = (value->IsArray() ? this->array(v8::Local<v8::Array>::Cast(value)) : this->object(obj));
+		this->stack.pop_back();
+		return result;
+	}
+
+	bool array(v8::Local<v8::Array> arr) {
+		if (!this->out.put('[')) { return false; }
+		uint32_t length = arr->Length();
+		for (uint32_t i=0; i<length; i++) {
+			v8::HandleScope handle_scope(JS_ISOLATE);
+			if (i && !this->out.put(',')) { return false; }
+			v8::Local<v8::Value> item;
+			if (!arr->Get(JS_CONTEXT, i).ToLocal(&item)) { return false; }
+			if (!this->resolve(item, JS_INT(i))) { return false; }
+			if (skipped(item)) {
+				if (!this->out.put("null", 4)) { return false; }
+			} else if (!this->value(item)) {
+				return false;
+			}
+		}
+		return this->out.put(']');
+	}
+
+	bool object(v8::Local<v8::Object> obj) {
+		v8::Local<v8::Array> keys;
+		if (!obj->GetOwnPropertyNames(JS_CONTEXT, static_cast<v8::PropertyFilter>(v8::ONLY_ENUMERABLE | v8::SKIP_SYMBOLS),
+				v8::KeyConversionMode::kConvertToString).ToLocal(&keys)) { return false; }
+		if (!this->out.put('{')) { return false; }
+		bool first = true;
+		uint32_t length = keys->Length();
+		for (uint32_t i=0; i<length; i++) {
+			v8::HandleScope handle_scope(JS_ISOLATE);
+			v8::Local<v8::Value> key;
+			v8::Local<v8::Value> item;
+			if (!keys->Get(JS_CONTEXT, i).ToLocal(&key)) { return false; }
+			if (!obj->Get(JS_CONTEXT, key).ToLocal(&item)) { return false; }
+			if (!this->resolve(item, key)) { return false; }
+			if (skipped(item)) { continue; }
+
+			if (!first && !this->out.put(',')) { return false; }
+			first = false;
+			if (!this->string(v8::Local<v8::String>::Cast(key))) { return false; }
+			if (!this->out.put(':')) { return false; }
+			if (!this->value(item)) { return false; }
+		}
+		return this->out.put('}');
+	}
+
+	bool number(v8::Local<v8::Value> value) {
+		char tmp[32];
+		if (value->IsInt32()) {
+			int size = snprintf(tmp, sizeof(tmp), "%d", (int) v8::Local<v8::Int32>::Cast(value)->Value());
+			return this->out.put(tmp, size);
+		}
+		double d = v8::Local<v8::Number>::Cast(value)->Value();
+		if (!std::isfinite(d)) { return this->out.put("null", 4); }
+		if (d == 0) { return this->out.put('0'); } /* also -0 */
+		if (d == std::floor(d) && std::fabs(d) < 9007199254740992.0) { /* exact integers (below 2^53) print as Number.prototype.toString does */
+			int size = snprintf(tmp, sizeof(tmp), "%.0f", d);
+			return this->out.put(tmp, size);
+		}
+		/* shortest round-trip representation */
+		v8::Local<v8::String> str;
+		if (!value->ToString(JS_CONTEXT).ToLocal(&str)) { return false; }
+		int length = str->Length();
+		if (!this->out.reserve(length)) { return false; }
+		str->WriteOneByte(JS_ISOLATE, (uint8_t *) this->out.data + this->out.length, 0, length, v8::String::NO_NULL_TERMINATION);
+		this->out.length += length;
+		return true;
+	}
+
+	bool escape(uint16_t ch) {
+		char tmp[6] = {'\\', 'u', '0', '0', 0, 0};
+		switch (ch) {
+			case '"': return this->out.put("\\\"", 2);
+			case '\\': return this->out.put("\\\\", 2);
+			case '\b': return this->out.put("\\b", 2);
+			case '\f': return this->out.put("\\f", 2);
+			case '\n': return this->out.put("\\n", 2);
+			case '\r': return this->out.put("\\r", 2);
+			case '\t': return this->out.put("\\t", 2);
+		}
+		tmp[2] = hex_digits[(ch >> 12) & 0xF];
+		tmp[3] = hex_digits[(ch >> 8) & 0xF];
+		tmp[4] = hex_digits[(ch >> 4) & 0xF];
+		tmp[5] = hex_digits[ch & 0xF];
+		return this->out.put(tmp, 6);
+	}
+
+	bool string(v8::Local<v8::String> str) {
+		int length = str->Length();
+		if (!this->out.put('"')) { return false; }
+
+		if (str->IsOneByte()) { /* Latin-1 */
+			this->one_byte.resize(length);
+			str->WriteOneByte(JS_ISOLATE, this->one_byte.data(), 0, length, v8::String::NO_NULL_TERMINATION);
+			const unsigned char * data = this->one_byte.data();
+			size_t i = 0;
+			while (i < (size_t) length) {
+				size_t next = plain_ascii(data, i, length);
+				if (next > i && !this->out.put((const char *) data + i, next - i)) { return false; }
+				if (next == (size_t) length) { break; }
+				unsigned char ch = data[next];
+				if (ch >= 0x80) {
+					char utf[2] = { (char) (0xC0 | (ch >> 6)), (char) (0x80 | (ch & 0x3F)) };
+					if (!this->out.put(utf, 2)) { return false; }
+				} else if (!this->escape(ch)) {
+					return false;
+				}
+				i = next + 1;
+			}
+			return this->out.put('"');
+		}
+
+		this->two_byte.resize(length);
+		str->Write(JS_ISOLATE, this->two_byte.data(), 0, length, v8::String::NO_NULL_TERMINATION);
+		const uint16_t * data = this->two_byte.data();
+		for (int i=0; i<length; i++) {
+			uint32_t ch = data[i];
+			char utf[4];
+			if (ch < 0x80) {
+				if (ch < 0x20 || ch == '"' || ch == '\\') {
+					if (!this->escape(ch)) { return false; }
+				} else if (!this->out.put((char) ch)) {
+					return false;
+				}
+			} else if (ch < 0x800) {
+				utf[0] = 0xC0 | (ch >> 6);
+				utf[1] = 0x80 | (ch & 0x3F);
+				if (!this->out.put(utf, 2)) { return false; }
+			} else if (ch >= 0xD800 && ch <= 0xDFFF) {
+				if (ch <= 0xDBFF && i + 1 < length && data[i+1] >= 0xDC00 && data[i+1] <= 0xDFFF) {
+					uint32_t cp = 0x10000 + ((ch - 0xD800) << 10) + (data[i+1] - 0xDC00);
+					utf[0] = 0xF0 | (cp >> 18);
+					utf[1] = 0x80 | ((cp >> 12) & 0x3F);
+					utf[2] = 0x80 | ((cp >> 6) & 0x3F);
+					utf[3] = 0x80 | (cp & 0x3F);
+					if (!this->out.put(utf, 4)) { return false; }
+					i++;
+				} else if (!this->escape(ch)) { /* lone surrogate */
+					return false;
+				}
+			} else {
+				utf[0] = 0xE0 | (ch >> 12);
+				utf[1] = 0x80 | ((ch >> 6) & 0x3F);
+				utf[2] = 0x80 | (ch & 0x3F);
+				if (!this->out.put(utf, 3)) { return false; }
+			}
+		}
+		return this->out.put('"');
+	}
+};
+
+/**
+ * Recursive descent parser over UTF-8 bytes
+ */
+class Parser {
+public:
+	Parser(const char * data, size_t length) : start((const unsigned char *) data), p((const unsigned char *) data), end((const unsigned char *) data + length), depth(0) {}
+
+	bool parse(v8::Local<v8::Value> * result) {
+		if (!this->value(result)) { return false; }
+		this->whitespace();
+		if (this->p != this->end) { return this->error(); }
+		return true;
+	}
+
+private:
+	const unsigned char * start;
+	const unsigned char * p;
+	const unsigned char * end;
+	int depth;
+	std::string scratch;
+
+	bool error(const char * reason = NULL) {
+		char tmp[128];
+		if (reason) {
+			snprintf(tmp, sizeof(tmp), "%s in JSON at position %lu", reason, (unsigned long) (this->p - this->start));
+		} else if (this->p == this->end) {
+			snprintf(tmp, sizeof(tmp), "Unexpected end of JSON input");
+		} else {
+			snprintf(tmp, sizeof(tmp), "Unexpected token %c in JSON at position %lu", *this->p, (unsigned long) (this->p - this->start));
+		}
+		JS_SYNTAX_ERROR(tmp);
+		return false;
+	}
+
+	void whitespace() {
+		while (this->p < this->end && (*this->p == ' ' || *this->p == '\n' || *this->p == '\r' || *this->p == '\t')) { this->p++; }
+	}
+
+	bool literal(const char * word, size_t length) {
+		if ((size_t) (this->end - this->p) < length || memcmp(this->p, word, length)) { return this->error(); }
+		this->p += length;
+		return true;
+	}
+
+	bool value(v8::Local<v8::Value> * result) {
+		this->whitespace();
+		if (this->p == this->end) { return this->error(); }
+		switch (*this->p) {
+			case '{': return this->object(result);
+			case '[': return this->array(result);
+			case '"': {
+				v8::Local<v8::String> str;
+				if (!this->string(&str, false)) { return false; }
+				*result = str;
+				return true;
+			}
+			case 't': *result = JS_BOOL(true); return this->literal("true", 4);
+			case 'f': *result = JS_BOOL(false); return this->literal("false", 5);
+			case 'n': *result = JS_NULL; return this->literal("null", 4);
+			default: return this->number(result);
+		}
+	}
+
+	bool object(v8::Local<v8::Value> * result) {
+		if (++this->depth > JSON_MAX_DEPTH) { return this->error("Structure is nested too deep"); }
+		v8::EscapableHandleScope handle_scope(JS_ISOLATE);
+		v8::Local<v8::Object> obj = v8::Object::New(JS_ISOLATE);
+		this->p++;
+		this->whitespace();
+		if (this->p < this->end && *this->p == '}') {
+			this->p++;
+		} else {
+			while (true) {
+				this->whitespace();
+				if (this->p == this->end || *this->p != '"') { return this->error(); }
+				v8::Local<v8::String> key;
+				v8::Local<v8::Value> item;
+				if (!this->string(&key, true)) { return false; }
+				this->whitespace();
+				if (this->p == this->end || *this->p != ':') { return this->error(); }
+				this->p++;
+				if (!this->value(&item)) { return false; }
+				/* own data property even for "__proto__", as in JSON.parse */
+				if (obj->CreateDataProperty(JS_CONTEXT, key, item).IsNothing()) { return false; }
+
+				this->whitespace();
+				if (this->p == this->end) { return this->error(); }
+				if (*this->p == ',') { this->p++; continue; }
+				if (*this->p == '}') { this->p++; break; }
+				return this->error();
+			}
+		}
+		this->depth--;
+		*result = handle_scope.Escape(obj);
+		return true;
+	}
+
+	bool array(v8::Local<v8::Value> * result) {
+		if (++this->depth > JSON_MAX_DEPTH) { return this->error("Structure is nested too deep"); }
+		v8::EscapableHandleScope handle_scope(JS_ISOLATE);
+		std::vector<v8::Local<v8::Value> > items;
+		this->p++;
+		this->whitespace();
+		if (this->p < this->end && *this->p == ']') {
+			this->p++;
+		} else {
+			while (true) {
+				v8::Local<v8::Value> item;
+				if (!this->value(&item)) { return false; }
+				items.push_back(item);
+
+				this->whitespace();
+				if (this->p == this->end) { return this->error(); }
+				if (*this->p == ',') { this->p++; continue; }
+				if (*this->p == ']') { this->p++; break; }
+				return this->error();
+			}
+		}
+		this->depth--;
+		*result = handle_scope.Escape(v8::Array::New(JS_ISOLATE, items.data(), items.size()));
+		return true;
+	}
+
+	/* offset of the first quote, backslash or control character at or after p */
+	const unsigned char * scan(const unsigned char * q) {
+#ifdef __SSE2__
+		const __m128i quote = _mm_set1_epi8('"');
+		const __m128i backslash = _mm_set1_epi8('\\');
+		const __m128i control = _mm_set1_epi8(0x1F);
+		for (; q + 16 <= this->end; q += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *) q);
+			/* unsigned v <= 0x1F */
+			__m128i low = _mm_cmpeq_epi8(_mm_min_epu8(v, control), v);
+			__m128i special = _mm_or_si128(low, _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+			int mask = _mm_movemask_epi8(special);
+			if (mask) { return q + __builtin_ctz(mask); }
+		}
+#endif
+		while (q < this->end && *q != '"' && *q != '\\' && *q >= 0x20) { q++; }
+		return q;
+	}
+
+	bool hex4(uint32_t * cp) {
+		if (this->end - this->p < 4) { this->p = this->end; return this->error(); }
+		*cp = 0;
+		for (int i=0; i<4; i++) {
+			unsigned char ch = *this->p;
+			int digit;
+			if (ch >= '0' && ch <= '9') {
+				digit = ch - '0';
+			} else if (ch >= 'a' && ch <= 'f') {
+				digit = ch - 'a' + 10;
+			} else if (ch >= 'A' && ch <= 'F') {
+				digit = ch - 'A' + 10;
+			} else {
+				return this->error();
+			}
+			*cp = (*cp << 4) | digit;
+			this->p++;
+		}
+		return true;
+	}
+
+	void utf8(uint32_t cp) {
+		if (cp < 0x80) {
+			this->scratch += (char) cp;
+		} else if (cp < 0x800) {
+			this->scratch += (char) (0xC0 | (cp >> 6));
+			this->scratch += (char) (0x80 | (cp & 0x3F));
+		} else if (cp < 0x10000) {
+			this->scratch += (char) (0xE0 | (cp >> 12));
+			this->scratch += (char) (0x80 | ((cp >> 6) & 0x3F));
+			this->scratch += (char) (0x80 | (cp & 0x3F));
+		} else {
+			this->scratch += (char) (0xF0 | (cp >> 18));
+			this->scratch += (char) (0x80 | ((cp >> 12) & 0x3F));
+			this->scratch += (char) (0x80 | ((cp >> 6) & 0x3F));
+			this->scratch += (char) (0x80 | (cp & 0x3F));
+		}
+	}
+
+	bool make_string(v8::Local<v8::String> * result, const char * data, size_t length, bool key) {
+		v8::NewStringType type = (key ? v8::NewStringType::kInternalized : v8::NewStringType::kNormal);
+		if (!v8::String::NewFromUtf8(JS_ISOLATE, data, type, (int) length).ToLocal(result)) { return this->error("String too long"); }
+		return true;
+	}
+
+	bool string(v8::Local<v8::String> * result, bool key) {
+		const unsigned char * first = ++this->p;
+		const unsigned char * q = this->scan(first);
+		if (q < this->end && *q == '"') { /* no escapes: straight from the input */
+			this->p = q + 1;
+			return this->make_string(result, (const char *) first, q - first, key);
+		}
+
+		this->scratch.assign((const char *) first, q - first);
+		this->p = q;
+		while (true) {
+			if (this->p == this->end) { return this->error(); }
+			unsigned char ch = *this->p;
+			if (ch == '"') { this->p++; break; }
+			if (ch < 0x20) { return this->error("Bad control character in string literal"); }
+			if (ch != '\\') {
+				q = this->scan(this->p);
+				this->scratch.append((const char *) this->p, q - this->p);
+				this->p = q;
+				continue;
+			}
+
+			this->p++;
+			if (this->p == this->end) { return this->error(); }
+			ch = *this->p++;
+			switch (ch) {
+				case '"': this->scratch += '"'; break;
+				case '\\': this->scratch += '\\'; break;
+				case '/': this->scratch += '/'; break;
+				case 'b': this->scratch += '\b'; break;
+				case 'f': this->scratch += '\f'; break;
+				case 'n': this->scratch += '\n'; break;
+				case 'r': this->scratch += '\r'; break;
+				case 't': this->scratch += '\t'; break;
+				case 'u': {
+					uint32_t cp;
+					if (!this->hex4(&cp)) { return false; }
+					if (cp >= 0xD800 && cp <= 0xDBFF && this->end - this->p >= 6 && this->p[0] == '\\' && this->p[1] == 'u') {
+						const unsigned char * mark = this->p;
+						this->p += 2;
+						uint32_t low;
+						if (!this->hex4(&low)) { return false; }
+						if (low >= 0xDC00 && low <= 0xDFFF) {
+							cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+						} else {
+							this->p = mark; /* not a pair; the second escape is handled on its own */
+						}
+					}
+					this->utf8(cp);
+				} break;
+				default:
+					this->p--;
+					return this->error();
+			}
+		}
+		return this->make_string(result, this->scratch.data(), this->scratch.length(), key);
+	}
+
+	bool digits() {
+		const unsigned char * first = this->p;
+		while (this->p < this->end && *this->p >= '0' && *this->p <= '9') { this->p++; }
+		return this->p > first;
+	}
+
+	bool number(v8::Local<v8::Value> * result) {
+		const unsigned char * first = this->p;
+		bool integer = true;
+		if (*this->p == '-') { this->p++; }
+		if (this->p == this->end) { return this->error(); }
+		if (*this->p == '0') {
+			this->p++;
+		} else if (*this->p >= '1' && *this->p <= '9') {
+			this->digits();
+		} else {
+			return this->error();
+		}
+		if (this->p < this->end && *this->p == '.') {
+			integer = false;
+			this->p++;
+			if (!this->digits()) { return this->error(); }
+		}
+		if (this->p < this->end && (*this->p == 'e' || *this->p == 'E')) {
+			integer = false;
+			this->p++;
+			if (this->p < this->end && (*this->p == '+' || *this->p == '-')) { this->p++; }
+			if (!this->digits()) { return this->error(); }
+		}
+
+		size_t length = this->p - first;
+		if (integer && length <= 15) { /* exact in a double */
+			bool negative = (*first == '-');
+			int64_t value = 0;
+			for (const unsigned char * q = first + (negative ? 1 : 0); q < this->p; q++) { value = value * 10 + (*q - '0'); }
+			if (negative && value == 0) { *result = JS_FLOAT(-0.0); return true; }
+			*result = JS_FLOAT((double) (negative ? -value : value));
+			return true;
+		}
+		this->scratch.assign((const char *) first, length);
+		*result = JS_FLOAT(strtod(this->scratch.c_str(), NULL));
+		return true;
+	}
+};
+
+/**
+ * @param {any} value
+ * @returns {Buffer} UTF-8 JSON text, undefined for values JSON.stringify skips
+ */
+JS_METHOD(_stringify) {
+	try {
+		Writer out(MIN_CHUNK);
+		Serializer serializer(out);
+		int status = serializer.top(args[0]);
+		if (status < 1) { return; }
+		args.GetReturnValue().Set(BYTESTORAGE_TO_JS(out.detach()));
+	} catch (std::string e) {
+		JS_ERROR(e);
+	}
+}
+
+/**
+ * @param {any} value
+ * @param {object} stream anything with write(buffer), e.g. system.stdout
+ * @param {int} [chunkSize=65536]
+ * @returns {int} number of bytes written
+ */
+JS_METHOD(_write) {
+	if (args.Length() < 2 || !args[1]->IsObject()) { JS_TYPE_ERROR("Invalid call format. Use 'write(value, stream, [chunkSize])'"); return; }
+	v8::Local<v8::Object> stream = v8::Local<v8::Object>::Cast(args[1]);
+	v8::Local<v8::Value> write;
+	if (!stream->Get(JS_CONTEXT, JS_STR("write")).ToLocal(&write)) { return; }
+	if (!write->IsFunction()) { JS_TYPE_ERROR("Stream has no write() method"); return; }
+
+	size_t chunk = DEFAULT_CHUNK;
+	if (args.Length() > 2 && args[2]->IsNumber()) {
+		int64_t size = args[2]->IntegerValue(JS_CONTEXT).ToChecked();
+		chunk = (size_t) (size < MIN_CHUNK ? MIN_CHUNK : size);
+	}
+
+	try {
+		Writer out(chunk);
+		out.stream = stream;
+		out.write = v8::Local<v8::Function>::Cast(write);
+		Serializer serializer(out);
+		if (serializer.top(args[0]) < 0) { return; }
+		if (!out.flush()) { return; }
+		args.GetReturnValue().Set(JS_FLOAT((double) out.total));
+	} catch (std::string e) {
+		JS_ERROR(e);
+	}
+}
+
+/**
+ * @param {Buffer || string} text
+ * @param {int} [start]
+ * @param {int} [end]
+ */
+JS_METHOD(_parse) {
+	if (args.Length() < 1) { JS_TYPE_ERROR("Invalid call format. Use 'parse(buffer, [start], [end])'"); return; }
+	if (args[0]->IsString()) {
+		v8::Local<v8::Value> result;
+		if (v8::JSON::Parse(JS_CONTEXT, v8::Local<v8::String>::Cast(args[0])).ToLocal(&result)) { args.GetReturnValue().Set(result); }
+		return;
+	}
+	if (!IS_BUFFER(args[0])) { JS_TYPE_ERROR("Invalid call format. Use 'parse(buffer, [start], [end])'"); return; }
+
+	ByteStorage * bs = JS_TO_BYTESTORAGE(args[0]);
+	size_t length = bs->getLength();
+	size_t start = (args.Length() > 1 && args[1]->IsNumber() ? (size_t) args[1]->IntegerValue(JS_CONTEXT).ToChecked() : 0);
+	size_t stop = (args.Length() > 2 && args[2]->IsNumber() ? (size_t) args[2]->IntegerValue(JS_CONTEXT).ToChecked() : length);
+	if (stop > length || start > stop) { JS_RANGE_ERROR("Invalid start/end"); return; }
+
+	const char * data = bs->getData() + start;
+	size_t size = stop - start;
+	if (size >= 3 && !memcmp(data, "\xEF\xBB\xBF", 3)) { data += 3; size -= 3; } /* UTF-8 BOM */
+
+	Parser parser(data, size);
+	v8::Local<v8::Value> result;
+	if (parser.parse(&result)) { args.GetReturnValue().Set(result); }
+}
+
+}
+
+SHARED_INIT() {
+	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
+
+	(void)exports->Set(JS_CONTEXT, JS_STR("stringify"), v8::FunctionTemplate::New(JS_ISOLATE, _stringify)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("write"), v8::FunctionTemplate::New(JS_ISOLATE, _write)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("parse"), v8::FunctionTemplate::New(JS_ISOLATE, _parse)->GetFunction(JS_CONTEXT).ToLocalChecked());
+}
@@ -1,5 +1,6 @@
 #include <v8.h>
 #include "macros.h"
+#include "metrics.h"
 #include "gc.h"
 
 #include <libmemcached/memcached.h>
@@ -192,6 +193,7 @@ JS_METHOD(_flush) {
  * written.
  */
 JS_METHOD(_set) {
+  Metrics::Timer timer(METRICS_PTR, "memcached.set");
   MEMCACHED_PTR;
 
   if (args.Length() != 4 ||
@@ -227,6 +229,7 @@ JS_METHOD(_set) {
  * error occurs.
  */
 JS_METHOD(_replace) {
+  Metrics::Timer timer(METRICS_PTR, "memcached.replace");
   MEMCACHED_PTR;
 
   if (args.Length() != 4 ||
@@ -262,6 +265,7 @@ JS_METHOD(_replace) {
  * occurs, otherwise the value is stored.
  */
 JS_METHOD(_add) {
+  Metrics::Timer timer(METRICS_PTR, "memcached.add");
   MEMCACHED_PTR;
 
   if (args.Length() != 4 ||
@@ -303,6 +307,7 @@ JS_METHOD(_add) {
  * the 1.4 version.
  */
 JS_METHOD(_remove) {
+  Metrics::Timer timer(METRICS_PTR, "memcached.remove");
   MEMCACHED_PTR;
 
   if (args.Length() != 2 ||
@@ -332,6 +337,7 @@ JS_METHOD(_remove) {
  * If you need the CAS value you can use mget.
  */
 JS_METHOD(_get) {
+  Metrics::Timer timer(METRICS_PTR, "memcached.get");
   MEMCACHED_PTR;
 
   if (args.Length() != 1 ||
@@ -377,6 +383,7 @@ JS_METHOD(_get) {
  * a value since you read it with mget.
  */
 JS_METHOD(_cas) {
+  Metrics::Timer timer(METRICS_PTR, "memcached.cas");
   MEMCACHED_PTR;
 
   if (args.Length() != 5 ||
@@ -424,6 +431,7 @@ JS_METHOD(_cas) {
  * then there will be a tuple for it, otherwise no tuple will exist for the key.
  */
 JS_METHOD(_mget) {
+  Metrics::Timer timer(METRICS_PTR, "memcached.mget");
   MEMCACHED_PTR;
 
   if (args.Length() != 1 ||
@@ -0,0 +1,125 @@
+/**
+ * Probes for measuring the cost of binding patterns used by native modules.
+ * Every function does one pattern and nothing else; bench/native/bindings.js calls
+ * them in loops and subtracts the cost of noop().
+ */
+
+#include <v8.h>
+#include "macros.h"
+#include "gc.h"
+#include <cstring>
+
+namespace {
+
+int value = 42;
+unsigned char bytes[256];
+
+/* plain call: FunctionCallbackInfo setup and return */
+JS_METHOD(_noop) {
+	args.GetReturnValue().SetUndefined();
+}
+
+/* Probe constructor: one internal field, like most wrapped native objects */
+JS_METHOD(_probe) {
+	ASSERT_CONSTRUCTOR;
+	SAVE_PTR(0, &value);
+	args.GetReturnValue().Set(args.This());
+}
+
+JS_METHOD(_loadptr) {
+	int * ptr = LOAD_PTR(0, int *);
+	args.GetReturnValue().Set(JS_INT(*ptr));
+}
+
+JS_METHOD(_gcptr) {
+	GC * gc = GC_PTR;
+	args.GetReturnValue().Set(JS_BOOL(gc != NULL));
+}
+
+JS_METHOD(_int) {
+	args.GetReturnValue().Set(JS_INT(args[0]->Int32Value(JS_CONTEXT).ToChecked()));
+}
+
+/* short string result, NUL-terminated vs. known length */
+JS_METHOD(_str) {
+	args.GetReturnValue().Set(JS_STR("hello world"));
+}
+
+JS_METHOD(_strlen) {
+	args.GetReturnValue().Set(JS_STR_LEN("hello world", 11));
+}
+
+/* string argument to UTF-8 */
+JS_METHOD(_utf8) {
+	v8::String::Utf8Value str(JS_ISOLATE, args[0]);
+	args.GetReturnValue().Set(JS_INT(str.length()));
+}
+
+/* Buffer type check: looks up require("binary").Buffer.prototype */
+JS_METHOD(_isbuffer) {
+	args.GetReturnValue().Set(JS_BOOL(IS_BUFFER(args[0])));
+}
+
+/* Buffer argument to char *, unchecked: pass a Buffer */
+JS_METHOD(_bufferdata) {
+	size_t length = 0;
+	char * data = JS_BUFFER_TO_CHAR(args[0], &length);
+	args.GetReturnValue().Set(JS_INT(length ? data[0] : 0));
+}
+
+/* Buffer result */
+JS_METHOD(_buffer) {
+	args.GetReturnValue().Set(JS_BUFFER((char *) bytes, 64));
+}
+
+/**
+ * Indexed: the interceptor pattern of ByteArray _get/_set (binary-b), which does not
+ * build against the current V8. Compare with Buffer_get/Buffer_set of a real Buffer.
+ */
+void _indexed_get(uint32_t index, const v8::PropertyCallbackInfo<v8::Value>& info) {
+	unsigned char * data = LOAD_PTR_FROM(info.This(), 0, unsigned char *);
+	if (index >= sizeof(bytes)) { info.GetReturnValue().SetUndefined(); return; }
+	info.GetReturnValue().Set(JS_INT(data[index]));
+}
+
+void _indexed_set(uint32_t index, v8::Local<v8::Value> value, const v8::PropertyCallbackInfo<v8::Value>& info) {
+	unsigned char * data = LOAD_PTR_FROM(info.This(), 0, unsigned char *);
+	if (index >= sizeof(bytes)) { info.GetReturnValue().SetUndefined(); return; }
+	data[index] = (unsigned char) value->IntegerValue(JS_CONTEXT).ToChecked();
+	info.GetReturnValue().Set(value);
+}
+
+JS_METHOD(_indexed) {
+	ASSERT_CONSTRUCTOR;
+	SAVE_PTR(0, bytes);
+	args.GetReturnValue().Set(args.This());
+}
+
+}
+
+SHARED_INIT() {
+	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
+	memset(bytes, 1, sizeof(bytes));
+
+	(void)exports->Set(JS_CONTEXT,JS_STR("noop"), v8::FunctionTemplate::New(JS_ISOLATE, _noop)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT,JS_STR("gcptr"), v8::FunctionTemplate::New(JS_ISOLATE, _gcptr)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT,JS_STR("int"), v8::FunctionTemplate::New(JS_ISOLATE, _int)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT,JS_STR("str"), v8::FunctionTemplate::New(JS_ISOLATE, _str)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT,JS_STR("strlen"), v8::FunctionTemplate::New(JS_ISOLATE, _strlen)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT,JS_STR("utf8"), v8::FunctionTemplate::New(JS_ISOLATE, _utf8)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT,JS_STR("isBuffer"), v8::FunctionTemplate::New(JS_ISOLATE, _isbuffer)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT,JS_STR("bufferData"), v8::FunctionTemplate::New(JS_ISOLATE, _bufferdata)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT,JS_STR("buffer"), v8::FunctionTemplate::New(JS_ISOLATE, _buffer)->GetFunction(JS_CONTEXT).ToLocalChecked());
+
+	v8::Local<v8::FunctionTemplate> probeTemplate = v8::FunctionTemplate::New(JS_ISOLATE, _probe);
+	probeTemplate->SetClassName(JS_STR("Probe"));
+	probeTemplate->InstanceTemplate()->SetInternalFieldCount(1);
+	probeTemplate->PrototypeTemplate()->Set(JS_ISOLATE, "loadPtr", v8::FunctionTemplate::New(JS_ISOLATE, _loadptr));
+	(void)exports->Set(JS_CONTEXT,JS_STR("Probe"), probeTemplate->GetFunction(JS_CONTEXT).ToLocalChecked());
+
+	v8::Local<v8::FunctionTemplate> indexedTemplate = v8::FunctionTemplate::New(JS_ISOLATE, _indexed);
+	indexedTemplate->SetClassName(JS_STR("Indexed"));
+	indexedTemplate->InstanceTemplate()->SetInternalFieldCount(1);
+	indexedTemplate->InstanceTemplate()->SetIndexedPropertyHandler(_indexed_get, _indexed_set);
+	(void)exports->Set(JS_CONTEXT,JS_STR("Indexed"), indexedTemplate->GetFunction(JS_CONTEXT).ToLocalChecked());
+}
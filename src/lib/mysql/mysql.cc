@@ -1,5 +1,6 @@
 #include <v8.h>
 #include "macros.h"
+#include "metrics.h"
 #include "gc.h"
 
 #ifdef windows
@@ -84,6 +85,7 @@ JS_METHOD(_close) {
  * Should be called ASAP: new MySQL().connect("host", "user", "pass", "db")
  */ 
 JS_METHOD(_connect) {
+	Metrics::Timer timer(METRICS_PTR, "mysql.connect");
 	if (args.Length() < 4) {
 		JS_TYPE_ERROR("Invalid call format. Use 'mysql.connect(host, user, pass, db)'");
 		return;
@@ -122,6 +124,7 @@ JS_METHOD(_connect) {
  * Query takes a string argument and returns an instance of Result object
  */ 
 JS_METHOD(_query) {
+	Metrics::Timer timer(METRICS_PTR, "mysql.query");
 	MYSQL_PTR;
 	ASSERT_CONNECTED;
 	if (args.Length() < 1) {
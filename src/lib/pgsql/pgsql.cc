@@ -21,6 +21,7 @@
 
 #include <v8.h>
 #include "macros.h"
+#include "metrics.h"
 #include "common.h"
 #include "gc.h"
 
@@ -85,11 +86,19 @@ void destroy_pgsql(v8::Local<v8::Object> obj) {
 	(void)fun->Call(JS_CONTEXT,obj, 0, NULL);
 }
 
+/**
+ * Free a result owned by a JS Result object; its memory was reported in _result
+ */
+void clear_result(PGresult * res) {
+	Metrics::external(Metrics::PGSQL, -(int64_t) PQresultMemorySize(res));
+	PQclear(res);
+}
+
 void destroy_result2(void*tmp) {
 	/*v8::Local<v8::Function> fun = v8::Local<v8::Function>::Cast(obj->Get(JS_CONTEXT,JS_STR("clear")).ToLocalChecked());
 	(void)fun->Call(JS_CONTEXT,obj, 0, NULL);*/
 	PGresult *res=(PGresult*)tmp;
-	if (res) PQclear(res);
+	if (res) clear_result(res);
 }
 
 void destroy_pgsql2(void*tmp) {
@@ -99,6 +108,44 @@ void destroy_pgsql2(void*tmp) {
 	if (conn) PQfinish(conn);
 }
 
+/**
+ * Prepared statements die with the session: drop the names cached by
+ * Query.prototype.execute (lib/query.js) whenever the connection changes.
+ */
+void forget_statements(v8::Local<v8::Object> obj) {
+	(void)obj->Delete(JS_CONTEXT, JS_STR("_statements"));
+}
+
+/**
+ * Text parameters for PQexecParams / PQexecPrepared: null and undefined
+ * become SQL NULL, objects are sent as JSON. queryParams() has always sent
+ * empty strings as NULL too (emptyNull). Release with free_params().
+ */
+char ** to_params(v8::Local<v8::Array> arr, bool emptyNull = false) {
+	uint32_t len = arr->Length();
+	char ** params = (char **)malloc((len ? len : 1) * sizeof(char *));
+	for (uint32_t i = 0; i < len; i++) {
+		v8::Local<v8::Value> val = arr->Get(JS_CONTEXT,JS_INT(i)).ToLocalChecked();
+		if (val->IsUndefined() || val->IsNull()) {
+			params[i] = NULL;
+		} else if (val->IsObject()) {
+			v8::String::Utf8Value tval(JS_ISOLATE,v8::JSON::Stringify(JS_CONTEXT,val).ToLocalChecked());
+			params[i] = strdup(*tval);
+		} else {
+			v8::String::Utf8Value tval(JS_ISOLATE,val->ToString(JS_CONTEXT).ToLocalChecked());
+			params[i] = (emptyNull && !tval.length() ? NULL : strdup(*tval));
+		}
+	}
+	return params;
+}
+
+void free_params(char ** params, uint32_t len) {
+	for (uint32_t i = 0; i < len; i++) {
+		if (params[i]) free(params[i]);
+	}
+	free(params);
+}
+
 /**
  * Parameters:
  *		lineno	= -1 fetch all, -2 fetch next line, >=0 - fetch lineno
@@ -184,6 +231,8 @@ v8::Local<v8::Array> fetch_any(PGresult *res,int lineno,bool fetch_objects)
 		ASSERT_CONSTRUCTOR;
 		PGSQL_RES_SAVE(args[0]);
 		PGSQL_RES_SETPOS(0);
+		PGSQL_RES_LOAD(res);
+		if (res) { Metrics::external(Metrics::PGSQL, PQresultMemorySize(res)); }
 		GC * gc = GC_PTR;
 		//gc->add(args.This(), destroy_result);
 		gc->add(args.This(), destroy_result2,0);
@@ -199,7 +248,7 @@ v8::Local<v8::Array> fetch_any(PGresult *res,int lineno,bool fetch_objects)
 	JS_METHOD(_clear) {
 		PGSQL_RES_LOAD(res);
 		if (res) {
-			PQclear(res);
+			clear_result(res);
 			PGSQL_RES_CLEAR;
 		}
 		args.GetReturnValue().Set(args.This());
@@ -252,6 +301,7 @@ v8::Local<v8::Array> fetch_any(PGresult *res,int lineno,bool fetch_objects)
 			PQfinish(conn);
 			SAVE_PTR(0, NULL);
 		}
+		forget_statements(args.This());
 		args.GetReturnValue().Set(args.This());
 	}
 
@@ -260,6 +310,7 @@ v8::Local<v8::Array> fetch_any(PGresult *res,int lineno,bool fetch_objects)
 	 *	- call format: new PostgreSQL().connect("host", "user", "pass", "db")
 	 */ 
 	JS_METHOD(_connect) {
+		Metrics::Timer timer(METRICS_PTR, "pgsql.connect");
 		if (args.Length() < 1 and args.Length() != 5) {
 			JS_TYPE_ERROR("Invalid call format. Use either 'pgsql.connect(\"hostaddr=host port=port dbname=dbname user=user password=pass\")' or 'pgsql.connect(host, port, db, user, password)'");
 			return;
@@ -349,6 +400,7 @@ v8::Local<v8::Array> fetch_any(PGresult *res,int lineno,bool fetch_objects)
 		}
 		else {
 			SAVE_PTR(0, conn);
+			forget_statements(args.This());
 			delete[] tconnstr;
 			args.GetReturnValue().Set(args.This());
 		}
@@ -364,6 +416,7 @@ v8::Local<v8::Array> fetch_any(PGresult *res,int lineno,bool fetch_objects)
 	 *		statement (c.f. "pg_query_params()" in PHP)
 	 */
 JS_METHOD(_query) {
+	Metrics::Timer timer(METRICS_PTR, "pgsql.query");
 	PGSQL_PTR_CON;
 	ASSERT_CONNECTED;
 	uint32_t len = args.Length();
@@ -433,44 +486,30 @@ JS_METHOD(_query) {
 	 *		as its input argument, in which the string and
 	 *		object members are used as a prepared SQL
 	 *		statement (c.f. "pg_query_params()" in PHP)
+	 *	- empty strings are sent as NULL unless the optional
+	 *		third argument is false
 	 */
 	JS_METHOD(_queryparams) {
+		Metrics::Timer timer(METRICS_PTR, "pgsql.queryparams");
 		PGSQL_PTR_CON;
 		ASSERT_CONNECTED;
 		if (args.Length() < 2) {
 			JS_TYPE_ERROR("Too few input parameters");
 			return;
 		}
-		if (args.Length() > 2) {
+		if (args.Length() > 3) {
 			JS_TYPE_ERROR("Too many input parameters");
 			return;
 		}
+		bool emptyNull = (args.Length() < 3 || args[2]->BooleanValue(JS_ISOLATE));
 		PGresult *res;
 		v8::String::Utf8Value q(JS_ISOLATE,args[0]);
 		v8::Local<v8::Array> tarray = v8::Local<v8::Array>::Cast(args[1]->ToObject(JS_CONTEXT).ToLocalChecked());
 		//v8::Local<v8::Object> parray = args[1]->ToObject(JS_CONTEXT).ToLocalChecked();
 		int nparams = tarray->Length();
-		char ** params = (char **)malloc(nparams * sizeof(char*));
-		for(int i = 0; i < nparams; i++) {
-			v8::Local<v8::Value> val=tarray->Get(JS_CONTEXT,JS_INT(i)).ToLocalChecked();
-			if (val->IsUndefined()) {
-				params[i]=NULL;
-			} else if (val->IsNull()) {
-				params[i]=NULL;
-			} else if (val->IsObject()) {
-				v8::String::Utf8Value tval(JS_ISOLATE,v8::JSON::Stringify(JS_CONTEXT,val).ToLocalChecked());
-				params[i]=strdup(*tval);
-			} else {
-				v8::String::Utf8Value tval(JS_ISOLATE,val->ToString(JS_CONTEXT).ToLocalChecked());
-				if (tval.length()) params[i] = strdup(*tval); else params[i]=NULL;
-			}
-		}
+		char ** params = to_params(tarray, emptyNull);
 		res = PQexecParams(conn, *q, nparams, NULL, params, NULL, NULL, 0);
- 
-		for(int i = 0; i < nparams; i++) {
-			if (params[i]) free(params[i]);
-		}
-		free(params);
+		free_params(params, nparams);
 
 		int code = -1;
 		if (!(!res)) {
@@ -593,13 +632,7 @@ JS_METHOD(_query) {
 			return;
 		}
 		int nparams = tarray->Length();
-		char ** params = (char **)malloc(nparams);
-		//size_t n = 0;
-		for(int i = 0; i < nparams; i++) {
-			//n = tarray->Get(JS_CONTEXT,JS_INT(i)).ToLocalChecked()->ToString(JS_CONTEXT).ToLocalChecked()->Utf8Length(JS_ISOLATE);
-			v8::String::Utf8Value tval(JS_ISOLATE,tarray->Get(JS_CONTEXT,JS_INT(i)).ToLocalChecked()->ToString(JS_CONTEXT).ToLocalChecked());
-			params[i] = strdup(*tval);
-		}
+		char ** params = to_params(tarray);
 		fd_set write_mask;
 		FD_ZERO(&write_mask);
 		FD_SET(sock, &write_mask);
@@ -648,10 +681,7 @@ JS_METHOD(_query) {
 			args.GetReturnValue().Set(code);
 		}
 		
-		for(int i = 0; i < nparams; i++) {
-			if (params[i]) free(params[i]);
-		}
-		free(params);
+		free_params(params, nparams);
 	}
 	
 	JS_METHOD(_isconnected) {
@@ -913,23 +943,15 @@ JS_METHOD(_query) {
 	}
 
 JS_METHOD(_execute) {
+	Metrics::Timer timer(METRICS_PTR, "pgsql.execute");
 	PGSQL_PTR_CON;
 	ASSERT_CONNECTED;
 	v8::String::Utf8Value n(JS_ISOLATE,args[0]);
 	v8::Local<v8::Array> tmp ( v8::Local<v8::Array>::Cast(args[1]) );
 	uint32_t len = tmp->Length();
-	char ** q = (char **)malloc(len);
-	for(uint32_t i = 0; i < len; i++) {
-		//uint32_t n = tmp->Get(JS_CONTEXT,JS_INT(i)).ToLocalChecked()->ToString(JS_CONTEXT).ToLocalChecked()->Utf8Length(JS_ISOLATE);
-		v8::String::Utf8Value tval(JS_ISOLATE,tmp->Get(JS_CONTEXT,JS_INT(i)).ToLocalChecked()->ToString(JS_CONTEXT).ToLocalChecked());
-		q[i] = strdup(*tval);
-	}
+	char ** q = to_params(tmp);
 	PGresult * res = PQexecPrepared(conn, *n, len, (const char* const*)q, NULL, NULL, 0);
-				
-	for(uint32_t i = 0; i < len; i++) {
-		if (q[i]) free(q[i]);
-	}
-	free(q);
+	free_params(q, len);
 	
 	int code = -1;
 	if (!(!res)) { code = PQresultStatus(res); }
@@ -968,12 +990,7 @@ JS_METHOD(_execute) {
 			return;
 		}
 		uint32_t len = tmp->Length();
-		char ** q = (char **)malloc(len);
-		for(uint32_t i = 0; i < len; i++) {
-			//uint32_t n = tmp->Get(JS_CONTEXT,JS_INT(i)).ToLocalChecked()->ToString(JS_CONTEXT).ToLocalChecked()->Utf8Length(JS_ISOLATE);
-			v8::String::Utf8Value tval(JS_ISOLATE,tmp->Get(JS_CONTEXT,JS_INT(i)).ToLocalChecked()->ToString(JS_CONTEXT).ToLocalChecked());
-			q[i] = strdup(*tval);
-		}		
+		char ** q = to_params(tmp);
 		fd_set write_mask;
 		FD_ZERO(&write_mask);
 		FD_SET(sock, &write_mask);
@@ -1022,14 +1039,11 @@ JS_METHOD(_execute) {
 			args.GetReturnValue().Set(JS_BOOL(code));
 		}
 		
-		for(uint32_t i = 0; i < len; i++) {
-			if (q[i]) free(q[i]);
-		}
-		free(q);
-		
+		free_params(q, len);
 	}
 
 	JS_METHOD(_prepare) {
+		Metrics::Timer timer(METRICS_PTR, "pgsql.prepare");
 		PGSQL_PTR_CON;
 		ASSERT_CONNECTED;
 		v8::String::Utf8Value n(JS_ISOLATE,args[0]);
@@ -1151,8 +1165,10 @@ JS_METHOD(_execute) {
 		std::stringstream q("DEALLOCATE ");
 		int ret = PQsendQuery(conn, q.str().c_str());
 		if (!ret) {
-			if (PQstatus(conn) != CONNECTION_OK)
+			if (PQstatus(conn) != CONNECTION_OK) {
 				PQreset(conn);
+				forget_statements(args.This());
+			}
 			ret = PQsendQuery(conn, q.str().c_str());
 			if (!ret) {
 				JS_ERROR("[js_pgsql.cc @ _senddeallocate()] ERROR: PQsendQuery failed");
@@ -0,0 +1,510 @@
+/**
+ * Native part of the "query" module.
+ *
+ * expand() renders the %f / %s / %n format strings of lib/query.js. Every
+ * distinct format string is parsed once into a template, and quoted
+ * identifiers are cached, so rendering only converts the values: escaped
+ * inline, or as $n placeholders plus a parameter array for pgsql
+ * queryParams / prepare + execute.
+ *
+ * filter() evaluates WHERE programs of ActiveRecord's in-memory adapter a
+ * column at a time: a comparison reads its column from all rows once and
+ * fills a byte mask (numeric columns in a plain loop over doubles, which
+ * the compiler vectorizes); AND / OR / IN combine masks.
+ */
+
+#include <v8.h>
+#include "macros.h"
+#include "common.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <stdint.h>
+
+#define MAX_TEMPLATES 1024
+#define MAX_IDENTIFIERS 4096
+
+namespace {
+
+typedef enum {
+	PIECE_TEXT,
+	PIECE_FIELD,
+	PIECE_STRING,
+	PIECE_NUMBER
+} piece_type_t;
+
+typedef struct {
+	piece_type_t type;
+	std::string text;
+} piece_t;
+
+typedef std::vector<piece_t> format_t;
+
+std::map<std::string, format_t> templates;
+std::map<std::string, std::string> identifiers; /* quote + name => qualified name */
+
+/**
+ * Split a format string into pieces; same rules as Query.prototype._expand
+ */
+const format_t & compile(const std::string & str) {
+	std::map<std::string, format_t>::iterator it = templates.find(str);
+	if (it != templates.end()) { return it->second; }
+	if (templates.size() >= MAX_TEMPLATES) { templates.clear(); }
+
+	format_t & format = templates[str];
+	std::string text;
+	bool start = false;
+	for (size_t i=0; i<str.length(); i++) {
+		char ch = str[i];
+		piece_type_t type = PIECE_TEXT;
+		switch (ch) {
+			case '%':
+				start = !start;
+				if (!start) { text += ch; }
+				continue;
+			case 'f': type = PIECE_FIELD; break;
+			case 's': type = PIECE_STRING; break;
+			case 'n': type = PIECE_NUMBER; break;
+		}
+		if (type == PIECE_TEXT || !start) {
+			text += ch;
+			continue;
+		}
+		start = false;
+		if (text.length()) {
+			piece_t piece = { PIECE_TEXT, text };
+			format.push_back(piece);
+			text = "";
+		}
+		piece_t piece = { type, "" };
+		format.push_back(piece);
+	}
+	if (text.length()) {
+		piece_t piece = { PIECE_TEXT, text };
+		format.push_back(piece);
+	}
+	return format;
+}
+
+/**
+ * Quote every dot-separated part except "*"; embedded quotes are doubled
+ */
+const std::string & qualify(const std::string & name, const std::string & quote) {
+	std::string key = quote + '\0' + name;
+	std::map<std::string, std::string>::iterator it = identifiers.find(key);
+	if (it != identifiers.end()) { return it->second; }
+	if (identifiers.size() >= MAX_IDENTIFIERS) { identifiers.clear(); }
+
+	std::string result;
+	size_t start = 0;
+	while (true) {
+		size_t end = name.find('.', start);
+		std::string part = name.substr(start, end == std::string::npos ? std::string::npos : end - start);
+		if (part == "*" || !quote.length()) {
+			result += part;
+		} else {
+			result += quote;
+			for (size_t i=0; i<part.length(); i++) {
+				if (part[i] == quote[0]) { result += quote; }
+				result += part[i];
+			}
+			result += quote;
+		}
+		if (end == std::string::npos) { break; }
+		result += '.';
+		start = end + 1;
+	}
+	return (identifiers[key] = result);
+}
+
+std::string to_string(v8::Local<v8::Value> value) {
+	v8::String::Utf8Value str(JS_ISOLATE, value);
+	return std::string(*str ? *str : "", str.length());
+}
+
+/* parseFloat(), with NaN mapped to 0 */
+double to_number(v8::Local<v8::Value> value) {
+	double result;
+	if (value->IsNumber()) {
+		result = v8::Local<v8::Number>::Cast(value)->Value();
+	} else {
+		std::string str = to_string(value);
+		const char * p = str.c_str();
+		while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') { p++; }
+		const char * digits = (*p == '-' || *p == '+' ? p + 1 : p);
+		if (digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) { /* no hex in parseFloat */
+			result = 0;
+		} else if (!strncmp(digits, "Infinity", 8)) {
+			result = (*p == '-' ? -INFINITY : INFINITY);
+		} else if ((*digits < '0' || *digits > '9') && *digits != '.') { /* strtod would accept "inf", "nan" */
+			result = NAN;
+		} else {
+			result = strtod(p, NULL);
+		}
+	}
+	return (std::isnan(result) ? 0 : result);
+}
+
+bool append_number(std::string & sql, double number) {
+	char tmp[32];
+	if (number == std::floor(number) && std::fabs(number) < 9007199254740992.0) { /* above 2^53 %.0f prints more digits than toString() */
+		snprintf(tmp, sizeof(tmp), "%.0f", number == 0 ? 0.0 : number);
+		sql += tmp;
+		return true;
+	}
+	v8::Local<v8::String> str;
+	if (!JS_FLOAT(number)->ToString(JS_CONTEXT).ToLocal(&str)) { return false; }
+	sql += to_string(str);
+	return true;
+}
+
+void append_placeholder(std::string & sql, v8::Local<v8::Array> params, v8::Local<v8::Value> value) {
+	uint32_t index = params->Length();
+	(void)params->Set(JS_CONTEXT, index, value);
+	char tmp[16];
+	snprintf(tmp, sizeof(tmp), "$%u", index + 1);
+	sql += tmp;
+}
+
+/**
+ * @param {string} format
+ * @param {any[]} args format arguments
+ * @param {string} quote identifier quote character ("" = none)
+ * @param {object} db connection with escape(), used for inline %s values
+ * @param {any[]} [params] when present, values are appended here and replaced by $n
+ * @returns {string}
+ */
+JS_METHOD(_expand) {
+	if (args.Length() < 4 || !args[1]->IsArray()) { JS_TYPE_ERROR("Invalid call format. Use 'expand(format, args, quote, db, [params])'"); return; }
+	std::string str = to_string(args[0]);
+	v8::Local<v8::Array> values = v8::Local<v8::Array>::Cast(args[1]);
+	std::string quote = to_string(args[2]);
+	bool parametrized = (args.Length() > 4 && args[4]->IsArray());
+	v8::Local<v8::Array> params;
+	if (parametrized) { params = v8::Local<v8::Array>::Cast(args[4]); }
+
+	const format_t & format = compile(str);
+	std::string sql;
+	uint32_t argptr = 0;
+	v8::Local<v8::Function> escape;
+
+	for (size_t i=0; i<format.size(); i++) {
+		const piece_t & piece = format[i];
+		if (piece.type == PIECE_TEXT) {
+			sql += piece.text;
+			continue;
+		}
+
+		v8::Local<v8::Value> value;
+		if (!values->Get(JS_CONTEXT, argptr++).ToLocal(&value)) { return; }
+		switch (piece.type) {
+			case PIECE_FIELD:
+				sql += qualify(to_string(value), quote);
+			break;
+
+			case PIECE_NUMBER: /* inline even when parametrized: an untyped $n would take the column type */
+				if (!append_number(sql, to_number(value))) { return; }
+			break;
+
+			case PIECE_STRING:
+				if (parametrized) {
+					append_placeholder(sql, params, value);
+					break;
+				}
+				if (escape.IsEmpty()) {
+					v8::Local<v8::Value> fn;
+					if (!args[3]->IsObject() || !v8::Local<v8::Object>::Cast(args[3])->Get(JS_CONTEXT, JS_STR("escape")).ToLocal(&fn) || !fn->IsFunction()) {
+						JS_TYPE_ERROR("Database object has no escape() method");
+						return;
+					}
+					escape = v8::Local<v8::Function>::Cast(fn);
+				}
+				{
+					v8::Local<v8::Value> argv[1] = { value };
+					v8::Local<v8::Value> escaped;
+					if (!escape->Call(JS_CONTEXT, args[3], 1, argv).ToLocal(&escaped)) { return; }
+					sql += "'" + to_string(escaped) + "'";
+				}
+			break;
+
+			default: break;
+		}
+	}
+
+	args.GetReturnValue().Set(JS_STR_LEN(sql.data(), (int) sql.length()));
+}
+
+/**
+ * @param {string} name possibly dotted identifier
+ * @param {string} quote
+ */
+JS_METHOD(_qualify) {
+	if (args.Length() < 2) { JS_TYPE_ERROR("Invalid call format. Use 'qualify(name, quote)'"); return; }
+	const std::string & result = qualify(to_string(args[0]), to_string(args[1]));
+	args.GetReturnValue().Set(JS_STR_LEN(result.data(), (int) result.length()));
+}
+
+/**
+ * One operand of a comparison: a constant or a column read from all rows
+ */
+class Operand {
+public:
+	bool constant;
+	bool numeric; /* every value is a number */
+	v8::Local<v8::Value> value;
+	double number;
+	std::vector<v8::Local<v8::Value> > values;
+	std::vector<double> numbers;
+
+	v8::Local<v8::Value> at(size_t i) { return (this->constant ? this->value : this->values[i]); }
+};
+
+typedef std::vector<uint8_t> mask_t;
+
+class Filter {
+public:
+	Filter(std::vector<v8::Local<v8::Object> > & rows) : rows(rows), supported(true) {}
+
+	std::vector<v8::Local<v8::Object> > & rows;
+	bool supported; /* false: the program needs JS semantics we do not replicate */
+
+	/* false when a JS exception is pending */
+	bool evaluate(v8::Local<v8::Value> node, mask_t & mask) {
+		mask.assign(this->rows.size(), 0);
+		std::string op;
+		v8::Local<v8::Array> arr;
+		if (!this->header(node, op, arr)) { return true; }
+
+		if (op == "and" || op == "or") {
+			mask_t rhs;
+			v8::Local<v8::Value> left, right;
+			if (!arr->Get(JS_CONTEXT, 1).ToLocal(&left) || !arr->Get(JS_CONTEXT, 2).ToLocal(&right)) { return false; }
+			if (!this->evaluate(left, mask) || !this->evaluate(right, rhs)) { return false; }
+			bool conjunction = (op == "and");
+			for (size_t i=0; i<mask.size(); i++) { mask[i] = (conjunction ? mask[i] & rhs[i] : mask[i] | rhs[i]); }
+			return true;
+		}
+
+		if (op == "col" || op == "val") { /* bare value: its truthiness */
+			Operand operand;
+			if (!this->operand(node, operand)) { return false; }
+			for (size_t i=0; i<mask.size(); i++) { mask[i] = operand.at(i)->BooleanValue(JS_ISOLATE); }
+			return true;
+		}
+
+		v8::Local<v8::Value> left, right;
+		if (!arr->Get(JS_CONTEXT, 1).ToLocal(&left) || !arr->Get(JS_CONTEXT, 2).ToLocal(&right)) { return false; }
+		Operand lhs;
+		if (!this->operand(left, lhs)) { return false; }
+
+		if (op == "in") {
+			if (!right->IsArray()) { this->supported = false; return true; }
+			v8::Local<v8::Array> items = v8::Local<v8::Array>::Cast(right);
+			for (uint32_t j=0; j<items->Length(); j++) {
+				v8::Local<v8::Value> item;
+				Operand rhs;
+				if (!items->Get(JS_CONTEXT, j).ToLocal(&item) || !this->operand(item, rhs)) { return false; }
+				if (!this->loose_equal(lhs, rhs, mask)) { return false; }
+			}
+			return true;
+		}
+
+		Operand rhs;
+		if (!this->operand(right, rhs)) { return false; }
+		return this->compare(op, lhs, rhs, mask);
+	}
+
+private:
+	bool header(v8::Local<v8::Value> node, std::string & op, v8::Local<v8::Array> & arr) {
+		if (!node->IsArray()) { this->supported = false; return false; }
+		arr = v8::Local<v8::Array>::Cast(node);
+		v8::Local<v8::Value> name;
+		if (arr->Length() < 2 || !arr->Get(JS_CONTEXT, 0).ToLocal(&name) || !name->IsString()) { this->supported = false; return false; }
+		op = to_string(name);
+		return true;
+	}
+
+	/* leaves only: ["col", name] or ["val", value] */
+	bool operand(v8::Local<v8::Value> node, Operand & result) {
+		std::string op;
+		v8::Local<v8::Array> arr;
+		result.constant = true;
+		result.numeric = false;
+		result.value = JS_UNDEFINED;
+		if (!this->header(node, op, arr)) { return true; }
+
+		v8::Local<v8::Value> payload;
+		if (!arr->Get(JS_CONTEXT, 1).ToLocal(&payload)) { return false; }
+		if (op == "val") {
+			result.value = payload;
+			result.numeric = payload->IsNumber();
+			if (result.numeric) { result.number = v8::Local<v8::Number>::Cast(payload)->Value(); }
+			return true;
+		}
+		if (op != "col") { this->supported = false; return true; }
+
+		result.constant = false;
+		result.numeric = true;
+		size_t count = this->rows.size();
+		result.values.resize(count);
+		result.numbers.resize(count);
+		for (size_t i=0; i<count; i++) {
+			v8::Local<v8::Value> value;
+			if (!this->rows[i]->Get(JS_CONTEXT, payload).ToLocal(&value)) { return false; }
+			result.values[i] = value;
+			if (result.numeric && value->IsNumber()) {
+				result.numbers[i] = v8::Local<v8::Number>::Cast(value)->Value();
+			} else {
+				result.numeric = false;
+			}
+		}
+		return true;
+	}
+
+	/* JS relational operators on two strings compare UTF-16 code units */
+	static int compare_strings(v8::Local<v8::Value> a, v8::Local<v8::Value> b) {
+		v8::String::Value sa(JS_ISOLATE, a);
+		v8::String::Value sb(JS_ISOLATE, b);
+		int la = sa.length(), lb = sb.length();
+		int length = (la < lb ? la : lb);
+		for (int i=0; i<length; i++) {
+			if ((*sa)[i] != (*sb)[i]) { return ((*sa)[i] < (*sb)[i] ? -1 : 1); }
+		}
+		return (la == lb ? 0 : (la < lb ? -1 : 1));
+	}
+
+	static bool test(const std::string & op, double a, double b) {
+		if (op == "<") { return a < b; }
+		if (op == "<=") { return a <= b; }
+		if (op == ">") { return a > b; }
+		if (op == ">=") { return a >= b; }
+		if (op == "=") { return a == b; }
+		return a != b;
+	}
+
+	static bool test(const std::string & op, int cmp) {
+		if (op == "<") { return cmp < 0; }
+		if (op == "<=") { return cmp <= 0; }
+		if (op == ">") { return cmp > 0; }
+		return cmp >= 0;
+	}
+
+	/* the common case: numeric column against a number, as a straight loop over doubles */
+	static void numeric_column(const std::string & op, const double * column, double c, size_t count, uint8_t * out, bool swapped) {
+		int code = (op == "<" ? 0 : op == "<=" ? 1 : op == ">" ? 2 : op == ">=" ? 3 : op == "=" ? 4 : 5);
+		if (swapped && code < 4) { code ^= 2; } /* c < x  <=>  x > c */
+		switch (code) {
+			case 0: for (size_t i=0; i<count; i++) { out[i] = column[i] < c; } break;
+			case 1: for (size_t i=0; i<count; i++) { out[i] = column[i] <= c; } break;
+			case 2: for (size_t i=0; i<count; i++) { out[i] = column[i] > c; } break;
+			case 3: for (size_t i=0; i<count; i++) { out[i] = column[i] >= c; } break;
+			case 4: for (size_t i=0; i<count; i++) { out[i] = column[i] == c; } break;
+			default: for (size_t i=0; i<count; i++) { out[i] = column[i] != c; } break;
+		}
+	}
+
+	bool compare(const std::string & op, Operand & lhs, Operand & rhs, mask_t & mask) {
+		bool equality = (op == "=" || op == "!=");
+		if (!equality && op != "<" && op != "<=" && op != ">" && op != ">=") { this->supported = false; return true; }
+		size_t count = mask.size();
+
+		if (lhs.numeric && rhs.numeric) {
+			if (!lhs.constant && rhs.constant) {
+				numeric_column(op, lhs.numbers.data(), rhs.number, count, mask.data(), false);
+			} else if (lhs.constant && !rhs.constant) {
+				numeric_column(op, rhs.numbers.data(), lhs.number, count, mask.data(), true);
+			} else {
+				for (size_t i=0; i<count; i++) {
+					double a = (lhs.constant ? lhs.number : lhs.numbers[i]);
+					double b = (rhs.constant ? rhs.number : rhs.numbers[i]);
+					mask[i] = test(op, a, b);
+				}
+			}
+			return true;
+		}
+
+		for (size_t i=0; i<count; i++) {
+			v8::Local<v8::Value> a = lhs.at(i);
+			v8::Local<v8::Value> b = rhs.at(i);
+			if (equality) { /* === and !== */
+				mask[i] = (a->StrictEquals(b) == (op == "="));
+			} else if (a->IsNumber() && b->IsNumber()) {
+				mask[i] = test(op, v8::Local<v8::Number>::Cast(a)->Value(), v8::Local<v8::Number>::Cast(b)->Value());
+			} else if (a->IsString() && b->IsString()) {
+				mask[i] = test(op, compare_strings(a, b));
+			} else { /* mixed types: leave the coercion rules to JS */
+				this->supported = false;
+				return true;
+			}
+		}
+		return true;
+	}
+
+	/* IN uses ==; ORs the matches into mask */
+	bool loose_equal(Operand & lhs, Operand & rhs, mask_t & mask) {
+		size_t count = mask.size();
+		for (size_t i=0; i<count; i++) {
+			if (mask[i]) { continue; }
+			if (lhs.numeric && rhs.numeric) {
+				mask[i] = ((lhs.constant ? lhs.number : lhs.numbers[i]) == (rhs.constant ? rhs.number : rhs.numbers[i]));
+				continue;
+			}
+			v8::Local<v8::Value> a = lhs.at(i);
+			v8::Local<v8::Value> b = rhs.at(i);
+			if (a->IsString() && b->IsString()) {
+				mask[i] = a->StrictEquals(b);
+			} else {
+				v8::Maybe<bool> equal = a->Equals(JS_CONTEXT, b);
+				if (equal.IsNothing()) { return false; }
+				mask[i] = equal.FromJust();
+			}
+		}
+		return true;
+	}
+};
+
+/**
+ * @param {object[]} rows
+ * @param {array} program nested ["and"|"or", a, b], [op, a, b], ["in", a, [b, ...]], ["col", name], ["val", value]
+ * @returns {object[] || null} matching rows; null when the program has to be evaluated in JS
+ */
+JS_METHOD(_filter) {
+	if (args.Length() < 2 || !args[0]->IsArray()) { JS_TYPE_ERROR("Invalid call format. Use 'filter(rows, program)'"); return; }
+	v8::Local<v8::Array> input = v8::Local<v8::Array>::Cast(args[0]);
+	uint32_t length = input->Length();
+
+	std::vector<v8::Local<v8::Object> > rows;
+	rows.reserve(length);
+	for (uint32_t i=0; i<length; i++) {
+		v8::Local<v8::Value> row;
+		if (!input->Get(JS_CONTEXT, i).ToLocal(&row)) { return; }
+		if (!row->IsObject()) { args.GetReturnValue().Set(JS_NULL); return; }
+		rows.push_back(v8::Local<v8::Object>::Cast(row));
+	}
+
+	Filter filter(rows);
+	mask_t mask;
+	if (!filter.evaluate(args[1], mask)) { return; }
+	if (!filter.supported) { args.GetReturnValue().Set(JS_NULL); return; }
+
+	std::vector<v8::Local<v8::Value> > result;
+	for (uint32_t i=0; i<length; i++) {
+		if (mask[i]) { result.push_back(rows[i]); }
+	}
+	args.GetReturnValue().Set(v8::Array::New(JS_ISOLATE, result.data(), result.size()));
+}
+
+}
+
+SHARED_INIT() {
+	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
+
+	(void)exports->Set(JS_CONTEXT, JS_STR("expand"), v8::FunctionTemplate::New(JS_ISOLATE, _expand)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("qualify"), v8::FunctionTemplate::New(JS_ISOLATE, _qualify)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("filter"), v8::FunctionTemplate::New(JS_ISOLATE, _filter)->GetFunction(JS_CONTEXT).ToLocalChecked());
+}
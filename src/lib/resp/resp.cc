@@ -0,0 +1,459 @@
+/**
+ * Redis serialization protocol (RESP2 and RESP3). Incremental reply parser
+ * and command encoder; the socket I/O stays in lib/redis.js.
+ *
+ * The parser keeps its position between reads: completed values of an open
+ * aggregate stay on a stack, and only the unfinished element is buffered.
+ * Bulk strings which arrive whole are returned as Buffer views into the
+ * received data; strings split across reads are copied once.
+ */
+
+#include <v8.h>
+#include "macros.h"
+#include "common.h"
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+
+#define RESP_MAX_DEPTH 64
+#define RESP_MAX_ITEMS 0xFFFFFFFELL /* largest JS array */
+
+#define PARSE_ERROR -1
+#define PARSE_INCOMPLETE 0
+#define PARSE_OK 1
+
+#define PARSER_PTR Parser * parser = LOAD_PTR(0, Parser *)
+
+namespace {
+
+/* an aggregate whose items are still being read */
+typedef struct {
+	char type;
+	int64_t remaining;		/* items; maps and attributes count keys and values */
+	uint32_t index;
+	v8::Global<v8::Object> container;
+	v8::Global<v8::Value> key;	/* map key waiting for its value */
+} frame_t;
+
+class Parser {
+public:
+	Parser(bool _buffers, bool _views) : buffers(_buffers), views(_views) {}
+	~Parser() { this->reset(); }
+
+	void reset() {
+		for (size_t i=0; i<this->stack.size(); i++) { delete this->stack[i]; }
+		this->stack.clear();
+		this->pending.clear();
+	}
+
+	std::string pending;			/* bytes of an unfinished element */
+	std::vector<frame_t *> stack;	/* open aggregates, outermost first */
+	bool buffers;					/* bulk strings as Buffers (true) or strings */
+	bool views;						/* Buffers may be views into the pushed data */
+};
+
+typedef struct {
+	ByteStorage * source; /* NULL when parsing buffered bytes, which are copied */
+	const char * data;
+	size_t length;
+} input_t;
+
+void Parser_destroy(void * ptr) {
+	delete (Parser *) ptr;
+}
+
+/**
+ * Find the CRLF-terminated line starting at *pos
+ */
+inline bool read_line(input_t * in, size_t * pos, const char ** line, size_t * length) {
+	const char * start = in->data + *pos;
+	size_t available = in->length - *pos;
+	const char * cr = (const char *) memchr(start, '\r', available);
+	while (cr && (size_t) (cr - start) + 1 < available && cr[1] != '\n') {
+		cr = (const char *) memchr(cr + 1, '\r', available - (cr + 1 - start));
+	}
+	if (!cr || (size_t) (cr - start) + 1 >= available) { return false; }
+	*line = start;
+	*length = cr - start;
+	*pos += *length + 2;
+	return true;
+}
+
+inline bool parse_integer(const char * line, size_t length, int64_t * result) {
+	if (!length) { return false; }
+	bool negative = (line[0] == '-');
+	size_t i = (negative || line[0] == '+' ? 1 : 0);
+	if (i == length) { return false; }
+	int64_t value = 0;
+	for (; i<length; i++) {
+		if (line[i] < '0' || line[i] > '9') { return false; }
+		if (value > (INT64_MAX - (line[i] - '0')) / 10) { return false; }
+		value = value * 10 + (line[i] - '0');
+	}
+	*result = (negative ? -value : value);
+	return true;
+}
+
+inline v8::Local<v8::Value> make_bytes(input_t * in, const char * data, size_t length, bool buffers) {
+	if (!buffers) { return JS_STR_LEN(data, (int) length); }
+	if (!in->source) { return JS_BUFFER(data, length); }
+	size_t start = data - in->source->getData();
+	return BYTESTORAGE_TO_JS(new ByteStorage(in->source, start, start + length));
+}
+
+inline v8::Local<v8::Value> make_error(const char * data, size_t length) {
+	v8::Local<v8::String> message = JS_STR_LEN(data, (int) length);
+	v8::Local<v8::Object> error = v8::Exception::Error(message)->ToObject(JS_CONTEXT).ToLocalChecked();
+	(void)error->Set(JS_CONTEXT, JS_STR("redis"), JS_BOOL(true));
+	return error;
+}
+
+/**
+ * Read a length-prefixed blob ($, !, =)
+ */
+int parse_blob(input_t * in, size_t * pos, const char * line, size_t lineLength, const char ** blob, int64_t * blobLength) {
+	if (!parse_integer(line, lineLength, blobLength)) { JS_ERROR("Invalid RESP length"); return PARSE_ERROR; }
+	if (*blobLength < 0) { return PARSE_OK; }
+	if (in->length - *pos < (size_t) *blobLength + 2) { return PARSE_INCOMPLETE; }
+	*blob = in->data + *pos;
+	*pos += (size_t) *blobLength + 2;
+	return PARSE_OK;
+}
+
+/**
+ * Parse one element at *pos. Aggregates with items are pushed to the stack
+ * and *value is left empty; their items follow as separate elements.
+ * @returns {int} PARSE_OK (pos advanced), PARSE_INCOMPLETE, PARSE_ERROR (thrown)
+ */
+int parse_element(Parser * parser, input_t * in, size_t * pos, v8::Local<v8::Value> * value, bool buffers) {
+	if (*pos >= in->length) { return PARSE_INCOMPLETE; }
+
+	char type = in->data[*pos];
+	size_t p = *pos + 1;
+	const char * line;
+	size_t lineLength;
+	if (!read_line(in, &p, &line, &lineLength)) { return PARSE_INCOMPLETE; }
+
+	int64_t count;
+	int status = PARSE_OK;
+	const char * blob = NULL;
+
+	switch (type) {
+		case '+': /* simple string */
+			*value = JS_STR_LEN(line, (int) lineLength);
+		break;
+
+		case '-': /* error */
+			*value = make_error(line, lineLength);
+		break;
+
+		case ':': /* integer */
+			if (!parse_integer(line, lineLength, &count)) { JS_ERROR("Invalid RESP integer"); return PARSE_ERROR; }
+			*value = v8::Number::New(JS_ISOLATE, (double) count);
+		break;
+
+		case '(': /* big number, kept as string */
+			*value = JS_STR_LEN(line, (int) lineLength);
+		break;
+
+		case ',': { /* double */
+			std::string number(line, lineLength);
+			*value = v8::Number::New(JS_ISOLATE, strtod(number.c_str(), NULL));
+		} break;
+
+		case '#': /* boolean */
+			*value = JS_BOOL(lineLength == 1 && line[0] == 't');
+		break;
+
+		case '_': /* null */
+			*value = JS_NULL;
+		break;
+
+		case '$': /* bulk string */
+		case '!': /* bulk error */
+		case '=': /* verbatim string, "xxx:" format prefix */
+			status = parse_blob(in, &p, line, lineLength, &blob, &count);
+			if (status != PARSE_OK) { return status; }
+			if (count < 0) {
+				*value = JS_NULL;
+			} else if (type == '!') {
+				*value = make_error(blob, (size_t) count);
+			} else if (type == '=' && count >= 4) {
+				*value = make_bytes(in, blob + 4, (size_t) count - 4, buffers);
+			} else {
+				*value = make_bytes(in, blob, (size_t) count, buffers);
+			}
+		break;
+
+		case '*': /* array */
+		case '~': /* set */
+		case '>': /* push */
+		case '%': /* map */
+		case '|': { /* attribute; applies to the following reply, which is returned instead */
+			bool keyed = (type == '%' || type == '|');
+			if (!parse_integer(line, lineLength, &count) || (keyed && count < 0) || count > RESP_MAX_ITEMS) { JS_ERROR("Invalid RESP length"); return PARSE_ERROR; }
+			if (count < 0) { *value = JS_NULL; break; }
+			if (parser->stack.size() >= RESP_MAX_DEPTH) { JS_ERROR("RESP nesting too deep"); return PARSE_ERROR; }
+
+			/* the array grows as items arrive; count is not trusted for allocation */
+			v8::Local<v8::Object> container;
+			if (keyed) {
+				container = v8::Object::New(JS_ISOLATE);
+			} else {
+				container = v8::Array::New(JS_ISOLATE);
+				if (type == '>') { (void)container->Set(JS_CONTEXT, JS_STR("push"), JS_BOOL(true)); }
+			}
+			if (!count && type != '|') { *value = container; break; }
+
+			frame_t * frame = new frame_t();
+			frame->type = type;
+			frame->remaining = (keyed ? count * 2 : count);
+			frame->index = 0;
+			frame->container.Reset(JS_ISOLATE, container);
+			parser->stack.push_back(frame);
+		} break;
+
+		default: {
+			std::string message = "Unknown RESP type '";
+			message += type;
+			message += "'";
+			JS_ERROR(message.c_str());
+		} return PARSE_ERROR;
+	}
+
+	*pos = p;
+	return PARSE_OK;
+}
+
+/**
+ * Parse elements until one complete reply is available.
+ * @returns {int} PARSE_OK (reply in *value), PARSE_INCOMPLETE (state kept), PARSE_ERROR (thrown)
+ */
+int parse(Parser * parser, input_t * in, size_t * pos, v8::Local<v8::Value> * value) {
+	while (true) {
+		frame_t * top = (parser->stack.empty() ? NULL : parser->stack.back());
+		v8::Local<v8::Value> item;
+
+		if (top && top->type == '|' && !top->remaining) {
+			/* attribute read; the next element replaces it */
+			delete top;
+			parser->stack.pop_back();
+			continue;
+		}
+		if (top && !top->remaining) { /* aggregate complete */
+			item = v8::Local<v8::Object>::New(JS_ISOLATE, top->container);
+			delete top;
+			parser->stack.pop_back();
+		} else {
+			bool key = (top && (top->type == '%' || top->type == '|') && top->key.IsEmpty());
+			int status = parse_element(parser, in, pos, &item, (key ? false : parser->buffers));
+			if (status != PARSE_OK) { return status; }
+			if (item.IsEmpty()) { continue; } /* aggregate opened */
+		}
+
+		top = (parser->stack.empty() ? NULL : parser->stack.back());
+		if (!top) {
+			*value = item;
+			return PARSE_OK;
+		}
+
+		v8::Local<v8::Object> container = v8::Local<v8::Object>::New(JS_ISOLATE, top->container);
+		if (top->type == '%' || top->type == '|') {
+			if (top->key.IsEmpty()) {
+				top->key.Reset(JS_ISOLATE, item);
+			} else {
+				(void)container->Set(JS_CONTEXT, v8::Local<v8::Value>::New(JS_ISOLATE, top->key), item);
+				top->key.Reset();
+			}
+		} else {
+			(void)container->Set(JS_CONTEXT, top->index++, item);
+		}
+		top->remaining--;
+	}
+}
+
+/**
+ * @param {bool} [buffers=true] Return bulk strings as Buffers or as strings
+ * @param {bool} [views=true] Buffers are views into the pushed data (no copy);
+ *   pass false when the caller reuses its read buffer
+ */
+JS_METHOD(_parser) {
+	ASSERT_CONSTRUCTOR;
+	bool buffers = (args.Length() > 0 && !args[0]->IsUndefined() ? args[0]->BooleanValue(JS_ISOLATE) : true);
+	bool views = (args.Length() > 1 && !args[1]->IsUndefined() ? args[1]->BooleanValue(JS_ISOLATE) : true);
+	Parser * parser = new Parser(buffers, views);
+	SAVE_PTR(0, parser);
+	GC * gc = GC_PTR;
+	gc->add(args.This(), Parser_destroy, 0);
+	args.GetReturnValue().Set(args.This());
+}
+
+/**
+ * Feed received bytes.
+ * @param {Buffer} data
+ * @returns {array} Complete replies; error replies are Error instances with .redis = true
+ */
+JS_METHOD(_push) {
+	PARSER_PTR;
+	if (args.Length() < 1 || !IS_BUFFER(args[0])) { JS_TYPE_ERROR("Invalid call format. Use 'parser.push(buffer)'"); return; }
+
+	ByteStorage * bs = JS_TO_BYTESTORAGE(args[0]);
+	input_t in;
+	bool buffered = !parser->pending.empty();
+	if (!buffered) { /* views into the received data, unless they have to be copies */
+		in.source = (parser->views ? bs : NULL);
+		in.data = bs->getData();
+		in.length = bs->getLength();
+	} else { /* continue the unfinished element; only the new bytes are appended */
+		parser->pending.append(bs->getData(), bs->getLength());
+		in.source = NULL;
+		in.data = parser->pending.data();
+		in.length = parser->pending.length();
+	}
+
+	v8::Local<v8::Array> result = v8::Array::New(JS_ISOLATE);
+	size_t pos = 0;
+	int status = PARSE_OK;
+	while (pos < in.length) {
+		v8::Local<v8::Value> value;
+		status = parse(parser, &in, &pos, &value);
+		if (status != PARSE_OK) { break; }
+		(void)result->Set(JS_CONTEXT, result->Length(), value);
+	}
+
+	if (status == PARSE_ERROR) {
+		parser->reset();
+		return;
+	}
+	if (!buffered) {
+		parser->pending.assign(in.data + pos, in.length - pos);
+	} else if (pos) {
+		parser->pending.erase(0, pos);
+	}
+	args.GetReturnValue().Set(result);
+}
+
+/**
+ * @returns {bool} Whether a partial reply is buffered
+ */
+JS_METHOD(_isPending) {
+	PARSER_PTR;
+	args.GetReturnValue().Set(JS_BOOL(!parser->pending.empty() || !parser->stack.empty()));
+}
+
+/**
+ * Convert command arguments to byte ranges; strings are kept alive in storage.
+ */
+void collect(v8::Local<v8::Array> command, std::vector<std::string> & storage, std::vector<const char *> & datas, std::vector<size_t> & sizes) {
+	uint32_t count = command->Length();
+	for (uint32_t i=0; i<count; i++) {
+		v8::Local<v8::Value> item = command->Get(JS_CONTEXT, i).ToLocalChecked();
+		if (IS_BUFFER(item)) {
+			size_t size = 0;
+			datas.push_back(JS_BUFFER_TO_CHAR(item, &size));
+			sizes.push_back(size);
+		} else {
+			v8::String::Utf8Value str(JS_ISOLATE, item);
+			storage.push_back(std::string(*str, str.length()));
+			datas.push_back(NULL); /* resolved after storage stops growing */
+			sizes.push_back(storage.size() - 1);
+		}
+	}
+}
+
+/**
+ * @param {array[]} commands Each command is an array of strings, numbers or Buffers
+ * @returns {Buffer} RESP arrays of bulk strings, ready to be written at once
+ */
+v8::Local<v8::Value> encode(v8::Local<v8::Array> commands) {
+	std::vector<std::string> storage;
+	std::vector<const char *> datas;
+	std::vector<size_t> sizes;
+	std::vector<size_t> counts;
+
+	uint32_t count = commands->Length();
+	for (uint32_t i=0; i<count; i++) {
+		v8::Local<v8::Value> command = commands->Get(JS_CONTEXT, i).ToLocalChecked();
+		if (!command->IsArray()) { throw std::string("Command must be an array"); }
+		size_t before = datas.size();
+		collect(v8::Local<v8::Array>::Cast(command), storage, datas, sizes);
+		counts.push_back(datas.size() - before);
+	}
+	for (size_t i=0; i<datas.size(); i++) { /* strings: size holds the storage index */
+		if (datas[i]) { continue; }
+		const std::string & str = storage[sizes[i]];
+		datas[i] = str.data();
+		sizes[i] = str.length();
+	}
+
+	char number[32];
+	size_t total = 0;
+	for (size_t i=0; i<counts.size(); i++) { total += snprintf(number, sizeof(number), "*%zu\r\n", counts[i]); }
+	for (size_t i=0; i<datas.size(); i++) { total += snprintf(number, sizeof(number), "$%zu\r\n", sizes[i]) + sizes[i] + 2; }
+
+	ByteStorage * bs = new ByteStorage(total);
+	char * out = bs->getData();
+	size_t index = 0;
+	for (size_t i=0; i<counts.size(); i++) {
+		out += sprintf(out, "*%zu\r\n", counts[i]);
+		for (size_t j=0; j<counts[i]; j++, index++) {
+			out += sprintf(out, "$%zu\r\n", sizes[index]);
+			memcpy(out, datas[index], sizes[index]);
+			out += sizes[index];
+			*out++ = '\r';
+			*out++ = '\n';
+		}
+	}
+	return BYTESTORAGE_TO_JS(bs);
+}
+
+/**
+ * @param {array} command
+ * @returns {Buffer}
+ */
+JS_METHOD(_encode) {
+	if (args.Length() < 1 || !args[0]->IsArray()) { JS_TYPE_ERROR("Invalid call format. Use 'encode([command, arg, ...])'"); return; }
+	v8::Local<v8::Array> commands = v8::Array::New(JS_ISOLATE, 1);
+	(void)commands->Set(JS_CONTEXT, 0, args[0]);
+	args.GetReturnValue().Set(encode(commands));
+}
+
+/**
+ * @param {array[]} commands
+ * @returns {Buffer} All commands, for pipelining
+ */
+JS_METHOD(_encodeMany) {
+	if (args.Length() < 1 || !args[0]->IsArray()) { JS_TYPE_ERROR("Invalid call format. Use 'encodeMany([[command, arg, ...], ...])'"); return; }
+	try {
+		args.GetReturnValue().Set(encode(v8::Local<v8::Array>::Cast(args[0])));
+	} catch (std::string e) {
+		JS_TYPE_ERROR(e.c_str());
+	}
+}
+
+}
+
+SHARED_INIT() {
+	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
+
+	v8::Local<v8::FunctionTemplate> ft = v8::FunctionTemplate::New(JS_ISOLATE, _parser);
+	ft->SetClassName(JS_STR("Parser"));
+
+	v8::Local<v8::ObjectTemplate> it = ft->InstanceTemplate();
+	it->SetInternalFieldCount(1); /* parser */
+
+	v8::Local<v8::ObjectTemplate> pt = ft->PrototypeTemplate();
+
+	/**
+	 * Prototype methods (new Parser().*)
+	 */
+	pt->Set(JS_ISOLATE, "push"		, v8::FunctionTemplate::New(JS_ISOLATE, _push));
+	pt->Set(JS_ISOLATE, "isPending"	, v8::FunctionTemplate::New(JS_ISOLATE, _isPending));
+
+	(void)exports->Set(JS_CONTEXT, JS_STR("Parser"), ft->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("encode"), v8::FunctionTemplate::New(JS_ISOLATE, _encode)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("encodeMany"), v8::FunctionTemplate::New(JS_ISOLATE, _encodeMany)->GetFunction(JS_CONTEXT).ToLocalChecked());
+}
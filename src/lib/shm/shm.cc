@@ -0,0 +1,582 @@
+/**
+ * Shared memory cache. A fixed-size arena (POSIX shared memory) shared by all
+ * TeaJS processes on one host.
+ *
+ * Layout: header | bucket index | data slots. Every bucket owns one data slot
+ * (key + value). Buckets are addressed by open addressing with a bounded probe
+ * window. Writers serialize on a process-shared robust mutex; readers are
+ * lock-free and validate what they read with a per-bucket sequence counter.
+ * When the probe window is full, a CLOCK (second chance) sweep over the
+ * window picks the victim.
+ */
+
+#include <v8.h>
+#include "macros.h"
+#include "common.h"
+
+#include <string>
+#include <map>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <ctime>
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHM_MAGIC 0x54454153 /* "TEAS" */
+#define SHM_VERSION 1
+#define SHM_PROBE 16
+#define SHM_DEFAULT_SIZE (64 * 1024 * 1024)
+#define SHM_DEFAULT_SLOT 1024
+#define SHM_MIN_SLOT 64
+#define SHM_MAX_SLOT (1024 * 1024 * 1024)
+#define SHM_VIEW_RETRIES 10
+
+#define BUCKET_EMPTY 0
+#define BUCKET_USED 1
+#define BUCKET_DELETED 2
+
+#define TYPE_STRING 0
+#define TYPE_BUFFER 1
+
+#define SEGMENT_PTR Segment * segment = LOAD_PTR(0, Segment *)
+#define SHM_USAGE "Invalid call format. Use 'new Cache(name, [size], [slotSize])'"
+
+namespace {
+
+typedef struct {
+	std::atomic<uint32_t> magic;
+	uint32_t version;
+	uint64_t size;
+	uint32_t buckets;
+	uint32_t slotSize;
+	pthread_mutex_t lock;
+	std::atomic<uint64_t> hits;
+	std::atomic<uint64_t> misses;
+	std::atomic<uint64_t> sets;
+	std::atomic<uint64_t> evictions;
+	std::atomic<uint64_t> expired;
+	std::atomic<uint32_t> used;
+} shm_header_t;
+
+typedef struct {
+	std::atomic<uint32_t> seq; /* odd while being written */
+	std::atomic<uint8_t> ref; /* CLOCK reference bit */
+	uint8_t state;
+	uint8_t type;
+	uint8_t reserved;
+	uint32_t keyLength;
+	uint32_t valueLength;
+	uint64_t hash;
+	uint64_t expires; /* ms since epoch, 0 = never */
+} shm_bucket_t;
+
+/**
+ * Process-local view of one mapped segment. Segments stay mapped for the whole
+ * process lifetime, so Buffers returned by view() never point to unmapped memory.
+ */
+class Segment {
+public:
+	std::string name;
+	char * base;
+	size_t size;
+	shm_header_t * header;
+	shm_bucket_t * buckets;
+	char * data;
+
+	char * slot(uint32_t index) { return this->data + (size_t)index * this->header->slotSize; }
+};
+
+std::map<std::string, Segment *> segments;
+
+uint64_t now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* FNV-1a */
+uint64_t hash_key(const char * key, size_t length) {
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i=0; i<length; i++) {
+		h ^= (unsigned char) key[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+std::string segment_path(std::string name) {
+	std::string path = "/teajs-";
+	for (size_t i=0; i<name.length(); i++) {
+		path += (name[i] == '/' ? '_' : name[i]);
+	}
+	return path;
+}
+
+void lock(shm_header_t * header) {
+	int result = pthread_mutex_lock(&header->lock);
+	if (result == EOWNERDEAD) { pthread_mutex_consistent(&header->lock); }
+}
+
+void unlock(shm_header_t * header) {
+	pthread_mutex_unlock(&header->lock);
+}
+
+/**
+ * Map (and possibly create + initialize) a named segment
+ */
+Segment * attach(std::string name, size_t size, uint32_t slotSize) {
+	std::map<std::string, Segment *>::iterator it = segments.find(name);
+	if (it != segments.end()) { return it->second; }
+
+	std::string path = segment_path(name);
+	bool creator = true;
+	int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (fd == -1 && errno == EEXIST) {
+		creator = false;
+		fd = shm_open(path.c_str(), O_RDWR, 0);
+	}
+	if (fd == -1) { throw std::string("Cannot open shared memory segment: ") + strerror(errno); }
+
+	if (creator) {
+		if (size < sizeof(shm_header_t) + sizeof(shm_bucket_t) + slotSize) {
+			close(fd);
+			shm_unlink(path.c_str());
+			throw std::string("Shared memory segment is too small");
+		}
+		uint32_t count = (uint32_t)((size - sizeof(shm_header_t)) / (sizeof(shm_bucket_t) + slotSize));
+		if (count < SHM_PROBE) {
+			close(fd);
+			shm_unlink(path.c_str());
+			throw std::string("Shared memory segment is too small");
+		}
+		if (ftruncate(fd, size) == -1) {
+			close(fd);
+			shm_unlink(path.c_str());
+			throw std::string("Cannot resize shared memory segment: ") + strerror(errno);
+		}
+	} else {
+		/* wait for the creator to finish sizing the segment */
+		struct stat st;
+		st.st_size = 0;
+		for (int i=0; i<1000; i++) {
+			if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(shm_header_t)) { break; }
+			usleep(1000);
+		}
+		if (st.st_size < (off_t)sizeof(shm_header_t)) {
+			close(fd);
+			throw std::string("Shared memory segment '") + name + "' was not initialized";
+		}
+		size = st.st_size;
+	}
+
+	void * base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) { throw std::string("Cannot map shared memory segment: ") + strerror(errno); }
+
+	shm_header_t * header = (shm_header_t *) base;
+	if (creator) {
+		header->version = SHM_VERSION;
+		header->size = size;
+		header->slotSize = slotSize;
+		header->buckets = (uint32_t)((size - sizeof(shm_header_t)) / (sizeof(shm_bucket_t) + slotSize));
+
+		pthread_mutexattr_t attr;
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+		pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+		pthread_mutex_init(&header->lock, &attr);
+		pthread_mutexattr_destroy(&attr);
+		/* ftruncate zeroed everything else */
+		header->magic.store(SHM_MAGIC, std::memory_order_release);
+	} else {
+		for (int i=0; i<1000 && header->magic.load(std::memory_order_acquire) != SHM_MAGIC; i++) { usleep(1000); }
+		if (header->magic.load(std::memory_order_acquire) != SHM_MAGIC || header->version != SHM_VERSION) {
+			munmap(base, size);
+			throw std::string("Shared memory segment '") + name + "' has an incompatible format";
+		}
+	}
+
+	Segment * segment = new Segment();
+	segment->name = name;
+	segment->base = (char *) base;
+	segment->size = size;
+	segment->header = header;
+	segment->buckets = (shm_bucket_t *) ((char *) base + sizeof(shm_header_t));
+	segment->data = (char *) (segment->buckets + header->buckets);
+	segments[name] = segment;
+	return segment;
+}
+
+/**
+ * Lock-free lookup. Returns bucket index or -1; value is copied to *value when not NULL.
+ * *length and *sequence receive the value length and bucket sequence of a consistent read.
+ */
+int64_t find(Segment * segment, const char * key, uint32_t keyLength, std::string * value, uint8_t * type, uint32_t * length = NULL, uint32_t * sequence = NULL) {
+	shm_header_t * header = segment->header;
+	uint64_t h = hash_key(key, keyLength);
+	uint64_t now = now_ms();
+
+	for (uint32_t probe=0; probe<SHM_PROBE; probe++) {
+		uint32_t index = (uint32_t)((h + probe) % header->buckets);
+		shm_bucket_t * bucket = &segment->buckets[index];
+
+		for (int spins=0; ; spins++) {
+			if (spins > 10000) { return -1; } /* writer died mid-update; writers repair it */
+			uint32_t seq = bucket->seq.load(std::memory_order_acquire);
+			if (seq & 1) { continue; } /* writer in progress */
+
+			uint8_t state = bucket->state;
+			bool match = (state == BUCKET_USED && bucket->hash == h && bucket->keyLength == keyLength);
+			uint32_t valueLength = bucket->valueLength;
+			uint64_t expires = bucket->expires;
+			uint8_t t = bucket->type;
+			char * slot = segment->slot(index);
+			if (match) {
+				match = (valueLength + keyLength <= header->slotSize) && memcmp(slot, key, keyLength) == 0;
+				if (match && value) { value->assign(slot + keyLength, valueLength); }
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (bucket->seq.load(std::memory_order_relaxed) != seq) { continue; } /* torn read, retry */
+
+			if (state == BUCKET_EMPTY) { return -1; }
+			if (!match) { break; }
+			if (expires && expires <= now) { return -1; }
+
+			bucket->ref.store(1, std::memory_order_relaxed);
+			if (type) { *type = t; }
+			if (length) { *length = valueLength; }
+			if (sequence) { *sequence = seq; }
+			return index;
+		}
+	}
+	return -1;
+}
+
+void begin_write(shm_bucket_t * bucket) {
+	bucket->seq.fetch_add(1, std::memory_order_acq_rel);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+void end_write(shm_bucket_t * bucket) {
+	std::atomic_thread_fence(std::memory_order_release);
+	bucket->seq.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * Writers only. A bucket left odd by a crashed writer is reclaimed as empty.
+ */
+void repair(shm_bucket_t * bucket) {
+	if (bucket->seq.load(std::memory_order_relaxed) & 1) {
+		bucket->state = BUCKET_DELETED;
+		bucket->seq.fetch_add(1, std::memory_order_release);
+	}
+}
+
+bool store(Segment * segment, const char * key, uint32_t keyLength, const char * value, uint32_t valueLength, uint8_t type, uint64_t expires) {
+	shm_header_t * header = segment->header;
+	if ((uint64_t)keyLength + valueLength > header->slotSize) { return false; }
+
+	uint64_t h = hash_key(key, keyLength);
+	uint64_t now = now_ms();
+	int64_t target = -1;
+	int64_t vacant = -1;
+
+	lock(header);
+	for (uint32_t probe=0; probe<SHM_PROBE; probe++) {
+		uint32_t index = (uint32_t)((h + probe) % header->buckets);
+		shm_bucket_t * bucket = &segment->buckets[index];
+		repair(bucket);
+
+		if (bucket->state == BUCKET_USED && bucket->hash == h && bucket->keyLength == keyLength && memcmp(segment->slot(index), key, keyLength) == 0) {
+			target = index;
+			break;
+		}
+		if (vacant == -1) {
+			if (bucket->state != BUCKET_USED) {
+				vacant = index;
+			} else if (bucket->expires && bucket->expires <= now) {
+				vacant = index;
+				header->expired.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+		if (bucket->state == BUCKET_EMPTY) { break; }
+	}
+
+	if (target == -1) { target = vacant; }
+	if (target == -1) { /* CLOCK sweep over the probe window; the second round always succeeds */
+		for (uint32_t round=0; round<2 && target == -1; round++) {
+			for (uint32_t probe=0; probe<SHM_PROBE; probe++) {
+				uint32_t index = (uint32_t)((h + probe) % header->buckets);
+				if (segment->buckets[index].ref.exchange(0, std::memory_order_relaxed) == 0) {
+					target = index;
+					break;
+				}
+			}
+		}
+		header->evictions.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	shm_bucket_t * bucket = &segment->buckets[target];
+	if (bucket->state != BUCKET_USED) { header->used.fetch_add(1, std::memory_order_relaxed); }
+
+	begin_write(bucket);
+	char * slot = segment->slot((uint32_t)target);
+	memcpy(slot, key, keyLength);
+	memcpy(slot + keyLength, value, valueLength);
+	bucket->hash = h;
+	bucket->keyLength = keyLength;
+	bucket->valueLength = valueLength;
+	bucket->expires = expires;
+	bucket->type = type;
+	bucket->state = BUCKET_USED;
+	bucket->ref.store(1, std::memory_order_relaxed);
+	end_write(bucket);
+
+	header->sets.fetch_add(1, std::memory_order_relaxed);
+	unlock(header);
+	return true;
+}
+
+bool erase(Segment * segment, const char * key, uint32_t keyLength) {
+	shm_header_t * header = segment->header;
+	uint64_t h = hash_key(key, keyLength);
+	bool result = false;
+
+	lock(header);
+	for (uint32_t probe=0; probe<SHM_PROBE; probe++) {
+		uint32_t index = (uint32_t)((h + probe) % header->buckets);
+		shm_bucket_t * bucket = &segment->buckets[index];
+		repair(bucket);
+		if (bucket->state == BUCKET_EMPTY) { break; }
+		if (bucket->state == BUCKET_USED && bucket->hash == h && bucket->keyLength == keyLength && memcmp(segment->slot(index), key, keyLength) == 0) {
+			begin_write(bucket);
+			bucket->state = BUCKET_DELETED;
+			end_write(bucket);
+			header->used.fetch_sub(1, std::memory_order_relaxed);
+			result = true;
+			break;
+		}
+	}
+	unlock(header);
+	return result;
+}
+
+/**
+ * Cache constructor
+ * @param {string} name Segment name, shared by all processes
+ * @param {int} [size] Total segment size in bytes (used only when creating)
+ * @param {int} [slotSize] Maximum key + value size in bytes (used only when creating)
+ */
+JS_METHOD(_cache) {
+	ASSERT_CONSTRUCTOR;
+	if (args.Length() < 1 || !args[0]->IsString()) { JS_TYPE_ERROR(SHM_USAGE); return; }
+
+	v8::String::Utf8Value name(JS_ISOLATE, args[0]);
+	int64_t size = SHM_DEFAULT_SIZE;
+	int64_t slotSize = SHM_DEFAULT_SLOT;
+	if (args.Length() > 1 && args[1]->IsNumber()) { size = args[1]->IntegerValue(JS_CONTEXT).ToChecked(); }
+	if (args.Length() > 2 && args[2]->IsNumber()) { slotSize = args[2]->IntegerValue(JS_CONTEXT).ToChecked(); }
+	if (slotSize < 1 || slotSize > SHM_MAX_SLOT) { JS_RANGE_ERROR("Slot size must be between 1 and 1073741824 bytes"); return; }
+	if (slotSize < SHM_MIN_SLOT) { slotSize = SHM_MIN_SLOT; }
+	slotSize = (slotSize + 7) & ~7LL;
+	if (size < (int64_t)(sizeof(shm_header_t) + sizeof(shm_bucket_t)) + slotSize) { JS_RANGE_ERROR("Segment size is too small for one slot"); return; }
+	if ((size - (int64_t)sizeof(shm_header_t)) / ((int64_t)sizeof(shm_bucket_t) + slotSize) > UINT32_MAX) { JS_RANGE_ERROR("Segment size results in too many buckets"); return; }
+
+	try {
+		Segment * segment = attach(*name, (size_t)size, (uint32_t)slotSize);
+		SAVE_PTR(0, segment);
+	} catch (std::string e) {
+		JS_ERROR(e);
+		return;
+	}
+	args.GetReturnValue().Set(args.This());
+}
+
+/**
+ * @param {string} key
+ * @returns {string || Buffer || null} copy of the stored value
+ */
+JS_METHOD(_get) {
+	SEGMENT_PTR;
+	v8::String::Utf8Value key(JS_ISOLATE, args[0]);
+	std::string value;
+	uint8_t type = TYPE_STRING;
+
+	if (find(segment, *key, key.length(), &value, &type) == -1) {
+		segment->header->misses.fetch_add(1, std::memory_order_relaxed);
+		args.GetReturnValue().Set(JS_NULL);
+		return;
+	}
+	segment->header->hits.fetch_add(1, std::memory_order_relaxed);
+	if (type == TYPE_BUFFER) {
+		args.GetReturnValue().Set(JS_BUFFER(value.data(), value.length()));
+	} else {
+		args.GetReturnValue().Set(JS_STR_LEN(value.data(), (int)value.length()));
+	}
+}
+
+/**
+ * Zero-copy access: calls callback with a Buffer mapped directly onto the shared slot.
+ * Reads through it are not protected against concurrent writers; the entry is checked
+ * after the callback returns and the callback is called again when it was modified
+ * meanwhile. The Buffer must not be written to nor kept after the callback returns.
+ * @param {string} key
+ * @param {function} callback
+ * @returns {any || null} result of the callback, null when the key is missing
+ */
+JS_METHOD(_view) {
+	SEGMENT_PTR;
+	if (args.Length() < 2 || !args[1]->IsFunction()) { JS_TYPE_ERROR("Bad argument count. Use 'cache.view(key, callback)'"); return; }
+	v8::String::Utf8Value key(JS_ISOLATE, args[0]);
+	v8::Local<v8::Function> callback = v8::Local<v8::Function>::Cast(args[1]);
+
+	for (int attempt=0; attempt<SHM_VIEW_RETRIES; attempt++) {
+		uint32_t length = 0;
+		uint32_t seq = 0;
+		int64_t index = find(segment, *key, key.length(), NULL, NULL, &length, &seq);
+		if (index == -1) {
+			segment->header->misses.fetch_add(1, std::memory_order_relaxed);
+			args.GetReturnValue().Set(JS_NULL);
+			return;
+		}
+
+		char * data = segment->slot((uint32_t)index) + key.length();
+		ByteStorageData * bsd = new ByteStorageData(data, length, false);
+		v8::Local<v8::Value> view = BYTESTORAGE_TO_JS(new ByteStorage(bsd));
+		v8::Local<v8::Value> result;
+		if (!callback->Call(JS_CONTEXT, JS_CONTEXT->Global(), 1, &view).ToLocal(&result)) { return; }
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (segment->buckets[index].seq.load(std::memory_order_relaxed) == seq) {
+			segment->header->hits.fetch_add(1, std::memory_order_relaxed);
+			args.GetReturnValue().Set(result);
+			return;
+		}
+	}
+	JS_ERROR("Entry kept changing while being viewed");
+}
+
+/**
+ * @param {string} key
+ * @param {string || Buffer} value
+ * @param {int} [ttl] Lifetime in seconds, 0 = forever
+ * @returns {bool} false when key + value do not fit into one slot
+ */
+JS_METHOD(_set) {
+	SEGMENT_PTR;
+	if (args.Length() < 2) { JS_TYPE_ERROR("Bad argument count. Use 'cache.set(key, value, [ttl])'"); return; }
+
+	v8::String::Utf8Value key(JS_ISOLATE, args[0]);
+	uint64_t expires = 0;
+	if (args.Length() > 2 && args[2]->IsNumber()) {
+		double ttl = args[2]->NumberValue(JS_CONTEXT).ToChecked();
+		if (ttl > 0) { expires = now_ms() + (uint64_t)(ttl * 1000); }
+	}
+
+	bool result;
+	if (IS_BUFFER(args[1])) {
+		size_t size = 0;
+		char * data = JS_BUFFER_TO_CHAR(args[1], &size);
+		result = store(segment, *key, key.length(), data, (uint32_t)size, TYPE_BUFFER, expires);
+	} else {
+		v8::String::Utf8Value data(JS_ISOLATE, args[1]);
+		result = store(segment, *key, key.length(), *data, data.length(), TYPE_STRING, expires);
+	}
+	args.GetReturnValue().Set(JS_BOOL(result));
+}
+
+JS_METHOD(_has) {
+	SEGMENT_PTR;
+	v8::String::Utf8Value key(JS_ISOLATE, args[0]);
+	args.GetReturnValue().Set(JS_BOOL(find(segment, *key, key.length(), NULL, NULL) != -1));
+}
+
+JS_METHOD(_remove) {
+	SEGMENT_PTR;
+	v8::String::Utf8Value key(JS_ISOLATE, args[0]);
+	args.GetReturnValue().Set(JS_BOOL(erase(segment, *key, key.length())));
+}
+
+/**
+ * Drop all entries (for all processes)
+ */
+JS_METHOD(_clear) {
+	SEGMENT_PTR;
+	shm_header_t * header = segment->header;
+	lock(header);
+	for (uint32_t i=0; i<header->buckets; i++) {
+		shm_bucket_t * bucket = &segment->buckets[i];
+		repair(bucket);
+		if (bucket->state == BUCKET_EMPTY) { continue; }
+		begin_write(bucket);
+		bucket->state = BUCKET_EMPTY;
+		end_write(bucket);
+	}
+	header->used.store(0, std::memory_order_relaxed);
+	unlock(header);
+	args.GetReturnValue().Set(args.This());
+}
+
+JS_METHOD(_stats) {
+	SEGMENT_PTR;
+	shm_header_t * header = segment->header;
+	v8::Local<v8::Object> result = v8::Object::New(JS_ISOLATE);
+	(void)result->Set(JS_CONTEXT, JS_STR("size"), JS_FLOAT((double)header->size));
+	(void)result->Set(JS_CONTEXT, JS_STR("buckets"), JS_FLOAT(header->buckets));
+	(void)result->Set(JS_CONTEXT, JS_STR("slotSize"), JS_FLOAT(header->slotSize));
+	(void)result->Set(JS_CONTEXT, JS_STR("used"), JS_FLOAT(header->used.load(std::memory_order_relaxed)));
+	(void)result->Set(JS_CONTEXT, JS_STR("hits"), JS_FLOAT((double)header->hits.load(std::memory_order_relaxed)));
+	(void)result->Set(JS_CONTEXT, JS_STR("misses"), JS_FLOAT((double)header->misses.load(std::memory_order_relaxed)));
+	(void)result->Set(JS_CONTEXT, JS_STR("sets"), JS_FLOAT((double)header->sets.load(std::memory_order_relaxed)));
+	(void)result->Set(JS_CONTEXT, JS_STR("evictions"), JS_FLOAT((double)header->evictions.load(std::memory_order_relaxed)));
+	(void)result->Set(JS_CONTEXT, JS_STR("expired"), JS_FLOAT((double)header->expired.load(std::memory_order_relaxed)));
+	args.GetReturnValue().Set(result);
+}
+
+/**
+ * Remove a named segment from the system. Processes which have it mapped keep using their mapping.
+ */
+JS_METHOD(_unlink) {
+	v8::String::Utf8Value name(JS_ISOLATE, args[0]);
+	std::string path = segment_path(*name);
+	if (shm_unlink(path.c_str()) == -1 && errno != ENOENT) {
+		JS_ERROR(strerror(errno));
+		return;
+	}
+	args.GetReturnValue().SetUndefined();
+}
+
+}
+
+SHARED_INIT() {
+	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
+
+	v8::Local<v8::FunctionTemplate> ft = v8::FunctionTemplate::New(JS_ISOLATE, _cache);
+	ft->SetClassName(JS_STR("Cache"));
+	ft->Set(JS_ISOLATE, "unlink", v8::FunctionTemplate::New(JS_ISOLATE, _unlink));
+
+	v8::Local<v8::ObjectTemplate> it = ft->InstanceTemplate();
+	it->SetInternalFieldCount(1); /* segment */
+
+	v8::Local<v8::ObjectTemplate> pt = ft->PrototypeTemplate();
+
+	/**
+	 * Prototype methods (new Cache().*)
+	 */
+	pt->Set(JS_ISOLATE, "get"		, v8::FunctionTemplate::New(JS_ISOLATE, _get));
+	pt->Set(JS_ISOLATE, "view"		, v8::FunctionTemplate::New(JS_ISOLATE, _view));
+	pt->Set(JS_ISOLATE, "set"		, v8::FunctionTemplate::New(JS_ISOLATE, _set));
+	pt->Set(JS_ISOLATE, "has"		, v8::FunctionTemplate::New(JS_ISOLATE, _has));
+	pt->Set(JS_ISOLATE, "remove"	, v8::FunctionTemplate::New(JS_ISOLATE, _remove));
+	pt->Set(JS_ISOLATE, "clear"		, v8::FunctionTemplate::New(JS_ISOLATE, _clear));
+	pt->Set(JS_ISOLATE, "stats"		, v8::FunctionTemplate::New(JS_ISOLATE, _stats));
+
+	(void)exports->Set(JS_CONTEXT, JS_STR("Cache"), ft->GetFunction(JS_CONTEXT).ToLocalChecked());
+}
@@ -4,6 +4,7 @@
 
 #include <v8.h>
 #include "macros.h"
+#include "metrics.h"
 #include "common.h"
 
 #include <cstdlib>
@@ -14,6 +15,9 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
 #include <cstdio>
 
 #ifdef windows
@@ -32,6 +36,7 @@
 #  include <netinet/tcp.h>
 #  include <netdb.h>
 #  include <arpa/inet.h>
+#  include <poll.h>
 #  define sock_errno errno
 #  define WOULD_BLOCK (sock_errno == EWOULDBLOCK || sock_errno == EAGAIN)
 #endif 
@@ -56,6 +61,52 @@
 #  define SOCKET_ERROR -1
 #endif
 
+#ifdef __linux__
+#  include <sys/epoll.h>
+#  define HAVE_EPOLL
+#  define POLL_READ EPOLLIN
+#  define POLL_WRITE EPOLLOUT
+#  define POLL_ERROR EPOLLERR
+#  define POLL_HANGUP EPOLLHUP
+#  define POLL_EDGE EPOLLET
+#  define POLL_ONESHOT EPOLLONESHOT
+#else
+#  define POLL_READ POLLIN
+#  define POLL_WRITE POLLOUT
+#  define POLL_ERROR POLLERR
+#  define POLL_HANGUP POLLHUP
+#  define POLL_EDGE 0
+#  define POLL_ONESHOT 0
+#endif
+
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#  define HAVE_MMSG
+#endif
+
+#define MMSG_MAX 64
+
+#ifndef windows
+#  include <sys/uio.h>
+#  include <climits>
+#  ifndef IOV_MAX
+#    define IOV_MAX 1024
+#  endif
+#endif
+
+#if !defined(TCP_CORK) && defined(TCP_NOPUSH)
+#  define TCP_CORK TCP_NOPUSH
+#endif
+
+#ifdef __linux__
+#  include <linux/errqueue.h>
+#endif
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#  define HAVE_ZEROCOPY
+#endif
+
+#define POLLER_PTR Poller * poller = LOAD_PTR(0, Poller *)
+#define POLLER_DEFAULT_EVENTS 256
+
 void FormatError() {
 #ifdef windows
 	int size = 0xFF;
@@ -364,10 +415,11 @@ JS_METHOD(_select) {
 	}
 	
 	/* prepare time info */
+	timeval time_info;
 	timeval * tv = NULL;
 	if (!args[3]->IsNull()) {
 		int time = args[3]->Int32Value(JS_CONTEXT).ToChecked();
-		tv = new timeval;
+		tv = &time_info;
 		tv->tv_sec = time / 1000;
 		tv->tv_usec = 1000 * (time % 1000);
 	}
@@ -382,7 +434,6 @@ JS_METHOD(_select) {
 		}
 	}
 
-	if (tv != NULL) { delete tv; } /* clean up time */
 	if (ret == SOCKET_ERROR) { return FormatError(); }
 	
 	/* delete unused sockets */
@@ -405,6 +456,198 @@ JS_METHOD(_select) {
 	args.GetReturnValue().Set(JS_INT(ret));
 }
 
+#ifndef windows
+/**
+ * Persistent interest set for Socket.Poller. Uses epoll where available,
+ * poll(2) elsewhere; unlike select(), neither is limited by FD_SETSIZE.
+ */
+class Poller {
+public:
+	int fd;
+	std::vector<int> ready; /* fd, events pairs from the last wait */
+#ifdef HAVE_EPOLL
+	std::vector<struct epoll_event> events;
+#else
+	std::vector<struct pollfd> fds;
+#endif
+	std::map<int, int> interest;
+};
+
+void Poller_destroy(void * ptr) {
+	Poller * poller = (Poller *) ptr;
+	if (!poller) { return; }
+	if (poller->fd != -1) { close(poller->fd); }
+	delete poller;
+}
+
+/**
+ * Socket.Poller constructor
+ * @param {int} [maxEvents] Maximum number of events reported by one wait()
+ */
+JS_METHOD(_poller) {
+	ASSERT_CONSTRUCTOR;
+	int max = POLLER_DEFAULT_EVENTS;
+	if (args.Length() > 0 && args[0]->IsNumber()) { max = args[0]->Int32Value(JS_CONTEXT).ToChecked(); }
+	if (max < 1) { max = 1; }
+
+	Poller * poller = new Poller();
+	poller->fd = -1;
+#ifdef HAVE_EPOLL
+	poller->fd = epoll_create1(EPOLL_CLOEXEC);
+	if (poller->fd == -1) {
+		delete poller;
+		FormatError();
+		return;
+	}
+	poller->events.resize(max);
+#endif
+
+	SAVE_PTR(0, poller);
+	SAVE_VALUE(1, v8::Map::New(JS_ISOLATE)); /* fd => registered object */
+	GC * gc = GC_PTR;
+	gc->add(args.This(), Poller_destroy, 0);
+	args.GetReturnValue().Set(args.This());
+}
+
+/**
+ * Register, modify or (with events == 0) unregister interest in a socket
+ */
+void Poller_update(const v8::FunctionCallbackInfo<v8::Value>& args, v8::Local<v8::Value> socket, int events) {
+	if (!socket->IsObject() || !isSocket(socket)) { JS_TYPE_ERROR("First argument must be a Socket instance"); return; }
+	POLLER_PTR;
+#ifdef HAVE_EPOLL
+	if (poller->fd == -1) { JS_ERROR("Poller is closed"); return; }
+#endif
+
+	int fd = jsToSocket(socket);
+	v8::Local<v8::Map> registry = v8::Local<v8::Map>::Cast(LOAD_VALUE(1));
+	std::map<int, int>::iterator it = poller->interest.find(fd);
+	bool known = (it != poller->interest.end());
+
+#ifdef HAVE_EPOLL
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	int result = 0;
+	if (!events) {
+		if (known) { result = epoll_ctl(poller->fd, EPOLL_CTL_DEL, fd, &ev); }
+	} else {
+		result = epoll_ctl(poller->fd, (known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD), fd, &ev);
+		/* descriptor was closed and reused since it was registered */
+		if (result == -1 && known && errno == ENOENT) { result = epoll_ctl(poller->fd, EPOLL_CTL_ADD, fd, &ev); }
+	}
+	if (result == -1 && !(errno == EBADF && !events)) { FormatError(); return; } /* closed sockets leave the set on their own */
+#else
+	if (known) {
+		for (size_t i=0; i<poller->fds.size(); i++) {
+			if (poller->fds[i].fd != fd) { continue; }
+			if (events) {
+				poller->fds[i].events = (short) events;
+			} else {
+				poller->fds.erase(poller->fds.begin() + i);
+			}
+			break;
+		}
+	} else if (events) {
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = (short) events;
+		pfd.revents = 0;
+		poller->fds.push_back(pfd);
+	}
+#endif
+
+	if (events) {
+		poller->interest[fd] = events;
+		(void)registry->Set(JS_CONTEXT, JS_INT(fd), socket);
+	} else if (known) {
+		poller->interest.erase(it);
+		(void)registry->Delete(JS_CONTEXT, JS_INT(fd));
+	}
+	args.GetReturnValue().Set(args.This());
+}
+
+/**
+ * @param {Socket} socket Socket or an object with getSocket()
+ * @param {int} events Combination of Poller.READ, Poller.WRITE, Poller.EDGE, Poller.ONESHOT; 0 = remove
+ */
+JS_METHOD(_poller_set) {
+	if (args.Length() < 2) { JS_TYPE_ERROR("Bad argument count. Use 'poller.set(socket, events)'"); return; }
+	Poller_update(args, args[0], args[1]->Int32Value(JS_CONTEXT).ToChecked());
+}
+
+JS_METHOD(_poller_remove) {
+	if (args.Length() < 1) { JS_TYPE_ERROR("Bad argument count. Use 'poller.remove(socket)'"); return; }
+	Poller_update(args, args[0], 0);
+}
+
+/**
+ * Wait for events
+ * @param {int || null} timeout Milliseconds; null or negative = infinite
+ * @returns {object[]} Dense array of {socket, events}
+ */
+JS_METHOD(_poller_wait) {
+	POLLER_PTR;
+	int timeout = -1;
+	if (args.Length() > 0 && args[0]->IsNumber()) { timeout = args[0]->Int32Value(JS_CONTEXT).ToChecked(); }
+	if (timeout < -1) { timeout = -1; }
+
+	poller->ready.clear();
+	int ret;
+	{
+		v8::Unlocker unlocker(JS_ISOLATE);
+#ifdef HAVE_EPOLL
+		do {
+			ret = epoll_wait(poller->fd, &poller->events[0], (int)poller->events.size(), timeout);
+		} while (ret == -1 && errno == EINTR);
+		for (int i=0; i<ret; i++) {
+			poller->ready.push_back(poller->events[i].data.fd);
+			poller->ready.push_back((int)poller->events[i].events);
+		}
+#else
+		do {
+			ret = poll(poller->fds.size() ? &poller->fds[0] : NULL, (nfds_t)poller->fds.size(), timeout);
+		} while (ret == -1 && errno == EINTR);
+		for (size_t i=0; ret > 0 && i<poller->fds.size(); i++) {
+			if (!poller->fds[i].revents) { continue; }
+			poller->ready.push_back(poller->fds[i].fd);
+			poller->ready.push_back(poller->fds[i].revents);
+		}
+#endif
+	}
+	if (ret == -1) { FormatError(); return; }
+
+	v8::Local<v8::Map> registry = v8::Local<v8::Map>::Cast(LOAD_VALUE(1));
+	v8::Local<v8::String> socketKey = JS_STR("socket");
+	v8::Local<v8::String> eventsKey = JS_STR("events");
+	int count = (int)poller->ready.size() / 2;
+	v8::Local<v8::Array> result = v8::Array::New(JS_ISOLATE, count);
+	for (int i=0; i<count; i++) {
+		int fd = poller->ready[2*i];
+		v8::Local<v8::Object> item = v8::Object::New(JS_ISOLATE);
+		(void)item->Set(JS_CONTEXT, socketKey, registry->Get(JS_CONTEXT, JS_INT(fd)).ToLocalChecked());
+		(void)item->Set(JS_CONTEXT, eventsKey, JS_INT(poller->ready[2*i+1]));
+		(void)result->Set(JS_CONTEXT, i, item);
+	}
+	args.GetReturnValue().Set(result);
+}
+
+JS_METHOD(_poller_close) {
+	POLLER_PTR;
+	if (poller->fd != -1) {
+		close(poller->fd);
+		poller->fd = -1;
+	}
+	poller->interest.clear();
+#ifndef HAVE_EPOLL
+	poller->fds.clear();
+#endif
+	v8::Local<v8::Map>::Cast(LOAD_VALUE(1))->Clear();
+	args.GetReturnValue().SetUndefined();
+}
+#endif
+
 JS_METHOD(_makeNonblock) {
 	if (args.Length() != 1) {
 		JS_TYPE_ERROR("Bad argument count. Socket.select must be called with 4 arguments.");
@@ -426,6 +669,7 @@ JS_METHOD(_makeNonblock) {
 }
 
 JS_METHOD(_connect) {
+	Metrics::Timer timer(METRICS_PTR, "socket.connect");
 	int family = args.This()->Get(JS_CONTEXT,JS_STR("family")).ToLocalChecked()->Int32Value(JS_CONTEXT).ToChecked();
 	int sock = LOAD_VALUE(0)->Int32Value(JS_CONTEXT).ToChecked();
 
@@ -497,6 +741,7 @@ JS_METHOD(_listen) {
 }
 
 JS_METHOD(_accept) {
+	Metrics::Timer timer(METRICS_PTR, "socket.accept");
 	int sock = LOAD_VALUE(0)->Int32Value(JS_CONTEXT).ToChecked();
 	int sock2 = accept(sock, NULL, NULL);
 	if (sock2 != INVALID_SOCKET) { 
@@ -514,6 +759,7 @@ JS_METHOD(_accept) {
 }
 
 JS_METHOD(_send) {
+	Metrics::Timer timer(METRICS_PTR, "socket.send");
 	int sock = LOAD_VALUE(0)->Int32Value(JS_CONTEXT).ToChecked();
 
 	if (args.Length() < 1) {
@@ -549,7 +795,112 @@ JS_METHOD(_send) {
 	FormatError();
 }
 
+/**
+ * Gather-write several Buffers and strings with one syscall.
+ * With Socket.MSG_ZEROCOPY (and SO_ZEROCOPY enabled), Buffers are transmitted
+ * in place and must not be modified until socket.zerocopyCompleted() reports them.
+ * @param {array} parts Buffers or strings
+ * @param {int} [flags]
+ * @returns {int || false} Bytes sent, false when it would block
+ */
+JS_METHOD(_sendv) {
+	Metrics::Timer timer(METRICS_PTR, "socket.sendv");
+	int sock = LOAD_VALUE(0)->Int32Value(JS_CONTEXT).ToChecked();
+	if (args.Length() < 1 || !args[0]->IsArray()) {
+		JS_TYPE_ERROR("Bad argument count. Use 'socket.sendv(parts, [flags])'");
+		return;
+	}
+	int flags = (args.Length() > 1 ? args[1]->Int32Value(JS_CONTEXT).FromMaybe(0) : 0);
+
+	v8::Local<v8::Array> parts = v8::Local<v8::Array>::Cast(args[0]);
+	size_t count = parts->Length();
+#ifndef windows
+	if (count > IOV_MAX) { count = IOV_MAX; } /* caller sees a short write */
+#endif
+
+	std::vector<std::string> strings(count);
+	std::vector<char *> datas(count);
+	std::vector<size_t> sizes(count);
+	for (size_t i=0; i<count; i++) {
+		v8::Local<v8::Value> item = parts->Get(JS_CONTEXT, (uint32_t) i).ToLocalChecked();
+		if (IS_BUFFER(item)) {
+			datas[i] = JS_BUFFER_TO_CHAR(item, &sizes[i]);
+		} else {
+#ifdef HAVE_ZEROCOPY
+			if (flags & MSG_ZEROCOPY) { JS_TYPE_ERROR("MSG_ZEROCOPY requires Buffer parts"); return; }
+#endif
+			v8::String::Utf8Value str(JS_ISOLATE, item);
+			strings[i].assign(*str, str.length());
+			datas[i] = (char *) strings[i].data();
+			sizes[i] = strings[i].length();
+		}
+	}
+
+	ssize_t result;
+#ifdef windows
+	std::string joined;
+	for (size_t i=0; i<count; i++) { joined.append(datas[i], sizes[i]); }
+	result = send(sock, joined.data(), (int) joined.length(), flags);
+#else
+	std::vector<struct iovec> iov(count ? count : 1);
+	for (size_t i=0; i<count; i++) {
+		iov[i].iov_base = datas[i];
+		iov[i].iov_len = sizes[i];
+	}
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov[0];
+	msg.msg_iovlen = count;
+	result = sendmsg(sock, &msg, flags);
+#endif
+
+	if (result != SOCKET_ERROR) { args.GetReturnValue().Set(JS_INT((int)result)); return; }
+	if (WOULD_BLOCK) { args.GetReturnValue().Set(JS_BOOL(false)); return; }
+	FormatError();
+}
+
+/**
+ * Drain MSG_ZEROCOPY completion notifications from the error queue.
+ * Every zerocopy send gets a sequence number, starting at 0 for each socket.
+ * @returns {object || null} {last: highest completed send, copied: kernel fell back to copying}
+ */
+JS_METHOD(_zerocopycompleted) {
+#ifdef HAVE_ZEROCOPY
+	int sock = LOAD_VALUE(0)->Int32Value(JS_CONTEXT).ToChecked();
+	int64_t last = -1;
+	bool copied = false;
+
+	while (1) {
+		char control[128];
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+			if (WOULD_BLOCK) { break; }
+			FormatError();
+			return;
+		}
+		for (struct cmsghdr * cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			struct sock_extended_err * err = (struct sock_extended_err *) CMSG_DATA(cm);
+			if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) { continue; }
+			if ((int64_t) err->ee_data > last) { last = err->ee_data; }
+			if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) { copied = true; }
+		}
+	}
+
+	if (last == -1) { args.GetReturnValue().SetNull(); return; }
+	v8::Local<v8::Object> result = v8::Object::New(JS_ISOLATE);
+	(void)result->Set(JS_CONTEXT, JS_STR("last"), JS_INT((int) last));
+	(void)result->Set(JS_CONTEXT, JS_STR("copied"), JS_BOOL(copied));
+	args.GetReturnValue().Set(result);
+#else
+	args.GetReturnValue().SetNull();
+#endif
+}
+
 JS_METHOD(_receive) {
+	Metrics::Timer timer(METRICS_PTR, "socket.receive");
 	int sock = LOAD_VALUE(0)->Int32Value(JS_CONTEXT).ToChecked();
 	int count = args[0]->Int32Value(JS_CONTEXT).ToChecked();
 	int type = args.This()->Get(JS_CONTEXT,JS_STR("type")).ToLocalChecked()->Int32Value(JS_CONTEXT).ToChecked();
@@ -573,7 +924,195 @@ JS_METHOD(_receive) {
 	FormatError();
 }
 
+/**
+ * Read directly into an existing Buffer, without intermediate allocation.
+ * @param {Buffer} buffer
+ * @param {int} [offset=0]
+ * @param {int} [length=buffer.length-offset]
+ * @returns {int || false} Bytes read, false when it would block
+ */
+JS_METHOD(_receiveinto) {
+	Metrics::Timer timer(METRICS_PTR, "socket.receiveinto");
+	int sock = LOAD_VALUE(0)->Int32Value(JS_CONTEXT).ToChecked();
+	int type = args.This()->Get(JS_CONTEXT,JS_STR("type")).ToLocalChecked()->Int32Value(JS_CONTEXT).ToChecked();
+	char * data = NULL;
+	size_t count = 0;
+	if (!JS_BUFFER_RANGE(args, 0, &data, &count)) { return; }
+
+	sock_addr_t addr;
+	socklen_t len = sizeof(addr);
+	ssize_t result = recvfrom(sock, data, count, 0, (sockaddr *) &addr, &len);
+	if (result != SOCKET_ERROR) {
+		if (type == SOCK_DGRAM) { SAVE_VALUE(1, create_peer((sockaddr *) &addr)); }
+		args.GetReturnValue().Set(JS_INT((int)result));
+		return;
+	}
+
+	if (WOULD_BLOCK) { args.GetReturnValue().Set(JS_BOOL(false)); return; }
+	FormatError();
+}
+
+/**
+ * Receive a batch of datagrams with one syscall (recvmmsg where available).
+ * Message i is stored at buffer offset i*slotSize.
+ * @param {Buffer} buffer
+ * @param {int} slotSize Maximum size of one datagram
+ * @param {int} [maxMessages] Defaults to as many slots as fit
+ * @param {array} [peers] When passed, filled with sender addresses
+ * @returns {int[] || false} Message lengths, false when it would block
+ */
+JS_METHOD(_receivemany) {
+	Metrics::Timer timer(METRICS_PTR, "socket.receivemany");
+	int sock = LOAD_VALUE(0)->Int32Value(JS_CONTEXT).ToChecked();
+	if (args.Length() < 2 || !IS_BUFFER(args[0])) {
+		JS_TYPE_ERROR("Bad argument count. Use 'socket.receiveMany(buffer, slotSize, [maxMessages], [peers])'");
+		return;
+	}
+
+	size_t size = 0;
+	char * data = JS_BUFFER_TO_CHAR(args[0], &size);
+	size_t slot = (size_t) args[1]->IntegerValue(JS_CONTEXT).FromMaybe(0);
+	if (!slot || slot > size) { JS_RANGE_ERROR("Slot size out of range"); return; }
+	size_t max = size / slot;
+	if (args.Length() > 2 && args[2]->IsNumber()) { max = std::min(max, (size_t) args[2]->IntegerValue(JS_CONTEXT).FromMaybe(0)); }
+	if (max > MMSG_MAX) { max = MMSG_MAX; }
+	if (!max) { args.GetReturnValue().Set(v8::Array::New(JS_ISOLATE, 0)); return; }
+
+	sock_addr_t addrs[MMSG_MAX];
+	size_t lengths[MMSG_MAX];
+	int received = 0;
+
+#ifdef HAVE_MMSG
+	struct mmsghdr msgs[MMSG_MAX];
+	struct iovec iov[MMSG_MAX];
+	memset(msgs, 0, sizeof(struct mmsghdr) * max);
+	for (size_t i=0; i<max; i++) {
+		iov[i].iov_base = data + i*slot;
+		iov[i].iov_len = slot;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &addrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(sock_addr_t);
+	}
+	received = recvmmsg(sock, msgs, (unsigned int) max, MSG_WAITFORONE, NULL);
+	for (int i=0; i<received; i++) { lengths[i] = msgs[i].msg_len; }
+#else
+	for (size_t i=0; i<max; i++) {
+		int flags = 0;
+		if (i) {
+#ifdef MSG_DONTWAIT
+			flags = MSG_DONTWAIT; /* block for the first datagram only */
+#else
+			break;
+#endif
+		}
+		socklen_t len = sizeof(sock_addr_t);
+		ssize_t result = recvfrom(sock, data + i*slot, slot, flags, (sockaddr *) &addrs[i], &len);
+		if (result == SOCKET_ERROR) {
+			if (i) { break; }
+			received = -1;
+			break;
+		}
+		lengths[i] = (size_t) result;
+		received++;
+	}
+#endif
+
+	if (received == SOCKET_ERROR) {
+		if (WOULD_BLOCK) { args.GetReturnValue().Set(JS_BOOL(false)); return; }
+		FormatError();
+		return;
+	}
+
+	v8::Local<v8::Array> result = v8::Array::New(JS_ISOLATE, received);
+	v8::Local<v8::Object> peers;
+	bool wantPeers = (args.Length() > 3 && args[3]->IsArray());
+	if (wantPeers) { peers = args[3]->ToObject(JS_CONTEXT).ToLocalChecked(); }
+	for (int i=0; i<received; i++) {
+		(void)result->Set(JS_CONTEXT, i, JS_INT((int) lengths[i]));
+		if (wantPeers) { (void)peers->Set(JS_CONTEXT, i, create_peer((sockaddr *) &addrs[i])); }
+	}
+	args.GetReturnValue().Set(result);
+}
+
+/**
+ * Send a batch of datagrams with one syscall (sendmmsg where available).
+ * @param {array} messages Buffers or strings
+ * @param {string} [address]
+ * @param {int} [port]
+ * @returns {int || false} Number of messages sent, false when it would block
+ */
+JS_METHOD(_sendmany) {
+	Metrics::Timer timer(METRICS_PTR, "socket.sendmany");
+	int sock = LOAD_VALUE(0)->Int32Value(JS_CONTEXT).ToChecked();
+	if (args.Length() < 1 || !args[0]->IsArray()) {
+		JS_TYPE_ERROR("Bad argument count. Use 'socket.sendMany(messages, [address], [port])'");
+		return;
+	}
+
+	sock_addr_t taddr;
+	sockaddr * target = NULL;
+	socklen_t len = 0;
+	if (args.Length() > 1) {
+		int family = args.This()->Get(JS_CONTEXT,JS_STR("family")).ToLocalChecked()->Int32Value(JS_CONTEXT).ToChecked();
+		v8::String::Utf8Value address(JS_ISOLATE,args[1]);
+		int port = args[2]->Int32Value(JS_CONTEXT).ToChecked();
+		int r = create_addr(*address, port, family, &taddr, &len);
+		if (r != 0) { JS_ERROR("Malformed address"); return; }
+		target = (sockaddr *) &taddr;
+	}
+
+	v8::Local<v8::Array> messages = v8::Local<v8::Array>::Cast(args[0]);
+	size_t count = std::min((size_t) messages->Length(), (size_t) MMSG_MAX);
+
+	/* strings need stable storage for the duration of the call; buffers are used in place */
+	std::vector<std::string> strings(count);
+	std::vector<char *> datas(count);
+	std::vector<size_t> sizes(count);
+	for (size_t i=0; i<count; i++) {
+		v8::Local<v8::Value> item = messages->Get(JS_CONTEXT, (uint32_t) i).ToLocalChecked();
+		if (IS_BUFFER(item)) {
+			datas[i] = JS_BUFFER_TO_CHAR(item, &sizes[i]);
+		} else {
+			v8::String::Utf8Value str(JS_ISOLATE, item);
+			strings[i].assign(*str, str.length());
+			datas[i] = (char *) strings[i].data();
+			sizes[i] = strings[i].length();
+		}
+	}
+
+	int sent = 0;
+#ifdef HAVE_MMSG
+	struct mmsghdr msgs[MMSG_MAX];
+	struct iovec iov[MMSG_MAX];
+	memset(msgs, 0, sizeof(struct mmsghdr) * count);
+	for (size_t i=0; i<count; i++) {
+		iov[i].iov_base = datas[i];
+		iov[i].iov_len = sizes[i];
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = target;
+		msgs[i].msg_hdr.msg_namelen = len;
+	}
+	sent = (count ? sendmmsg(sock, msgs, (unsigned int) count, 0) : 0);
+#else
+	for (size_t i=0; i<count; i++) {
+		ssize_t result = sendto(sock, datas[i], sizes[i], 0, target, len);
+		if (result == SOCKET_ERROR) {
+			if (!i) { sent = -1; }
+			break;
+		}
+		sent++;
+	}
+#endif
+
+	if (sent != SOCKET_ERROR) { args.GetReturnValue().Set(JS_INT(sent)); return; }
+	if (WOULD_BLOCK) { args.GetReturnValue().Set(JS_BOOL(false)); return; }
+	FormatError();
+}
+
 JS_METHOD(_receive_strict) {
+	Metrics::Timer timer(METRICS_PTR, "socket.receive_strict");
 	bool debug = false;
 	if (const char* env_d = std::getenv("PRINT_DEBUGS")) {
 		if (strcmp(env_d, "1") == 0) {
@@ -726,6 +1265,9 @@ JS_METHOD(_setoption) {
 	int level;
 	switch (name) {
 		case TCP_NODELAY:
+#ifdef TCP_CORK
+		case TCP_CORK:
+#endif
 			level = IPPROTO_TCP;
 		break;
 		default:
@@ -772,6 +1314,9 @@ JS_METHOD(_getoption) {
 	int level;
 	switch (name) {
 		case TCP_NODELAY:
+#ifdef TCP_CORK
+		case TCP_CORK:
+#endif
 			level = IPPROTO_TCP;
 		break;
 		default:
@@ -876,6 +1421,13 @@ SHARED_INIT() {
 	socketTemplate->Set(JS_ISOLATE,"SO_KEEPALIVE"	, JS_INT(SO_KEEPALIVE)); 
 	socketTemplate->Set(JS_ISOLATE,"SO_ERROR"		, JS_INT(SO_ERROR)); 
 	socketTemplate->Set(JS_ISOLATE,"TCP_NODELAY"	, JS_INT(TCP_NODELAY)); 
+#ifdef TCP_CORK
+	socketTemplate->Set(JS_ISOLATE,"TCP_CORK"		, JS_INT(TCP_CORK));
+#endif
+#ifdef HAVE_ZEROCOPY
+	socketTemplate->Set(JS_ISOLATE,"SO_ZEROCOPY"	, JS_INT(SO_ZEROCOPY));
+	socketTemplate->Set(JS_ISOLATE,"MSG_ZEROCOPY"	, JS_INT(MSG_ZEROCOPY));
+#endif
 	
 	/*fprintf(stderr,"socket.cc > SHARED_INIT context=%ld\n",(void*)*(JS_CONTEXT));
 	v8::MaybeLocal<v8::Function> tmp_func1=v8::FunctionTemplate::New(JS_ISOLATE, _getprotobyname)->GetFunction(JS_CONTEXT);
@@ -906,6 +1458,11 @@ SHARED_INIT() {
 	pt->Set(JS_ISOLATE,"send"			, v8::FunctionTemplate::New(JS_ISOLATE, _send));
 	pt->Set(JS_ISOLATE,"receive"		, v8::FunctionTemplate::New(JS_ISOLATE, _receive));
 	pt->Set(JS_ISOLATE,"receive_strict"	, v8::FunctionTemplate::New(JS_ISOLATE, _receive_strict));
+	pt->Set(JS_ISOLATE,"receiveInto"	, v8::FunctionTemplate::New(JS_ISOLATE, _receiveinto));
+	pt->Set(JS_ISOLATE,"receiveMany"	, v8::FunctionTemplate::New(JS_ISOLATE, _receivemany));
+	pt->Set(JS_ISOLATE,"sendMany"		, v8::FunctionTemplate::New(JS_ISOLATE, _sendmany));
+	pt->Set(JS_ISOLATE,"sendv"			, v8::FunctionTemplate::New(JS_ISOLATE, _sendv));
+	pt->Set(JS_ISOLATE,"zerocopyCompleted", v8::FunctionTemplate::New(JS_ISOLATE, _zerocopycompleted));
 	pt->Set(JS_ISOLATE,"bind"			, v8::FunctionTemplate::New(JS_ISOLATE, _bind));
 	pt->Set(JS_ISOLATE,"listen"			, v8::FunctionTemplate::New(JS_ISOLATE, _listen));
 	pt->Set(JS_ISOLATE,"accept"			, v8::FunctionTemplate::New(JS_ISOLATE, _accept));
@@ -916,6 +1473,27 @@ SHARED_INIT() {
 	pt->Set(JS_ISOLATE,"setBlocking"	, v8::FunctionTemplate::New(JS_ISOLATE, _setblocking));
 	pt->Set(JS_ISOLATE,"getPeerName"	, v8::FunctionTemplate::New(JS_ISOLATE, _getpeername));
 
+#ifndef windows
+	v8::Local<v8::FunctionTemplate> pollerTemplate = v8::FunctionTemplate::New(JS_ISOLATE, _poller);
+	pollerTemplate->SetClassName(JS_STR("Poller"));
+	pollerTemplate->Set(JS_ISOLATE,"READ"		, JS_INT(POLL_READ));
+	pollerTemplate->Set(JS_ISOLATE,"WRITE"		, JS_INT(POLL_WRITE));
+	pollerTemplate->Set(JS_ISOLATE,"ERROR"		, JS_INT(POLL_ERROR));
+	pollerTemplate->Set(JS_ISOLATE,"HANGUP"		, JS_INT(POLL_HANGUP));
+	pollerTemplate->Set(JS_ISOLATE,"EDGE"		, JS_INT(POLL_EDGE));
+	pollerTemplate->Set(JS_ISOLATE,"ONESHOT"	, JS_INT(POLL_ONESHOT));
+	pollerTemplate->InstanceTemplate()->SetInternalFieldCount(2); /* poller, registry */
+
+	v8::Local<v8::ObjectTemplate> ppt = pollerTemplate->PrototypeTemplate();
+	ppt->Set(JS_ISOLATE,"set"			, v8::FunctionTemplate::New(JS_ISOLATE, _poller_set));
+	ppt->Set(JS_ISOLATE,"add"			, v8::FunctionTemplate::New(JS_ISOLATE, _poller_set));
+	ppt->Set(JS_ISOLATE,"modify"		, v8::FunctionTemplate::New(JS_ISOLATE, _poller_set));
+	ppt->Set(JS_ISOLATE,"remove"		, v8::FunctionTemplate::New(JS_ISOLATE, _poller_remove));
+	ppt->Set(JS_ISOLATE,"wait"			, v8::FunctionTemplate::New(JS_ISOLATE, _poller_wait));
+	ppt->Set(JS_ISOLATE,"close"			, v8::FunctionTemplate::New(JS_ISOLATE, _poller_close));
+	socketTemplate->Set(JS_ISOLATE,"Poller"			, pollerTemplate);
+#endif
+
 	(void)exports->Set(JS_CONTEXT,JS_STR("Socket"), socketTemplate->GetFunction(JS_CONTEXT).ToLocalChecked());
 	_socketFunc.Reset(JS_ISOLATE, socketTemplate->GetFunction(JS_CONTEXT).ToLocalChecked());
 	//fprintf(stderr,"socket.cc > SHARED_INIT end()\n");
@@ -0,0 +1,351 @@
+/**
+ * Native part of the "template" module: compiles templates once into
+ * context-independent scripts and hands out render functions bound to the
+ * current request's context. The render functions are kept in an object
+ * owned by that context, so nothing here holds on to a finished request.
+ *
+ * Compiled templates are keyed by file name and dropped as soon as the file
+ * or any of its includes changes mtime. Static segments are kept as shared
+ * strings (external for ASCII text), so rendering only concatenates them
+ * into V8 cons strings instead of copying.
+ */
+
+#include <v8.h>
+#include "macros.h"
+#include "common.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define MAX_INCLUDE_DEPTH 16
+#define MAX_STRING_TEMPLATES 128
+
+namespace {
+
+/**
+ * Static segment text owned by V8 once the string is created
+ */
+class StaticResource : public v8::String::ExternalOneByteStringResource {
+public:
+	StaticResource(const std::string & str) : value(str) {}
+	const char * data() const { return this->value.data(); }
+	size_t length() const { return this->value.length(); }
+private:
+	std::string value;
+};
+
+typedef std::map<std::string, time_t> mtimes_t;
+
+class Compiled {
+public:
+	v8::Global<v8::UnboundScript> script;
+	std::vector<v8::Global<v8::String> > statics;
+	mtimes_t files; /* template and its includes */
+	unsigned int id; /* index of the render function in the context's object, see bind() */
+};
+
+typedef std::map<std::string, Compiled *> cache_t;
+
+cache_t file_templates;
+cache_t string_templates;
+unsigned int next_id = 0;
+
+time_t file_mtime(const std::string & name) {
+	struct stat st;
+	if (stat(name.c_str(), &st) != 0) { return -1; }
+	return st.st_mtime;
+}
+
+bool is_fresh(Compiled * compiled) {
+	mtimes_t::iterator it;
+	for (it = compiled->files.begin(); it != compiled->files.end(); it++) {
+		if (file_mtime(it->first) != it->second) { return false; }
+	}
+	return true;
+}
+
+/**
+ * Cached template for a key, or NULL when missing or stale
+ */
+Compiled * lookup(cache_t & cache, const std::string & key) {
+	cache_t::iterator it = cache.find(key);
+	if (it == cache.end()) { return NULL; }
+	if (is_fresh(it->second)) { return it->second; }
+	delete it->second;
+	cache.erase(it);
+	return NULL;
+}
+
+bool is_lowercase(const std::string & str) {
+	for (size_t i=0; i<str.length(); i++) {
+		if (str[i] < 'a' || str[i] > 'z') { return false; }
+	}
+	return true;
+}
+
+/**
+ * Turns template text into the body of a render function. Same syntax as
+ * Template.prototype._process in template.js: $(expr), $code(statements)
+ * and $include(file).
+ */
+class Compiler {
+public:
+	Compiler(const std::string & path, const std::string & suffix) : path(path), suffix(suffix) {}
+
+	std::string code;
+	std::vector<std::string> statics;
+	mtimes_t files;
+
+	std::string filename(const std::string & file) {
+		std::string name = this->path + file;
+		if (this->suffix.length()) { name += "." + this->suffix; }
+		return name;
+	}
+
+	std::string read(const std::string & file) {
+		std::string name = this->filename(file);
+		FILE * f = fopen(name.c_str(), "rb");
+		if (!f) { throw std::string("Cannot open '") + name + "'"; }
+		std::string result;
+		char buffer[8192];
+		size_t count;
+		while ((count = fread(buffer, 1, sizeof(buffer), f)) > 0) { result.append(buffer, count); }
+		fclose(f);
+		this->files[name] = file_mtime(name);
+		return result;
+	}
+
+	void process(const std::string & str, int level) {
+		if (level > MAX_INCLUDE_DEPTH) { throw std::string("Templates are included too deep"); }
+		std::string token; /* token being processed */
+		std::string command;
+		int depth = 0;
+		bool flag = false; /* in command part */
+
+		for (size_t i=0; i<str.length(); i++) {
+			char ch = str[i];
+			switch (ch) {
+				case '$':
+					if (!depth && !flag) { /* start of js expression */
+						flag = true;
+						this->tokenStatic(token);
+						token = "";
+					} else {
+						token += ch;
+					}
+				break;
+
+				case '(':
+					if (flag) { /* start of js expression content */
+						flag = false;
+						depth++;
+						command = token;
+						token = "";
+					} else {
+						if (depth > 0) { depth++; }
+						token += ch;
+					}
+				break;
+
+				case ')':
+					if (depth > 0) {
+						depth--;
+						if (depth == 0) { /* end of js expression */
+							this->tokenCommand(token, command, level);
+							token = "";
+						} else {
+							token += ch;
+						}
+					} else {
+						token += ch;
+					}
+				break;
+
+				default:
+					token += ch;
+				break;
+			}
+			if (flag && !is_lowercase(token)) { /* fake dollar alert */
+				flag = false;
+				token = "$" + token;
+			}
+		}
+		if (flag) { token = "$" + token; }
+		this->tokenStatic(token);
+	}
+
+private:
+	std::string path;
+	std::string suffix;
+
+	void tokenStatic(const std::string & str) {
+		if (!str.length()) { return; }
+		char index[32];
+		snprintf(index, sizeof(index), "%lu", (unsigned long) this->statics.size());
+		this->statics.push_back(str);
+		this->code += "__output += __s[";
+		this->code += index;
+		this->code += "];\n";
+	}
+
+	void tokenCommand(const std::string & str, const std::string & command, int level) {
+		if (command == "code") {
+			this->code += str + ";\n";
+		} else if (command == "include") {
+			this->process(this->read(str), level + 1);
+		} else {
+			this->code += "__output += " + str + ";\n";
+		}
+	}
+};
+
+bool is_ascii(const std::string & str) {
+	for (size_t i=0; i<str.length(); i++) {
+		if (str[i] & 0x80) { return false; }
+	}
+	return true;
+}
+
+/**
+ * Compile generated code; NULL when V8 threw (syntax error in the template)
+ */
+Compiled * build(Compiler & compiler, const std::string & name) {
+	std::string source = "(function(__s) { return function(data) {\nvar __output = \"\";\n";
+	source += compiler.code;
+	source += "return __output;\n}; })";
+
+	v8::ScriptOrigin origin(JS_ISOLATE, JS_STR(name.c_str()));
+	v8::ScriptCompiler::Source src(JS_STR_LEN(source.c_str(), (int) source.length()), origin);
+	v8::MaybeLocal<v8::UnboundScript> script = v8::ScriptCompiler::CompileUnboundScript(JS_ISOLATE, &src);
+	if (script.IsEmpty()) { return NULL; }
+
+	Compiled * compiled = new Compiled();
+	compiled->script.Reset(JS_ISOLATE, script.ToLocalChecked());
+	compiled->files = compiler.files;
+	compiled->id = next_id++;
+	for (size_t i=0; i<compiler.statics.size(); i++) {
+		const std::string & str = compiler.statics[i];
+		v8::Local<v8::String> value;
+		if (is_ascii(str)) {
+			value = v8::String::NewExternalOneByte(JS_ISOLATE, new StaticResource(str)).ToLocalChecked();
+		} else {
+			value = JS_STR_LEN(str.c_str(), (int) str.length());
+		}
+		compiled->statics.emplace_back(JS_ISOLATE, value);
+	}
+	return compiled;
+}
+
+/**
+ * Render function for the current context; created once per request
+ * @param {object} renders render functions of this context by Compiled::id
+ */
+v8::MaybeLocal<v8::Function> bind(Compiled * compiled, v8::Local<v8::Object> renders) {
+	v8::Local<v8::Value> cached;
+	if (renders->Get(JS_CONTEXT, compiled->id).ToLocal(&cached) && cached->IsFunction()) {
+		return v8::Local<v8::Function>::Cast(cached);
+	}
+
+	v8::Local<v8::Script> script = v8::Local<v8::UnboundScript>::New(JS_ISOLATE, compiled->script)->BindToCurrentContext();
+	v8::Local<v8::Value> factory;
+	if (!script->Run(JS_CONTEXT).ToLocal(&factory)) { return v8::MaybeLocal<v8::Function>(); }
+
+	v8::Local<v8::Array> statics = v8::Array::New(JS_ISOLATE, (int) compiled->statics.size());
+	for (size_t i=0; i<compiled->statics.size(); i++) {
+		(void)statics->Set(JS_CONTEXT, (uint32_t) i, v8::Local<v8::String>::New(JS_ISOLATE, compiled->statics[i]));
+	}
+	v8::Local<v8::Value> params[1] = {statics};
+	v8::Local<v8::Value> render;
+	if (!v8::Local<v8::Function>::Cast(factory)->Call(JS_CONTEXT, JS_GLOBAL, 1, params).ToLocal(&render)) {
+		return v8::MaybeLocal<v8::Function>();
+	}
+
+	(void)renders->Set(JS_CONTEXT, compiled->id, render);
+	return v8::Local<v8::Function>::Cast(render);
+}
+
+std::string optional_string(const v8::FunctionCallbackInfo<v8::Value>& args, int index) {
+	if (args.Length() <= index || !args[index]->IsString()) { return ""; }
+	v8::String::Utf8Value str(JS_ISOLATE, args[index]);
+	return std::string(*str, str.length());
+}
+
+void set_render(const v8::FunctionCallbackInfo<v8::Value>& args, Compiled * compiled) {
+	v8::Local<v8::Function> render;
+	if (bind(compiled, v8::Local<v8::Object>::Cast(args.Data())).ToLocal(&render)) { args.GetReturnValue().Set(render); }
+}
+
+/**
+ * @param {string} file
+ * @param {string} [path] prefix for file and includes
+ * @param {string} [suffix] file extension
+ * @returns {function} render(data)
+ */
+JS_METHOD(_compileFile) {
+	if (args.Length() < 1) { JS_TYPE_ERROR("Bad argument count. Use 'compileFile(file, [path], [suffix])'"); return; }
+	std::string file = optional_string(args, 0);
+	Compiler compiler(optional_string(args, 1), optional_string(args, 2));
+	std::string name = compiler.filename(file);
+
+	Compiled * compiled = lookup(file_templates, name);
+	if (!compiled) {
+		try {
+			compiler.process(compiler.read(file), 0);
+		} catch (std::string e) {
+			JS_ERROR(e);
+			return;
+		}
+		compiled = build(compiler, name);
+		if (!compiled) { return; }
+		file_templates[name] = compiled;
+	}
+	set_render(args, compiled);
+}
+
+/**
+ * @param {string} source template text
+ * @param {string} [path] prefix for includes
+ * @param {string} [suffix] include file extension
+ * @returns {function} render(data)
+ */
+JS_METHOD(_compileString) {
+	if (args.Length() < 1) { JS_TYPE_ERROR("Bad argument count. Use 'compileString(source, [path], [suffix])'"); return; }
+	std::string source = optional_string(args, 0);
+	std::string path = optional_string(args, 1);
+	std::string suffix = optional_string(args, 2);
+	std::string key = path + '\0' + suffix + '\0' + source;
+
+	Compiled * compiled = lookup(string_templates, key);
+	if (!compiled) {
+		Compiler compiler(path, suffix);
+		try {
+			compiler.process(source, 0);
+		} catch (std::string e) {
+			JS_ERROR(e);
+			return;
+		}
+		compiled = build(compiler, "template");
+		if (!compiled) { return; }
+
+		if (string_templates.size() >= MAX_STRING_TEMPLATES) { /* generated sources; do not grow without bounds */
+			for (cache_t::iterator it = string_templates.begin(); it != string_templates.end(); it++) { delete it->second; }
+			string_templates.clear();
+		}
+		string_templates[key] = compiled;
+	}
+	set_render(args, compiled);
+}
+
+}
+
+SHARED_INIT() {
+	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
+
+	v8::Local<v8::Object> renders = v8::Object::New(JS_ISOLATE); /* lives as long as this context's exports */
+	(void)exports->Set(JS_CONTEXT, JS_STR("compileFile"), v8::FunctionTemplate::New(JS_ISOLATE, _compileFile, renders)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("compileString"), v8::FunctionTemplate::New(JS_ISOLATE, _compileString, renders)->GetFunction(JS_CONTEXT).ToLocalChecked());
+}
@@ -9,8 +9,11 @@
 #include <iostream>
 #include <ctime>
 #include <cstdlib>
+#include <climits>
 #include <array>
 #include <typeinfo>
+#include <map>
+#include <mutex>
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -18,9 +21,13 @@
 #include <openssl/hmac.h>
 
 #ifdef windows
+#  include <winsock2.h>
+#  include <ws2tcpip.h>
 #  define sock_errno WSAGetLastError()
 #  define CONN_RESET (sock_errno == WSAECONNRESET)
 #else
+#  include <sys/socket.h>
+#  include <netdb.h>
 #  define sock_errno errno
 #  define CONN_RESET (sock_errno == ECONNRESET || sock_errno == EPIPE)
 #endif 
@@ -31,12 +38,75 @@
 #define LOAD_SOCKET v8::Local<v8::Value>::Cast(LOAD_VALUE(0)->ToObject(JS_CONTEXT).ToLocalChecked()->GetInternalField(0))->Int32Value(JS_CONTEXT).ToChecked()
 #define LOAD_SSL LOAD_PTR(1, SSL *)
 #define SSL_ERROR(ssl, ret) JS_ERROR(formatError(ssl, ret).c_str())
+#define SSL_WOULD_BLOCK(ssl, ret) (SSL_get_error(ssl, ret) == SSL_ERROR_WANT_READ || SSL_get_error(ssl, ret) == SSL_ERROR_WANT_WRITE)
+
+#define SESSION_CACHE_SIZE 256
 
 namespace {
 
 bool needToCheckCertificate;
-	
-SSL_CTX * ctx;
+
+/* one context per process; SHARED_INIT runs for every new JS context */
+SSL_CTX * ctx = NULL;
+
+/**
+ * Client session cache: "host:port config" => resumable session, where config is the
+ * SSL_CTX, minimum protocol version and certificate check of the connection: a session
+ * negotiated under one configuration is never offered under another.
+ * The key is attached to each client SSL via ex_data, so that
+ * sessions (including TLS 1.3 tickets arriving after the handshake) land in the right slot.
+ */
+std::map<std::string, SSL_SESSION *> sessions;
+std::mutex sessionsMutex;
+int sessionKeyIndex = -1;
+
+void freeSessionKey(void * parent, void * ptr, CRYPTO_EX_DATA * ad, int idx, long argl, void * argp) {
+	delete (std::string *) ptr;
+}
+
+int newSession(SSL * ssl, SSL_SESSION * session) {
+	std::string * key = (std::string *) SSL_get_ex_data(ssl, sessionKeyIndex);
+	if (!key || !SSL_SESSION_is_resumable(session)) { return 0; }
+
+	std::lock_guard<std::mutex> lock(sessionsMutex);
+	std::map<std::string, SSL_SESSION *>::iterator it = sessions.find(*key);
+	if (it != sessions.end()) {
+		SSL_SESSION_free(it->second);
+		it->second = session;
+	} else {
+		if (sessions.size() >= SESSION_CACHE_SIZE) { /* drop an arbitrary entry */
+			SSL_SESSION_free(sessions.begin()->second);
+			sessions.erase(sessions.begin());
+		}
+		sessions[*key] = session;
+	}
+	return 1; /* we keep the reference */
+}
+
+/**
+ * Before the first client handshake step, key the connection by SNI host (or peer address), port
+ * and TLS configuration, and offer a cached session for resumption.
+ */
+void resumeSession(SSL * ssl, int sock) {
+	if (SSL_get_ex_data(ssl, sessionKeyIndex)) { return; } /* already done */
+
+	sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+	if (getpeername(sock, (sockaddr *) &addr, &len) != 0) { return; }
+
+	char host[NI_MAXHOST], port[NI_MAXSERV];
+	if (getnameinfo((sockaddr *) &addr, len, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0) { return; }
+	const char * name = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+	char config[64];
+	snprintf(config, sizeof(config), " %p/%ld/%d", (void *) SSL_get_SSL_CTX(ssl), (long) SSL_get_min_proto_version(ssl), needToCheckCertificate ? 1 : 0);
+	std::string * key = new std::string(name ? name : host);
+	key->append(":").append(port).append(config);
+	SSL_set_ex_data(ssl, sessionKeyIndex, key);
+
+	std::lock_guard<std::mutex> lock(sessionsMutex);
+	std::map<std::string, SSL_SESSION *>::iterator it = sessions.find(*key);
+	if (it != sessions.end()) { SSL_set_session(ssl, it->second); }
+}
 
 std::string formatError(SSL * ssl, int ret) {
 	int code = SSL_get_error(ssl, ret);
@@ -139,6 +209,21 @@ JS_METHOD(_usePrivateKey) {
 	args.GetReturnValue().Set(JS_INT(SSL_use_PrivateKey_file(LOAD_SSL, *file, SSL_FILETYPE_PEM)));
 }
 
+/**
+ * @returns {int} TLS.WANT_READ or TLS.WANT_WRITE when the last call returned false, 0 otherwise
+ */
+JS_METHOD(_want) {
+	SSL * ssl = LOAD_SSL;
+	int result = 0;
+	if (SSL_want_read(ssl)) { result = SSL_READING; }
+	if (SSL_want_write(ssl)) { result = SSL_WRITING; }
+	args.GetReturnValue().Set(JS_INT(result));
+}
+
+JS_METHOD(_isSessionReused) {
+	args.GetReturnValue().Set(JS_BOOL(SSL_session_reused(LOAD_SSL) == 1));
+}
+
 JS_METHOD(_accept) {
 	SSL * ssl = LOAD_SSL;
 	int result = SSL_accept(ssl);
@@ -154,7 +239,7 @@ JS_METHOD(_accept) {
 		}
 		
 		args.GetReturnValue().Set(args.This());
-	} else if (result == -1 && SSL_get_error(ssl, result) == SSL_ERROR_WANT_READ) { /* blocking socket */
+	} else if (result == -1 && SSL_WOULD_BLOCK(ssl, result)) { /* non-blocking socket, see want() */
 		args.GetReturnValue().Set(JS_BOOL(false));
 	} else {
 		SSL_ERROR(ssl, result);
@@ -163,6 +248,7 @@ JS_METHOD(_accept) {
 
 JS_METHOD(_connect) {
 	SSL * ssl = LOAD_SSL;
+	resumeSession(ssl, LOAD_SOCKET);
 	int result = SSL_connect(ssl);
 	if (result == 1) {
 		if (needToCheckCertificate) {
@@ -174,6 +260,8 @@ JS_METHOD(_connect) {
 			}
 		}
 		args.GetReturnValue().Set(args.This());
+	} else if (result == -1 && SSL_WOULD_BLOCK(ssl, result)) { /* non-blocking socket, see want() */
+		args.GetReturnValue().Set(JS_BOOL(false));
 	} else {
 		//printf("%d\n", result);
 		//printf("%s", formatError(ssl, result).c_str());
@@ -211,7 +299,7 @@ JS_METHOD(_receive) {
 		args.GetReturnValue().Set(buffer);
 	} else {
 		delete[] data;
-		if (SSL_get_error(ssl, (int)result) == SSL_ERROR_WANT_READ) { // blocking socket
+		if (SSL_WOULD_BLOCK(ssl, (int)result)) { // non-blocking socket
 			args.GetReturnValue().Set(JS_BOOL(false));
 		} else {
 			SSL_ERROR(ssl, (int)result);
@@ -219,6 +307,42 @@ JS_METHOD(_receive) {
 	}
 }
 
+/**
+ * Decrypt directly into an existing Buffer, without intermediate allocation.
+ * @param {Buffer} buffer
+ * @param {int} [offset=0]
+ * @param {int} [length=buffer.length-offset]
+ * @returns {int || false} Bytes read, false when it would block
+ */
+JS_METHOD(_receiveInto) {
+	SSL * ssl = LOAD_SSL;
+	char * data = NULL;
+	size_t count = 0;
+	if (!JS_BUFFER_RANGE(args, 0, &data, &count)) { return; }
+	if (count > INT_MAX) { count = INT_MAX; }
+
+	int result = SSL_read(ssl, data, (int) count);
+	if (result >= 0) {
+		if (result == 0 && SSL_get_error(ssl, result) != SSL_ERROR_ZERO_RETURN) {
+			SSL_ERROR(ssl, result);
+			return;
+		}
+		if (needToCheckCertificate) {
+			int verify_flag = (int)SSL_get_verify_result(ssl);
+			if (verify_flag != X509_V_OK) {
+				std::string certError = "Certificate verification error " + std::to_string(verify_flag) + "\n";
+				JS_ERROR(certError.c_str());
+				return;
+			}
+		}
+		args.GetReturnValue().Set(JS_INT(result));
+	} else if (SSL_WOULD_BLOCK(ssl, result)) { // non-blocking socket
+		args.GetReturnValue().Set(JS_BOOL(false));
+	} else {
+		SSL_ERROR(ssl, result);
+	}
+}
+
 JS_METHOD(_receive_strict) {
 	bool debug = false;
 	if (const char* env_d = std::getenv("PRINT_DEBUGS")) {
@@ -422,7 +546,7 @@ JS_METHOD(_send) {
 	
 	if (result > 0) {
 		args.GetReturnValue().Set(args.This());
-	} else if (SSL_get_error(ssl, (int)result) == SSL_ERROR_WANT_WRITE) { /* blocking socket */
+	} else if (SSL_WOULD_BLOCK(ssl, (int)result)) { /* non-blocking socket */
 		args.GetReturnValue().Set(JS_BOOL(false));
 	} else {
 		SSL_ERROR(ssl,(int) result);
@@ -791,17 +915,23 @@ JS_METHOD(_hash_hmac) { // algo, data, key
 
 SHARED_INIT() {
 	//fprintf(stderr,"tls.cc > SHARED_INIT						isolate=%ld, InContext()=%d, context=%ld\n",(void*)JS_ISOLATE,JS_ISOLATE->InContext(),(void*)(*JS_CONTEXT));
-	SSL_library_init();
-	SSL_load_error_strings();
-	ctx = SSL_CTX_new(SSLv23_method());
-	// SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
-	// SSL_CTX_set_cipher_list(ctx, "TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256:TLS_CHACHA20_POLY1305_SHA256");
-	// SSL_CTX_set_cipher_list(ctx, "ALL");
 	needToCheckCertificate = true;
-
-	// if (!SSL_CTX_load_verify_locations(ctx, "/etc/ssl/certs/ca-certificates.crt", "/etc/ssl/certs/")) {
-	if (!SSL_CTX_set_default_verify_paths(ctx)) {
-		JS_ERROR("CTX Certificate init failed\n");
+	if (!ctx) {
+		SSL_library_init();
+		SSL_load_error_strings();
+		ctx = SSL_CTX_new(SSLv23_method());
+		// SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+		// SSL_CTX_set_cipher_list(ctx, "TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256:TLS_CHACHA20_POLY1305_SHA256");
+		// SSL_CTX_set_cipher_list(ctx, "ALL");
+		SSL_CTX_set_mode(ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER); /* no partial writes: send() writes all or nothing */
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(ctx, newSession);
+		sessionKeyIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, freeSessionKey);
+
+		// if (!SSL_CTX_load_verify_locations(ctx, "/etc/ssl/certs/ca-certificates.crt", "/etc/ssl/certs/")) {
+		if (!SSL_CTX_set_default_verify_paths(ctx)) {
+			JS_ERROR("CTX Certificate init failed\n");
+		}
 	}
 
 	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
@@ -812,6 +942,8 @@ SHARED_INIT() {
 	ft->Set(JS_ISOLATE,"RSASign",			   v8::FunctionTemplate::New(JS_ISOLATE, _RSASign));
 	ft->Set(JS_ISOLATE,"RSAVerifySignature",   v8::FunctionTemplate::New(JS_ISOLATE, _RSAVerifySignature));
 	ft->Set(JS_ISOLATE,"HashHmac",   		   v8::FunctionTemplate::New(JS_ISOLATE, _hash_hmac));
+	ft->Set(JS_ISOLATE,"WANT_READ",			   JS_INT(SSL_READING));
+	ft->Set(JS_ISOLATE,"WANT_WRITE",		   JS_INT(SSL_WRITING));
 	
 	v8::Local<v8::ObjectTemplate> it = ft->InstanceTemplate();
 	it->SetInternalFieldCount(2); /* socket, ssl */
@@ -829,11 +961,14 @@ SHARED_INIT() {
 	pt->Set(JS_ISOLATE, "connect",             v8::FunctionTemplate::New(JS_ISOLATE, _connect));
 	pt->Set(JS_ISOLATE, "receive",             v8::FunctionTemplate::New(JS_ISOLATE, _receive));
 	pt->Set(JS_ISOLATE, "receive_strict",      v8::FunctionTemplate::New(JS_ISOLATE, _receive_strict));
+	pt->Set(JS_ISOLATE, "receiveInto",         v8::FunctionTemplate::New(JS_ISOLATE, _receiveInto));
 	pt->Set(JS_ISOLATE, "send",                v8::FunctionTemplate::New(JS_ISOLATE, _send));
 	pt->Set(JS_ISOLATE, "close",               v8::FunctionTemplate::New(JS_ISOLATE, _close));
 	pt->Set(JS_ISOLATE, "setTLSMethod",        v8::FunctionTemplate::New(JS_ISOLATE, _setTLSMethod));
 	pt->Set(JS_ISOLATE, "setCertificateCheck", v8::FunctionTemplate::New(JS_ISOLATE, _setCertificateCheck));
 	pt->Set(JS_ISOLATE, "setSNI",              v8::FunctionTemplate::New(JS_ISOLATE, _setSNI));
+	pt->Set(JS_ISOLATE, "want",                v8::FunctionTemplate::New(JS_ISOLATE, _want));
+	pt->Set(JS_ISOLATE, "isSessionReused",     v8::FunctionTemplate::New(JS_ISOLATE, _isSessionReused));
 
 	(void)exports->Set(JS_CONTEXT,JS_STR("TLS"), ft->GetFunction(JS_CONTEXT).ToLocalChecked());
 }
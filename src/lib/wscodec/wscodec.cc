@@ -0,0 +1,405 @@
+/**
+ * WebSocket frame codec (RFC 6455). Parses frame headers, unmasks payloads
+ * in place and reassembles fragmented messages; encodes outgoing frames.
+ *
+ * Payloads of frames which arrive whole are returned as views into the
+ * pushed Buffer (which gets unmasked in place); only frames split across
+ * pushes and fragmented messages are copied.
+ */
+
+#include <v8.h>
+#include "macros.h"
+#include "common.h"
+
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  include <immintrin.h>
+#  define HAVE_AVX2_TARGET
+#endif
+
+#define OP_CONTINUATION 0x0
+#define OP_TEXT 0x1
+#define OP_BINARY 0x2
+#define OP_CLOSE 0x8
+#define OP_PING 0x9
+#define OP_PONG 0xA
+
+#define CLOSE_PROTOCOL 1002
+#define CLOSE_TOO_BIG 1009
+
+#define DEFAULT_MAX_PAYLOAD (16 * 1024 * 1024)
+
+#define DECODER_PTR Decoder * decoder = LOAD_PTR(0, Decoder *)
+
+namespace {
+
+class Decoder {
+public:
+	Decoder(bool _requireMask, size_t _maxPayload) : message(NULL), messageOpcode(0), requireMask(_requireMask), maxPayload(_maxPayload) {}
+	~Decoder() { if (message) { delete message; } }
+
+	std::string pending;		/* bytes of an incomplete frame */
+	ByteStorageData * message;	/* fragments of an unfinished data message */
+	int messageOpcode;
+	bool requireMask;
+	size_t maxPayload;
+};
+
+typedef struct {
+	bool fin;
+	int opcode;
+	bool masked;
+	unsigned char mask[4];
+	uint64_t length;
+	size_t header;
+} frame_t;
+
+void Decoder_destroy(void * ptr) {
+	delete (Decoder *) ptr;
+}
+
+/**
+ * Throw an Error carrying a websocket close code
+ */
+void protocol_error(int code, const char * message) {
+	v8::Local<v8::Object> error = v8::Exception::Error(JS_STR(message))->ToObject(JS_CONTEXT).ToLocalChecked();
+	(void)error->Set(JS_CONTEXT, JS_STR("code"), JS_INT(code));
+	JS_ISOLATE->ThrowException(error);
+}
+
+/**
+ * Scalar kernel, eight bytes at a time
+ */
+inline size_t unmask_scalar(unsigned char * data, size_t length, const unsigned char * mask, size_t i) {
+	uint64_t key;
+	memcpy(&key, mask, 4);
+	memcpy(((char *) &key) + 4, mask, 4);
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		word ^= key;
+		memcpy(data + i, &word, 8);
+	}
+	for (; i < length; i++) { data[i] ^= mask[i & 3]; }
+	return i;
+}
+
+#ifdef __SSE2__
+inline size_t unmask_sse2(unsigned char * data, size_t length, const unsigned char * mask, size_t i) {
+	int32_t key;
+	memcpy(&key, mask, 4);
+	__m128i k = _mm_set1_epi32(key);
+	for (; i + 16 <= length; i += 16) {
+		__m128i v = _mm_loadu_si128((__m128i *) (data + i));
+		_mm_storeu_si128((__m128i *) (data + i), _mm_xor_si128(v, k));
+	}
+	return i;
+}
+#endif
+
+#ifdef HAVE_AVX2_TARGET
+__attribute__((target("avx2")))
+size_t unmask_avx2(unsigned char * data, size_t length, const unsigned char * mask, size_t i) {
+	int32_t key;
+	memcpy(&key, mask, 4);
+	__m256i k = _mm256_set1_epi32(key);
+	for (; i + 32 <= length; i += 32) {
+		__m256i v = _mm256_loadu_si256((__m256i *) (data + i));
+		_mm256_storeu_si256((__m256i *) (data + i), _mm256_xor_si256(v, k));
+	}
+	return i;
+}
+
+bool has_avx2() {
+	static int supported = -1;
+	if (supported == -1) { supported = (__builtin_cpu_supports("avx2") ? 1 : 0); }
+	return supported == 1;
+}
+#endif
+
+/**
+ * XOR payload with the 4-byte masking key, in place. Every kernel keeps
+ * i a multiple of four, so the key never needs rotating.
+ */
+void unmask(unsigned char * data, size_t length, const unsigned char * mask) {
+	size_t i = 0;
+#ifdef HAVE_AVX2_TARGET
+	if (length >= 64 && has_avx2()) { i = unmask_avx2(data, length, mask, i); }
+#endif
+#ifdef __SSE2__
+	i = unmask_sse2(data, length, mask, i);
+#endif
+	unmask_scalar(data, length, mask, i);
+}
+
+/**
+ * @returns {int} 1 header parsed, 0 need more data, -1 protocol error (thrown)
+ */
+int parse_header(const unsigned char * p, size_t available, frame_t * frame, Decoder * decoder) {
+	if (available < 2) { return 0; }
+	frame->fin = (p[0] & 0x80);
+	frame->opcode = (p[0] & 0x0F);
+	frame->masked = (p[1] & 0x80);
+	frame->length = (p[1] & 0x7F);
+	size_t header = 2;
+
+	if (p[0] & 0x70) { protocol_error(CLOSE_PROTOCOL, "Reserved bits must be zero"); return -1; }
+	if (frame->opcode > OP_BINARY && frame->opcode < OP_CLOSE) { protocol_error(CLOSE_PROTOCOL, "Unknown opcode"); return -1; }
+	if (frame->opcode > OP_PONG) { protocol_error(CLOSE_PROTOCOL, "Unknown opcode"); return -1; }
+	if (decoder->requireMask && !frame->masked) { protocol_error(CLOSE_PROTOCOL, "Client must mask frames"); return -1; }
+
+	if (frame->length == 0x7E) {
+		if (available < header + 2) { return 0; }
+		frame->length = ((uint64_t) p[2] << 8) | p[3];
+		header += 2;
+	} else if (frame->length == 0x7F) {
+		if (available < header + 8) { return 0; }
+		if (p[2] & 0x80) { protocol_error(CLOSE_PROTOCOL, "Invalid payload length"); return -1; }
+		frame->length = 0;
+		for (int i=0; i<8; i++) { frame->length = (frame->length << 8) | p[2+i]; }
+		header += 8;
+	}
+
+	if (frame->opcode & 0x8) {
+		if (!frame->fin || frame->length > 125) { protocol_error(CLOSE_PROTOCOL, "Invalid control frame"); return -1; }
+	} else if (frame->opcode == OP_CONTINUATION) {
+		if (!decoder->message) { protocol_error(CLOSE_PROTOCOL, "No frame to be continued"); return -1; }
+	} else if (decoder->message) {
+		protocol_error(CLOSE_PROTOCOL, "Frames must not interleave");
+		return -1;
+	}
+
+	uint64_t total = frame->length + (frame->opcode == OP_CONTINUATION ? decoder->message->getLength() : 0);
+	if (total > decoder->maxPayload) { protocol_error(CLOSE_TOO_BIG, "Message too big"); return -1; }
+
+	if (frame->masked) {
+		if (available < header + 4) { return 0; }
+		memcpy(frame->mask, p + header, 4);
+		header += 4;
+	}
+	frame->header = header;
+	return 1;
+}
+
+void push_message(v8::Local<v8::Array> result, int opcode, v8::Local<v8::Value> payload) {
+	v8::Local<v8::Object> item = v8::Object::New(JS_ISOLATE);
+	(void)item->Set(JS_CONTEXT, JS_STR("opcode"), JS_INT(opcode));
+	(void)item->Set(JS_CONTEXT, JS_STR("payload"), payload);
+	(void)result->Set(JS_CONTEXT, result->Length(), item);
+}
+
+/**
+ * Consume as many complete frames as possible.
+ * @param {ByteStorage *} source When not NULL, data lives in this storage and whole frames become views
+ * @returns {ssize_t} bytes consumed, -1 on (thrown) error
+ */
+ssize_t decode(Decoder * decoder, unsigned char * data, size_t length, ByteStorage * source, v8::Local<v8::Array> result) {
+	size_t offset = 0;
+	while (offset < length) {
+		frame_t frame;
+		int status = parse_header(data + offset, length - offset, &frame, decoder);
+		if (status == -1) { return -1; }
+		if (status == 0 || length - offset - frame.header < frame.length) { break; } /* incomplete */
+
+		unsigned char * payload = data + offset + frame.header;
+		size_t payloadLength = (size_t) frame.length;
+		if (frame.masked) { unmask(payload, payloadLength, frame.mask); }
+
+		if (frame.opcode == OP_CONTINUATION || (!frame.fin && !(frame.opcode & 0x8))) { /* fragmented data message */
+			if (!decoder->message) {
+				decoder->message = new ByteStorageData(0, 0);
+				decoder->messageOpcode = frame.opcode;
+			}
+			decoder->message->add((const char *) payload, payloadLength);
+			if (frame.fin) {
+				ByteStorageData * message = decoder->message;
+				decoder->message = NULL;
+				push_message(result, decoder->messageOpcode, BYTESTORAGE_TO_JS(new ByteStorage(message)));
+			}
+		} else if (source) {
+			size_t start = (size_t) ((char *) payload - source->getData());
+			push_message(result, frame.opcode, BYTESTORAGE_TO_JS(new ByteStorage(source, start, start + payloadLength)));
+		} else {
+			push_message(result, frame.opcode, JS_BUFFER((const char *) payload, payloadLength));
+		}
+
+		offset += frame.header + payloadLength;
+	}
+	return (ssize_t) offset;
+}
+
+/**
+ * @param {bool} [requireMask=true] Server side: reject unmasked frames
+ * @param {int} [maxPayload=16MB] Largest accepted message
+ */
+JS_METHOD(_decoder) {
+	ASSERT_CONSTRUCTOR;
+	bool requireMask = (args.Length() > 0 && !args[0]->IsUndefined() ? args[0]->BooleanValue(JS_ISOLATE) : true);
+	size_t maxPayload = DEFAULT_MAX_PAYLOAD;
+	if (args.Length() > 1 && args[1]->IsNumber()) { maxPayload = (size_t) args[1]->IntegerValue(JS_CONTEXT).ToChecked(); }
+
+	Decoder * decoder = new Decoder(requireMask, maxPayload);
+	SAVE_PTR(0, decoder);
+	GC * gc = GC_PTR;
+	gc->add(args.This(), Decoder_destroy, 0);
+	args.GetReturnValue().Set(args.This());
+}
+
+/**
+ * Feed received bytes.
+ * @param {Buffer} data Unmasked in place
+ * @returns {object[]} Complete messages and control frames: {opcode, payload}
+ */
+JS_METHOD(_push) {
+	DECODER_PTR;
+	if (args.Length() < 1 || !IS_BUFFER(args[0])) { JS_TYPE_ERROR("Invalid call format. Use 'decoder.push(buffer)'"); return; }
+
+	ByteStorage * bs = JS_TO_BYTESTORAGE(args[0]);
+	v8::Local<v8::Array> result = v8::Array::New(JS_ISOLATE);
+	ssize_t used;
+
+	if (decoder->pending.empty()) {
+		used = decode(decoder, (unsigned char *) bs->getData(), bs->getLength(), bs, result);
+		if (used == -1) { return; }
+		if ((size_t) used < bs->getLength()) { decoder->pending.assign(bs->getData() + used, bs->getLength() - used); }
+	} else {
+		decoder->pending.append(bs->getData(), bs->getLength());
+		used = decode(decoder, (unsigned char *) &decoder->pending[0], decoder->pending.length(), NULL, result);
+		if (used == -1) { return; }
+		decoder->pending.erase(0, (size_t) used);
+	}
+
+	args.GetReturnValue().Set(result);
+}
+
+/**
+ * @returns {bool} Whether a partial frame or message is buffered
+ */
+JS_METHOD(_isPending) {
+	DECODER_PTR;
+	args.GetReturnValue().Set(JS_BOOL(!decoder->pending.empty() || decoder->message));
+}
+
+size_t write_header(unsigned char * p, int opcode, size_t length, bool fin) {
+	p[0] = (fin ? 0x80 : 0) | (opcode & 0x0F);
+	if (length < 0x7E) {
+		p[1] = (unsigned char) length;
+		return 2;
+	}
+	if (length <= 0xFFFF) {
+		p[1] = 0x7E;
+		p[2] = (unsigned char) (length >> 8);
+		p[3] = (unsigned char) length;
+		return 4;
+	}
+	p[1] = 0x7F;
+	uint64_t l = length;
+	for (int i=7; i>=0; i--) {
+		p[2+i] = (unsigned char) (l & 0xFF);
+		l >>= 8;
+	}
+	return 10;
+}
+
+/**
+ * @param {int} opcode
+ * @param {int} length Payload length
+ * @param {bool} [fin=true]
+ * @returns {Buffer} Frame header, to be sent together with the payload (e.g. socket.sendv)
+ */
+JS_METHOD(_header) {
+	if (args.Length() < 2) { JS_TYPE_ERROR("Invalid call format. Use 'header(opcode, length, [fin])'"); return; }
+	int opcode = args[0]->Int32Value(JS_CONTEXT).ToChecked();
+	size_t length = (size_t) args[1]->IntegerValue(JS_CONTEXT).ToChecked();
+	bool fin = (args.Length() > 2 ? args[2]->BooleanValue(JS_ISOLATE) : true);
+
+	unsigned char header[10];
+	size_t size = write_header(header, opcode, length, fin);
+	args.GetReturnValue().Set(JS_BUFFER((const char *) header, size));
+}
+
+/**
+ * @param {int} opcode
+ * @param {Buffer || string} [payload]
+ * @param {bool} [fin=true]
+ * @returns {Buffer} Complete unmasked frame
+ */
+JS_METHOD(_encode) {
+	if (args.Length() < 1) { JS_TYPE_ERROR("Invalid call format. Use 'encode(opcode, [payload], [fin])'"); return; }
+	int opcode = args[0]->Int32Value(JS_CONTEXT).ToChecked();
+	bool fin = (args.Length() > 2 ? args[2]->BooleanValue(JS_ISOLATE) : true);
+
+	const char * data = NULL;
+	size_t length = 0;
+	std::string str;
+	if (args.Length() > 1 && IS_BUFFER(args[1])) {
+		data = JS_BUFFER_TO_CHAR(args[1], &length);
+	} else if (args.Length() > 1 && !args[1]->IsUndefined() && !args[1]->IsNull()) {
+		v8::String::Utf8Value utf(JS_ISOLATE, args[1]);
+		str.assign(*utf, utf.length());
+		data = str.data();
+		length = str.length();
+	}
+
+	unsigned char header[10];
+	size_t headerLength = write_header(header, opcode, length, fin);
+	ByteStorage * bs = new ByteStorage(headerLength + length);
+	memcpy(bs->getData(), header, headerLength);
+	if (length) { memcpy(bs->getData() + headerLength, data, length); }
+	args.GetReturnValue().Set(BYTESTORAGE_TO_JS(bs));
+}
+
+/**
+ * XOR a Buffer region with a masking key, in place.
+ * @param {Buffer} buffer
+ * @param {Buffer} mask Four bytes
+ * @param {int} [offset=0]
+ * @param {int} [length]
+ */
+JS_METHOD(_unmask) {
+	if (args.Length() < 2 || !IS_BUFFER(args[0]) || !IS_BUFFER(args[1])) { JS_TYPE_ERROR("Invalid call format. Use 'unmask(buffer, mask, [offset], [length])'"); return; }
+	size_t size = 0, maskSize = 0;
+	unsigned char * data = (unsigned char *) JS_BUFFER_TO_CHAR(args[0], &size);
+	unsigned char * mask = (unsigned char *) JS_BUFFER_TO_CHAR(args[1], &maskSize);
+	if (maskSize < 4) { JS_RANGE_ERROR("Mask must have four bytes"); return; }
+
+	size_t offset = (args.Length() > 2 ? (size_t) args[2]->IntegerValue(JS_CONTEXT).FromMaybe(0) : 0);
+	if (offset > size) { JS_RANGE_ERROR("Offset out of range"); return; }
+	size_t length = size - offset;
+	if (args.Length() > 3 && !args[3]->IsUndefined()) {
+		length = (size_t) args[3]->IntegerValue(JS_CONTEXT).FromMaybe(0);
+		if (length > size - offset) { JS_RANGE_ERROR("Length out of range"); return; }
+	}
+
+	unmask(data + offset, length, mask);
+	args.GetReturnValue().Set(args[0]);
+}
+
+}
+
+SHARED_INIT() {
+	v8::HandleScope handle_scope(JS_ISOLATE);//v8::LocalScope handle_scope(JS_ISOLATE);
+
+	v8::Local<v8::FunctionTemplate> ft = v8::FunctionTemplate::New(JS_ISOLATE, _decoder);
+	ft->SetClassName(JS_STR("Decoder"));
+
+	v8::Local<v8::ObjectTemplate> it = ft->InstanceTemplate();
+	it->SetInternalFieldCount(1); /* decoder */
+
+	v8::Local<v8::ObjectTemplate> pt = ft->PrototypeTemplate();
+
+	/**
+	 * Prototype methods (new Decoder().*)
+	 */
+	pt->Set(JS_ISOLATE, "push"		, v8::FunctionTemplate::New(JS_ISOLATE, _push));
+	pt->Set(JS_ISOLATE, "isPending"	, v8::FunctionTemplate::New(JS_ISOLATE, _isPending));
+
+	(void)exports->Set(JS_CONTEXT, JS_STR("Decoder"), ft->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("header"), v8::FunctionTemplate::New(JS_ISOLATE, _header)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("encode"), v8::FunctionTemplate::New(JS_ISOLATE, _encode)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)exports->Set(JS_CONTEXT, JS_STR("unmask"), v8::FunctionTemplate::New(JS_ISOLATE, _unmask)->GetFunction(JS_CONTEXT).ToLocalChecked());
+}
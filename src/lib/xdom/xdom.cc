@@ -8,12 +8,14 @@
 #include <map>
 #include <cstdio>
 #include <cstring>
+#include <cstddef>
 #include <sstream>
 
 #include <v8.h>
 #include <v8-debug.h>
 #include "macros.h"
 #include "gc.h"
+#include "metrics.h"
 
 #include <xercesc/util/PlatformUtils.hpp>
 #include <xercesc/dom/DOM.hpp>
@@ -42,6 +44,32 @@ namespace xdom {
 
   bool initialized = 0;
 
+  /**
+   * Xerces heap; everything it holds (mostly documents) is counted
+   * as external memory, see Metrics::external(). V8 is told only at
+   * the end of the request: a GC started from here would run
+   * destructors in the middle of a Xerces call.
+   */
+  class CountingMemoryManager : public xercesc_3_1::MemoryManager {
+  public:
+    MemoryManager * getExceptionMemoryManager() { return this; }
+    void * allocate(XMLSize_t size) {
+      /* the header keeps the size, padded to keep the block aligned */
+      char * block = (char *) malloc(size + sizeof(std::max_align_t));
+      if (!block) { throw xercesc_3_1::OutOfMemoryException(); }
+      *((XMLSize_t *) block) = size;
+      Metrics::external(Metrics::XDOM, size, false);
+      return block + sizeof(std::max_align_t);
+    }
+    void deallocate(void * p) {
+      if (!p) { return; }
+      char * block = (char *) p - sizeof(std::max_align_t);
+      Metrics::external(Metrics::XDOM, -(int64_t) *((XMLSize_t *) block), false);
+      free(block);
+    }
+  };
+  CountingMemoryManager memory;
+
   //using namespace std;
   using namespace xercesc_3_1;
   //XERCES_CPP_NAMESPACE_USE;
@@ -301,7 +329,7 @@ namespace xdom {
       JS_RETURN_ERROR("[_domsource()] ERROR: Incorrect number of input parameters");
     ASSERT_CONSTRUCTOR;
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     SAVE_PTR(0, NULL);
@@ -328,7 +356,7 @@ namespace xdom {
       JS_RETURN_ERROR("[_domsourcegetdomimplementation()] ERROR: Incorrect number of input parameters");
     }
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     DOMSOURCE;
@@ -351,7 +379,7 @@ namespace xdom {
       JS_RETURN_ERROR("[_domsourcegetdomimplementationlist()] ERROR: Incorrect number of input parameters");
     }
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     DOMSOURCE;
@@ -385,7 +413,7 @@ namespace xdom {
       JS_RETURN_ERROR("[_domreg()] ERROR: Incorrect number of input parameters");
     ASSERT_CONSTRUCTOR;
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     SAVE_PTR(0, NULL);
@@ -420,7 +448,7 @@ namespace xdom {
     }
     //DOMREG;
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     DOMImplementation * dom = NULL;
@@ -446,7 +474,7 @@ namespace xdom {
     }
     //DOMREG;
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     DOMImplementationList * domlist = NULL;
@@ -470,7 +498,7 @@ namespace xdom {
       JS_RETURN_ERROR("[_domregaddsource()] ERROR: Incorrect number of input parameters");
     }
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     DOMREG;
@@ -1465,7 +1493,7 @@ namespace xdom {
     }
     ASSERT_CONSTRUCTOR;
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     SAVE_PTR(0, NULL);
@@ -1506,7 +1534,7 @@ namespace xdom {
     *adopt = false;
     ASSERT_CONSTRUCTOR;
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     SAVE_PTR(0, NULL);
@@ -1578,7 +1606,7 @@ namespace xdom {
     }
     ASSERT_CONSTRUCTOR;
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     SAVE_PTR(0, NULL);
@@ -1617,7 +1645,7 @@ namespace xdom {
     }
     ASSERT_CONSTRUCTOR;
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     SAVE_PTR(0, NULL);
@@ -1855,7 +1883,7 @@ namespace xdom {
     }
     ASSERT_CONSTRUCTOR;
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     SAVE_PTR(0, NULL);
@@ -2333,7 +2361,7 @@ namespace xdom {
     }
     ASSERT_CONSTRUCTOR;
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     SAVE_PTR(0, NULL);
@@ -2367,7 +2395,7 @@ namespace xdom {
       JS_RETURN_ERROR("[_domuserdatahandlerhandle()] ERROR: Incorrect number of input parameters");
     }
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     USERDATAHANDLER;
@@ -2420,7 +2448,7 @@ namespace xdom {
     }
     ASSERT_CONSTRUCTOR;
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     GC * gc = GC_PTR;
@@ -2589,7 +2617,7 @@ namespace xdom {
     ASSERT_CONSTRUCTOR;
     // initialize the XML library
     if (xdom::initialized!=true) {
-      xercesc_3_1::XMLPlatformUtils::Initialize();
+      xercesc_3_1::XMLPlatformUtils::Initialize(XMLUni::fgXercescDefaultLocale, 0, 0, &xdom::memory);
       xdom::initialized=true;
     }
     GC * gc = GC_PTR;
@@ -48,6 +48,7 @@ v8::Local<v8::Value> JS_ERROR(const std::string& data);
 #define GLOBAL_PROTO v8::Local<v8::Object>::Cast(JS_GLOBAL->GetPrototype())
 #define APP_PTR reinterpret_cast<TeaJS_App *>(v8::Local<v8::External>::Cast(GLOBAL_PROTO->GetInternalField(0))->Value())
 #define GC_PTR reinterpret_cast<GC *>(v8::Local<v8::External>::Cast(GLOBAL_PROTO->GetInternalField(1))->Value())
+#define METRICS_PTR reinterpret_cast<Metrics *>(v8::Local<v8::External>::Cast(GLOBAL_PROTO->GetInternalField(2))->Value())
 
 #define ASSERT_CONSTRUCTOR if (!args.IsConstructCall()) { JS_ERROR("Invalid call format. Please use the 'new' operator."); return; }
 #define ASSERT_NOT_CONSTRUCTOR if (args.IsConstructCall()) { return JS_ERROR("Invalid call format. Please do not use the 'new' operator."); }
@@ -100,6 +101,26 @@ inline bool IS_BUFFER(v8::Local<v8::Value> value) {
 	}
 }
 
+/**
+ * Resolve a Buffer argument and optional (offset, length) arguments after it.
+ * @returns {bool} false when a JS exception was thrown
+ */
+inline bool JS_BUFFER_RANGE(const v8::FunctionCallbackInfo<v8::Value>& args, int index, char ** data, size_t * length) {
+	if (!IS_BUFFER(args[index])) { JS_TYPE_ERROR("First argument must be a Buffer"); return false; }
+	size_t size = 0;
+	char * base = JS_BUFFER_TO_CHAR(args[index], &size);
+	size_t offset = (args.Length() > index + 1 ? (size_t) args[index + 1]->IntegerValue(JS_CONTEXT).FromMaybe(0) : 0);
+	if (offset > size) { JS_RANGE_ERROR("Offset out of range"); return false; }
+	size_t count = size - offset;
+	if (args.Length() > index + 2 && !args[index + 2]->IsUndefined()) {
+		count = (size_t) args[index + 2]->IntegerValue(JS_CONTEXT).FromMaybe(0);
+		if (count > size - offset) { JS_RANGE_ERROR("Length out of range"); return false; }
+	}
+	*data = base + offset;
+	*length = count;
+	return true;
+}
+
 inline void READ(FILE * stream, size_t amount, const v8::FunctionCallbackInfo<v8::Value>& args) {
 	std::string data;
 	size_t size = 0;
@@ -0,0 +1,166 @@
+/**
+ * Per-process request metrics in the Prometheus text format.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <unistd.h>
+#include "metrics.h"
+
+/* upper bucket bounds, seconds; +Inf is implied */
+static const double bounds[METRICS_BUCKETS] = { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+static const char * phase_names[Metrics::PHASES] = { "context", "prepare", "config", "main", "finish" };
+static const char * external_names[Metrics::EXTERNALS] = { "buffer", "pgsql", "xdom" };
+static int64_t externals[Metrics::EXTERNALS] = { 0, 0, 0 };
+static int64_t unreported = 0; /* external() deltas V8 was not told about yet */
+static std::string dump_file; /* last file written by Metrics::dump() */
+
+/* a finished process must not be reported forever; FastCGI workers end with exit() */
+static void remove_dump() {
+	if (!dump_file.length()) { return; }
+	unlink(dump_file.c_str());
+	dump_file.clear();
+}
+
+static void histogram(std::stringstream & out, const char * name, const std::string & labels, const Metrics::Histogram & h) {
+	unsigned long cumulative = 0;
+	for (int i=0; i<METRICS_BUCKETS; i++) {
+		cumulative += h.buckets[i];
+		out << name << "_bucket{" << labels << ",le=\"" << bounds[i] << "\"} " << cumulative << "\n";
+	}
+	out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << h.count << "\n";
+	out << name << "_sum{" << labels << "} " << h.sum / 1000 << "\n";
+	out << name << "_count{" << labels << "} " << h.count << "\n";
+}
+
+Metrics::Histogram::Histogram() : count(0), sum(0) {
+	for (int i=0; i<METRICS_BUCKETS; i++) { this->buckets[i] = 0; }
+}
+
+void Metrics::Histogram::observe(double ms) {
+	this->count++;
+	this->sum += ms;
+	for (int i=0; i<METRICS_BUCKETS; i++) {
+		if (ms <= bounds[i] * 1000) {
+			this->buckets[i]++;
+			break;
+		}
+	}
+}
+
+Metrics::Timer::Timer(Metrics * metrics, const char * name) : metrics(metrics), name(name), start(Metrics::now()) {
+}
+
+Metrics::Timer::~Timer() {
+	this->metrics->call(this->name, Metrics::now() - this->start);
+}
+
+Metrics::Metrics() : requests(0), errors(0), bytes_written(0), last_dump(0) {
+}
+
+Metrics::~Metrics() {
+	remove_dump();
+}
+
+double Metrics::now() {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Metrics::call(const char * name, double ms) {
+	this->calls[name].observe(ms);
+}
+
+void Metrics::external(external_t kind, int64_t delta, bool report) {
+	externals[kind] += delta;
+	if (!report) {
+		unreported += delta;
+		return;
+	}
+	v8::Isolate * isolate = v8::Isolate::GetCurrent();
+	if (isolate) { isolate->AdjustAmountOfExternalAllocatedMemory(delta); }
+}
+
+void Metrics::report_external() {
+	v8::Isolate * isolate = v8::Isolate::GetCurrent();
+	if (!unreported || !isolate) { return; }
+	isolate->AdjustAmountOfExternalAllocatedMemory(unreported);
+	unreported = 0;
+}
+
+int64_t Metrics::external(external_t kind) {
+	return externals[kind];
+}
+
+std::string Metrics::prometheus(v8::Isolate * isolate, GC & gc) {
+	std::stringstream out;
+	std::stringstream pid;
+	pid << "pid=\"" << getpid() << "\"";
+	std::string labels = pid.str();
+
+	out << "# TYPE teajs_requests_total counter\n";
+	out << "teajs_requests_total{" << labels << "} " << this->requests << "\n";
+	out << "# TYPE teajs_request_errors_total counter\n";
+	out << "teajs_request_errors_total{" << labels << "} " << this->errors << "\n";
+	out << "# TYPE teajs_output_bytes_total counter\n";
+	out << "teajs_output_bytes_total{" << labels << "} " << this->bytes_written << "\n";
+
+	out << "# TYPE teajs_request_seconds histogram\n";
+	histogram(out, "teajs_request_seconds", labels, this->request);
+	out << "# TYPE teajs_phase_seconds histogram\n";
+	for (int i=0; i<PHASES; i++) {
+		histogram(out, "teajs_phase_seconds", labels + ",phase=\"" + phase_names[i] + "\"", this->phases[i]);
+	}
+	out << "# TYPE teajs_module_load_seconds histogram\n";
+	histogram(out, "teajs_module_load_seconds", labels, this->modules);
+
+	out << "# TYPE teajs_native_call_seconds histogram\n";
+	for (std::map<std::string, Histogram>::iterator it = this->calls.begin(); it != this->calls.end(); it++) {
+		histogram(out, "teajs_native_call_seconds", labels + ",call=\"" + it->first + "\"", it->second);
+	}
+
+	out << "# TYPE teajs_gc_pauses_total counter\n";
+	out << "teajs_gc_pauses_total{" << labels << ",when=\"request\"} " << gc.inside.count << "\n";
+	out << "teajs_gc_pauses_total{" << labels << ",when=\"idle\"} " << gc.outside.count << "\n";
+	out << "# TYPE teajs_gc_pause_seconds_total counter\n";
+	out << "teajs_gc_pause_seconds_total{" << labels << ",when=\"request\"} " << gc.inside.time / 1000 << "\n";
+	out << "teajs_gc_pause_seconds_total{" << labels << ",when=\"idle\"} " << gc.outside.time / 1000 << "\n";
+	out << "# TYPE teajs_gc_idle_collections_total counter\n";
+	out << "teajs_gc_idle_collections_total{" << labels << "} " << gc.idle_collections << "\n";
+
+	v8::HeapStatistics stats;
+	isolate->GetHeapStatistics(&stats);
+	out << "# TYPE teajs_heap_used_bytes gauge\n";
+	out << "teajs_heap_used_bytes{" << labels << "} " << stats.used_heap_size() << "\n";
+	out << "# TYPE teajs_heap_total_bytes gauge\n";
+	out << "teajs_heap_total_bytes{" << labels << "} " << stats.total_heap_size() << "\n";
+	out << "# TYPE teajs_heap_external_bytes gauge\n";
+	out << "teajs_heap_external_bytes{" << labels << "} " << stats.external_memory() << "\n";
+	out << "# TYPE teajs_native_bytes gauge\n";
+	for (int i=0; i<EXTERNALS; i++) {
+		out << "teajs_native_bytes{" << labels << ",kind=\"" << external_names[i] << "\"} " << externals[i] << "\n";
+	}
+
+	return out.str();
+}
+
+void Metrics::dump(const std::string & dir, v8::Isolate * isolate, GC & gc) {
+	double time = Metrics::now();
+	if (!dir.length() || time - this->last_dump < 1000) { return; }
+	this->last_dump = time;
+
+	std::stringstream name;
+	name << dir << "/teajs-" << getpid() << ".prom";
+	std::string tmp = name.str() + ".tmp";
+	std::string data = this->prometheus(isolate, gc);
+
+	/* rename() so that collectors never see a partial file */
+	FILE * file = fopen(tmp.c_str(), "wb");
+	if (!file) { return; }
+	fwrite(data.c_str(), sizeof(char), data.length(), file);
+	fclose(file);
+	if (rename(tmp.c_str(), name.str().c_str()) != 0) { return; }
+	if (!dump_file.length()) { atexit(remove_dump); }
+	dump_file = name.str();
+}
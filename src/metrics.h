@@ -0,0 +1,81 @@
+/**
+ * Per-process request metrics: phase timings, module loads, output size and native
+ * call latency, exported in the Prometheus text format.
+ */
+
+#ifndef _JS_METRICS_H
+#define _JS_METRICS_H
+
+#include <string>
+#include <map>
+#include "v8.h"
+#include "gc.h"
+
+#define METRICS_BUCKETS 14
+
+class Metrics {
+public:
+	/* latency distribution with fixed buckets, see METRICS_BUCKETS in metrics.cc */
+	class Histogram {
+	public:
+		Histogram();
+		void observe(double ms);
+		unsigned long count;
+		double sum; /* ms */
+		unsigned long buckets[METRICS_BUCKETS]; /* non-cumulative */
+	};
+
+	/**
+	 * Measures the lifetime of a native call:
+	 * Metrics::Timer timer(METRICS_PTR, "pgsql.query");
+	 */
+	class Timer {
+	public:
+		Timer(Metrics * metrics, const char * name);
+		~Timer();
+	private:
+		Metrics * metrics;
+		const char * name;
+		double start;
+	};
+
+	typedef enum { CONTEXT, PREPARE, CONFIG, MAIN, FINISH, PHASES } phase_t;
+
+	Metrics();
+	virtual ~Metrics();
+
+	unsigned long requests;
+	unsigned long errors;
+	unsigned long long bytes_written;
+	Histogram request;
+	Histogram phases[PHASES];
+	Histogram modules; /* require() of modules not in the export cache, nested loads included */
+
+	void call(const char * name, double ms);
+
+	/* native memory outside the V8 heap, by owner */
+	typedef enum { BUFFER, PGSQL, XDOM, EXTERNALS } external_t;
+	/**
+	 * Account native memory (negative delta when freed). V8 is told as well, so that
+	 * collecting the JS objects which own it is not postponed. Needs no context.
+	 * report = false only counts; the delta reaches V8 with the next report_external().
+	 * Use it where V8 must not run (a GC could start), e.g. inside allocators.
+	 */
+	static void external(external_t kind, int64_t delta, bool report = true);
+	/* tell V8 about deltas counted with report = false; called at the end of a request */
+	static void report_external();
+	static int64_t external(external_t kind);
+	/* all metrics in the Prometheus text exposition format */
+	std::string prometheus(v8::Isolate * isolate, GC & gc);
+	/* write prometheus() to <dir>/teajs-<pid>.prom, at most once per second; removed by the destructor or at exit */
+	void dump(const std::string & dir, v8::Isolate * isolate, GC & gc);
+
+	/* monotonic time, ms */
+	static double now();
+
+private:
+	std::map<std::string, Histogram> calls;
+	double last_dump;
+};
+
+#endif
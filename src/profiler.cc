@@ -0,0 +1,246 @@
+/**
+ * Per-request CPU profiling, written as .cpuprofile (Chrome DevTools) or folded stacks;
+ * heap sampling (.heapprofile) and snapshots (.heapsnapshot).
+ */
+
+#include <cstdio>
+#include <sstream>
+#include <unistd.h>
+#include "profiler.h"
+#include "macros.h"
+
+static std::string json_string(const char * str) {
+	std::string result = "\"";
+	for (const char * p = str; *p; p++) {
+		unsigned char ch = (unsigned char) *p;
+		switch (ch) {
+			case '"': result += "\\\""; break;
+			case '\\': result += "\\\\"; break;
+			case '\n': result += "\\n"; break;
+			case '\r': result += "\\r"; break;
+			case '\t': result += "\\t"; break;
+			default:
+				if (ch < 0x20) {
+					char buf[8];
+					snprintf(buf, sizeof(buf), "\\u%04x", ch);
+					result += buf;
+				} else {
+					result += (char) ch;
+				}
+			break;
+		}
+	}
+	result += "\"";
+	return result;
+}
+
+static std::string frame_name(const v8::CpuProfileNode * node) {
+	std::string name = node->GetFunctionNameStr();
+	if (!name.length()) { name = "(anonymous)"; }
+	std::string url = node->GetScriptResourceNameStr();
+	if (url.length()) {
+		std::stringstream ss;
+		ss << name << " (" << url << ":" << node->GetLineNumber() << ")";
+		name = ss.str();
+	}
+	return name;
+}
+
+static void cpuprofile_nodes(const v8::CpuProfileNode * node, std::stringstream & out, bool first) {
+	if (!first) { out << ","; }
+	/* DevTools expects 0-based positions */
+	out << "{\"id\":" << node->GetNodeId();
+	out << ",\"callFrame\":{\"functionName\":" << json_string(node->GetFunctionNameStr());
+	out << ",\"scriptId\":\"" << node->GetScriptId() << "\"";
+	out << ",\"url\":" << json_string(node->GetScriptResourceNameStr());
+	out << ",\"lineNumber\":" << node->GetLineNumber() - 1;
+	out << ",\"columnNumber\":" << node->GetColumnNumber() - 1 << "}";
+	out << ",\"hitCount\":" << node->GetHitCount();
+	out << ",\"children\":[";
+	int count = node->GetChildrenCount();
+	for (int i=0; i<count; i++) {
+		if (i) { out << ","; }
+		out << node->GetChild(i)->GetNodeId();
+	}
+	out << "]}";
+	for (int i=0; i<count; i++) { cpuprofile_nodes(node->GetChild(i), out, false); }
+}
+
+static void folded_stacks(const v8::CpuProfileNode * node, std::string stack, std::stringstream & out) {
+	if (node->GetParent()) { /* the root node is not a frame */
+		if (stack.length()) { stack += ";"; }
+		stack += frame_name(node);
+		if (node->GetHitCount()) { out << stack << " " << node->GetHitCount() << "\n"; }
+	}
+	int count = node->GetChildrenCount();
+	for (int i=0; i<count; i++) { folded_stacks(node->GetChild(i), stack, out); }
+}
+
+static void heapprofile_node(v8::AllocationProfile::Node * node, std::stringstream & out) {
+	v8::String::Utf8Value name(v8::Isolate::GetCurrent(), node->name);
+	v8::String::Utf8Value url(v8::Isolate::GetCurrent(), node->script_name);
+	size_t self = 0;
+	for (unsigned int i=0; i<node->allocations.size(); i++) {
+		self += node->allocations[i].size * node->allocations[i].count;
+	}
+
+	out << "{\"callFrame\":{\"functionName\":" << json_string(*name ? *name : "");
+	out << ",\"scriptId\":\"" << node->script_id << "\"";
+	out << ",\"url\":" << json_string(*url ? *url : "");
+	out << ",\"lineNumber\":" << node->line_number - 1;
+	out << ",\"columnNumber\":" << node->column_number - 1 << "}";
+	out << ",\"selfSize\":" << self << ",\"id\":" << node->node_id << ",\"children\":[";
+	for (unsigned int i=0; i<node->children.size(); i++) {
+		if (i) { out << ","; }
+		heapprofile_node(node->children[i], out);
+	}
+	out << "]}";
+}
+
+/**
+ * Streams a heap snapshot into a file
+ */
+class SnapshotFile : public v8::OutputStream {
+public:
+	SnapshotFile(FILE * file) : file(file) {}
+	void EndOfStream() {}
+	WriteResult WriteAsciiChunk(char * data, int size) {
+		return (fwrite(data, sizeof(char), size, this->file) == (size_t) size ? kContinue : kAbort);
+	}
+private:
+	FILE * file;
+};
+
+Profiler::Profiler() : format(CPUPROFILE), every(0), interval(1000), heap_interval(512 * 1024), profiler(NULL), requests(0), written(0), active(false), heap_active(false) {
+}
+
+Profiler::~Profiler() {
+	if (this->profiler) { this->profiler->Dispose(); }
+}
+
+bool Profiler::start(v8::Isolate * isolate, bool requested) {
+	if (this->active || !this->dir.length()) { return false; }
+	this->requests++;
+	if (!requested && !(this->every && this->requests % this->every == 0)) { return false; }
+
+	if (!this->profiler) { this->profiler = v8::CpuProfiler::New(isolate); }
+	this->profiler->SetSamplingInterval(this->interval);
+	this->profiler->StartProfiling(v8::String::Empty(isolate), true);
+	this->active = true;
+	return true;
+}
+
+void Profiler::stop(v8::Isolate * isolate) {
+	if (!this->active) { return; }
+	this->active = false;
+
+	v8::HandleScope handle_scope(isolate);
+	v8::CpuProfile * profile = this->profiler->StopProfiling(v8::String::Empty(isolate));
+	if (!profile) { return; }
+
+	std::string data = (this->format == FOLDED ? this->write_folded(profile) : this->write_cpuprofile(profile));
+	profile->Delete();
+	write_file(this->filename(this->format == FOLDED ? ".folded" : ".cpuprofile"), data);
+}
+
+bool Profiler::heap_sampling() {
+	return this->heap_active;
+}
+
+void Profiler::start_heap_sampling(v8::Isolate * isolate) {
+	if (this->heap_active) { return; }
+	this->heap_active = isolate->GetHeapProfiler()->StartSamplingHeapProfiler(this->heap_interval);
+}
+
+void Profiler::stop_heap_sampling(v8::Isolate * isolate) {
+	if (!this->heap_active) { return; }
+	this->heap_active = false;
+
+	v8::HandleScope handle_scope(isolate);
+	v8::HeapProfiler * heap_profiler = isolate->GetHeapProfiler();
+	v8::AllocationProfile * profile = heap_profiler->GetAllocationProfile();
+	heap_profiler->StopSamplingHeapProfiler();
+	if (!profile) { return; }
+
+	std::string data = this->write_heapprofile(profile);
+	delete profile;
+	if (!this->dir.length()) {
+		fprintf(stderr, "Heap profile discarded: Config.profileDir is not set\n");
+		return;
+	}
+	write_file(this->filename(".heapprofile"), data);
+}
+
+bool Profiler::write_heap_snapshot(v8::Isolate * isolate, const std::string & path) {
+	FILE * file = fopen(path.c_str(), "wb");
+	if (!file) { return false; }
+
+	v8::HandleScope handle_scope(isolate);
+	const v8::HeapSnapshot * snapshot = isolate->GetHeapProfiler()->TakeHeapSnapshot();
+	SnapshotFile stream(file);
+	snapshot->Serialize(&stream, v8::HeapSnapshot::kJSON);
+	const_cast<v8::HeapSnapshot *>(snapshot)->Delete();
+	return (fclose(file) == 0);
+}
+
+std::string Profiler::filename(const char * ext) {
+	std::stringstream name;
+	name << this->dir << "/teajs-" << getpid() << "-" << ++this->written << ext;
+	return name.str();
+}
+
+bool Profiler::write_file(const std::string & name, const std::string & data) {
+	FILE * file = fopen(name.c_str(), "wb");
+	if (!file) {
+		fprintf(stderr, "Cannot write profile '%s'\n", name.c_str());
+		return false;
+	}
+	fwrite(data.c_str(), sizeof(char), data.length(), file);
+	fclose(file);
+	return true;
+}
+
+std::string Profiler::write_cpuprofile(v8::CpuProfile * profile) {
+	std::stringstream out;
+	out << "{\"nodes\":[";
+	cpuprofile_nodes(profile->GetTopDownRoot(), out, true);
+	out << "],\"startTime\":" << profile->GetStartTime();
+	out << ",\"endTime\":" << profile->GetEndTime();
+
+	int count = profile->GetSamplesCount();
+	out << ",\"samples\":[";
+	for (int i=0; i<count; i++) {
+		if (i) { out << ","; }
+		out << profile->GetSample(i)->GetNodeId();
+	}
+	out << "],\"timeDeltas\":[";
+	int64_t last = profile->GetStartTime();
+	for (int i=0; i<count; i++) {
+		if (i) { out << ","; }
+		int64_t ts = profile->GetSampleTimestamp(i);
+		out << ts - last;
+		last = ts;
+	}
+	out << "]}";
+	return out.str();
+}
+
+std::string Profiler::write_folded(v8::CpuProfile * profile) {
+	std::stringstream out;
+	folded_stacks(profile->GetTopDownRoot(), "", out);
+	return out.str();
+}
+
+std::string Profiler::write_heapprofile(v8::AllocationProfile * profile) {
+	std::stringstream out;
+	out << "{\"head\":";
+	heapprofile_node(profile->GetRootNode(), out);
+	out << ",\"samples\":[";
+	const std::vector<v8::AllocationProfile::Sample> & samples = profile->GetSamples();
+	for (unsigned int i=0; i<samples.size(); i++) {
+		if (i) { out << ","; }
+		out << "{\"size\":" << samples[i].size * samples[i].count << ",\"nodeId\":" << samples[i].node_id << ",\"ordinal\":" << samples[i].sample_id << "}";
+	}
+	out << "]}";
+	return out.str();
+}
@@ -0,0 +1,65 @@
+/**
+ * Per-request CPU profiling. A request is profiled when asked for (see TeaJS_App::prepare)
+ * or when it is the Nth one; the profile is written to a directory as a Chrome DevTools
+ * .cpuprofile or as folded stacks (flamegraph.pl input).
+ * Heap profiling spans requests: sampling runs until stopped (e.g. by SIGUSR2, see
+ * TeaJS_App::idle) and writes a .heapprofile; heap snapshots are taken on demand.
+ */
+
+#ifndef _JS_PROFILER_H
+#define _JS_PROFILER_H
+
+#include <string>
+#include "v8.h"
+#include "v8-profiler.h"
+
+class Profiler {
+public:
+	Profiler();
+	virtual ~Profiler();
+
+	/* output formats */
+	typedef enum { CPUPROFILE, FOLDED } format_t;
+
+	/* where to write profiles; empty = profiling off */
+	std::string dir;
+	format_t format;
+	/* profile every Nth request; 0 = only requested ones */
+	unsigned int every;
+	/* sampling interval, microseconds */
+	int interval;
+
+	/**
+	 * Start profiling the current request, if due
+	 * @param {bool} requested profile regardless of "every"
+	 * @returns {bool} whether profiling started
+	 */
+	bool start(v8::Isolate * isolate, bool requested);
+	/* stop profiling and write the profile; does nothing when not started */
+	void stop(v8::Isolate * isolate);
+
+	/* bytes allocated between heap samples */
+	uint64_t heap_interval;
+	bool heap_sampling();
+	void start_heap_sampling(v8::Isolate * isolate);
+	/* stop sampling and write the allocation profile of objects still alive */
+	void stop_heap_sampling(v8::Isolate * isolate);
+	/* @returns {bool} whether the snapshot was written */
+	static bool write_heap_snapshot(v8::Isolate * isolate, const std::string & path);
+
+private:
+	v8::CpuProfiler * profiler;
+	unsigned int requests;
+	unsigned int written;
+	bool active;
+	bool heap_active;
+
+	/* next output file name in dir */
+	std::string filename(const char * ext);
+	static bool write_file(const std::string & name, const std::string & data);
+	std::string write_cpuprofile(v8::CpuProfile * profile);
+	std::string write_folded(v8::CpuProfile * profile);
+	std::string write_heapprofile(v8::AllocationProfile * profile);
+};
+
+#endif
@@ -85,7 +85,7 @@ JS_METHOD(_readline) {
  * @param {string||Buffer} String or Buffer
  */
 JS_METHOD(_write_stdout) {
-	WRITE(stdout, args[0]);
+	METRICS_PTR->bytes_written += WRITE(stdout, args[0]);
 	args.GetReturnValue().Set(v8::Local<v8::Function>::New(JS_ISOLATE, js_stdout));
 }
 
@@ -97,7 +97,7 @@ JS_METHOD(_write_stderr) {
 JS_METHOD(_writeline_stdout) {
 	v8::Local<v8::Value> str = args[0];
 	if (!args.Length()) { str = JS_STR(""); }
-	WRITE_LINE(stdout, str);
+	METRICS_PTR->bytes_written += WRITE_LINE(stdout, str);
 	args.GetReturnValue().Set(v8::Local<v8::Function>::New(JS_ISOLATE, js_stdout));
 }
 
@@ -122,11 +122,25 @@ JS_METHOD(_getppid) {
 
 #if defined(FASTCGI_JS)
 JS_METHOD(_FCGI_Accept) {
-	if (fcgi_pre_accepted) {
+	if (fcgi_pre_accepted) { /* first request was accepted by main() */
 		args.GetReturnValue().Set(1);
 		fcgi_pre_accepted=0;
+		return;
 	}
-	args.GetReturnValue().Set(FCGI_Accept());
+	TeaJS_App * app = APP_PTR;
+	app->gc.request_end();
+	app->idle();
+	int result = FCGI_Accept();
+	if (result >= 0) { app->gc.request_start(); }
+	args.GetReturnValue().Set(result);
+}
+
+/**
+ * Complete the current FastCGI response; work done afterwards does not delay the client
+ */
+JS_METHOD(_FCGI_Finish) {
+	FCGI_Finish();
+	args.GetReturnValue().SetUndefined();
 }
 #endif
 
@@ -189,6 +203,53 @@ JS_METHOD(_heap_statistics) {
 	(void)result->Set(JS_CONTEXT,JS_STR("total_physical_size"), JS_BIGINT(heap_statistics.total_physical_size()));
 	(void)result->Set(JS_CONTEXT,JS_STR("used_heap_size"), JS_BIGINT(heap_statistics.used_heap_size()));
 	(void)result->Set(JS_CONTEXT,JS_STR("heap_size_limit"), JS_BIGINT(heap_statistics.heap_size_limit()));
+	(void)result->Set(JS_CONTEXT,JS_STR("external_memory"), JS_BIGINT(heap_statistics.external_memory()));
+
+	/* native memory held by buffers, database results and DOM documents */
+	v8::Local<v8::Object> native = v8::Object::New(JS_ISOLATE);
+	(void)native->Set(JS_CONTEXT,JS_STR("buffer"), JS_BIGINT(Metrics::external(Metrics::BUFFER)));
+	(void)native->Set(JS_CONTEXT,JS_STR("pgsql"), JS_BIGINT(Metrics::external(Metrics::PGSQL)));
+	(void)native->Set(JS_CONTEXT,JS_STR("xdom"), JS_BIGINT(Metrics::external(Metrics::XDOM)));
+	(void)result->Set(JS_CONTEXT,JS_STR("native"), native);
+
+	args.GetReturnValue().Set(result);
+}
+
+/**
+ * Write a heap snapshot (open in Chrome DevTools, Memory tab)
+ * @param {string} path file name, conventionally *.heapsnapshot
+ * @returns {bool} success
+ */
+JS_METHOD(_writeHeapSnapshot) {
+	if (!args.Length()) {
+		JS_TYPE_ERROR("Bad argument count. Use 'system.writeHeapSnapshot(path)'");
+		return;
+	}
+	v8::String::Utf8Value path(JS_ISOLATE, args[0]);
+	args.GetReturnValue().Set(JS_BOOL(Profiler::write_heap_snapshot(JS_ISOLATE, *path)));
+}
+
+/**
+ * Request metrics in the Prometheus text format
+ */
+JS_METHOD(_metrics) {
+	TeaJS_App * app = APP_PTR;
+	std::string result = app->metrics.prometheus(JS_ISOLATE, app->gc);
+	args.GetReturnValue().Set(JS_STR_LEN(result.c_str(), (int) result.length()));
+}
+
+/**
+ * GC pauses during requests and between them
+ */
+JS_METHOD(_gc_statistics) {
+	GC * gc = GC_PTR;
+	v8::Local<v8::Object> result = v8::Object::New(JS_ISOLATE);
+
+	(void)result->Set(JS_CONTEXT,JS_STR("inside_count"), JS_INT(gc->inside.count));
+	(void)result->Set(JS_CONTEXT,JS_STR("inside_time"), JS_FLOAT(gc->inside.time));
+	(void)result->Set(JS_CONTEXT,JS_STR("outside_count"), JS_INT(gc->outside.count));
+	(void)result->Set(JS_CONTEXT,JS_STR("outside_time"), JS_FLOAT(gc->outside.time));
+	(void)result->Set(JS_CONTEXT,JS_STR("idle_collections"), JS_INT(gc->idle_collections));
 
 	args.GetReturnValue().Set(result);
 }
@@ -259,12 +320,16 @@ void setup_system(v8::Local<v8::Object> global, char ** envp, std::string mainfi
 	(void)system->Set(JS_CONTEXT,JS_STR("usleep"), v8::FunctionTemplate::New(JS_ISOLATE, _usleep)->GetFunction(JS_CONTEXT).ToLocalChecked());
 	(void)system->Set(JS_CONTEXT,JS_STR("gc"), v8::FunctionTemplate::New(JS_ISOLATE, _gc)->GetFunction(JS_CONTEXT).ToLocalChecked());
 	(void)system->Set(JS_CONTEXT,JS_STR("heap_statistics"), v8::FunctionTemplate::New(JS_ISOLATE, _heap_statistics)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)system->Set(JS_CONTEXT,JS_STR("gc_statistics"), v8::FunctionTemplate::New(JS_ISOLATE, _gc_statistics)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)system->Set(JS_CONTEXT,JS_STR("metrics"), v8::FunctionTemplate::New(JS_ISOLATE, _metrics)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)system->Set(JS_CONTEXT,JS_STR("writeHeapSnapshot"), v8::FunctionTemplate::New(JS_ISOLATE, _writeHeapSnapshot)->GetFunction(JS_CONTEXT).ToLocalChecked());
 	(void)system->Set(JS_CONTEXT,JS_STR("getTimeInMicroseconds"), v8::FunctionTemplate::New(JS_ISOLATE, _getTimeInMicroseconds)->GetFunction(JS_CONTEXT).ToLocalChecked());
 	(void)system->Set(JS_CONTEXT,JS_STR("env"), env);
 	(void)system->Set(JS_CONTEXT,JS_STR("version"), JS_STR(STRING(VERSION)));
 	
 #if defined(FASTCGI_JS)
 	(void)system->Set(JS_CONTEXT,JS_STR("FCGI_Accept"), v8::FunctionTemplate::New(JS_ISOLATE, _FCGI_Accept)->GetFunction(JS_CONTEXT).ToLocalChecked());
+	(void)system->Set(JS_CONTEXT,JS_STR("FCGI_Finish"), v8::FunctionTemplate::New(JS_ISOLATE, _FCGI_Finish)->GetFunction(JS_CONTEXT).ToLocalChecked());
 	(void)system->Set(JS_CONTEXT,JS_STR("reextract_env"), v8::FunctionTemplate::New(JS_ISOLATE, _reextract_env)->GetFunction(JS_CONTEXT).ToLocalChecked());
 #endif
 
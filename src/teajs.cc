@@ -72,6 +72,24 @@ private:
 	const char * executableName() {
 		return this->argv0.c_str();
 	}
+
+	/**
+	 * Report the error and complete the response, so that onexit callbacks and cleanup run after the client is served
+	 */
+	bool end_response(const std::string & error) {
+		if (error.length()) {
+			FILE * target = (this->show_errors ? stdout : stderr);
+			fwrite((void *) error.c_str(), sizeof(char), error.length(), target);
+			fwrite((void *) "\n", sizeof(char), 1, target);
+		}
+#ifdef FASTCGI
+		FCGI_SetExitStatus(this->exit_code);
+		FCGI_Finish();
+#else
+		fflush(stdout);
+#endif
+		return true;
+	}
 	
 	/**
 	 * Process command line arguments.
@@ -179,6 +197,11 @@ private:
 		FCGI_SetExitStatus(0);
 		exit(0); 
 	}
+
+	/* start/stop the sampling heap profiler after the current request */
+	void handle_sigusr2(int param) {
+		heap_sampling_toggle = 1;
+	}
 #endif
 
 extern char ** environ;
@@ -212,8 +235,15 @@ int main(int argc, char ** argv) {
 #  ifdef SIGUSR1
 	signal(SIGUSR1, handle_sigusr1);
 #  endif
+#  ifdef SIGUSR2
+	signal(SIGUSR2, handle_sigusr2);
+#  endif
 # endif
 
+#if defined(FASTCGI) || defined(FASTCGI_JS)
+	cgi.preload(environ); /* before the first accept: no client waits for this */
+#endif
+
 #ifdef FASTCGI_JS
 	FCGI_Accept();
 	fcgi_pre_accepted=1;
@@ -241,7 +271,7 @@ int main(int argc, char ** argv) {
 		}
 		
 #ifdef FASTCGI
-		FCGI_SetExitStatus(cgi.exit_code);
+		cgi.idle(); /* response was completed by end_response(); prepare for the next one */
 	}
 #endif
 	MAIN_DEBUG("step 6");
@@ -27,3 +27,27 @@ exports.testToString = function() {
 	assert.equal(s.toString('utf-8'),'abc','toString("utf-8")');
 }
 
+
+exports.testBase64 = function() {
+	var s=new Buffer("xyzqwer",'utf-8');
+	assert.equal(s.toString('base64'),'eHl6cXdlcg==','toString("base64")');
+	assert.equal(s.toString('base64url'),'eHl6cXdlcg','toString("base64url") is unpadded');
+	assert.equal(new Buffer('eHl6cXdl\r\ncg==','base64').toString('utf-8'),'xyzqwer','decode skips line breaks');
+	assert.equal(new Buffer([251,255]).toString('base64url'),'-_8','url alphabet');
+	assert.equal(new Buffer('-_8','base64url')[1],255,'decode url alphabet');
+	assert.throws(function() { new Buffer('eH*l','base64'); },null,'bad base64 characters');
+
+	var large=[];
+	for (var i=0;i<1000;i++) { large.push((i*7) & 0xFF); }
+	var roundtrip=new Buffer(new Buffer(large).toString('base64'),'base64');
+	assert.equal(roundtrip.length,1000,'large roundtrip length');
+	for (var i=0;i<1000;i++) { assert.equal(roundtrip[i],large[i],'large roundtrip byte '+i); }
+}
+
+exports.testHex = function() {
+	var s=new Buffer([0,15,16,255]);
+	assert.equal(s.toString('hex'),'000f10ff','toString("hex")');
+	assert.equal(s.toString('hex',1,3),'0f10','toString("hex") range');
+	assert.equal(new Buffer('0F10FF','hex')[2],255,'decode uppercase hex');
+	assert.throws(function() { new Buffer('abc','hex'); },null,'odd number of digits');
+}
@@ -0,0 +1,42 @@
+/**
+ * This file tests the crypto module.
+ */
+
+var assert = require("assert");
+var crypto = require("crypto");
+var Buffer = require("binary").Buffer;
+
+exports.testDigest = function() {
+	assert.equal(crypto.digest("md5", "", "hex"), "d41d8cd98f00b204e9800998ecf8427e", "md5 empty");
+	assert.equal(crypto.digest("sha1", "abc123\n", "hex"), "61ee8b5601a84d5154387578466c8998848ba089", "sha1 string");
+	assert.equal(crypto.digest("sha256", "abc", "hex"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", "sha256");
+
+	var raw = crypto.digest("sha256", new Buffer("abc", "utf-8"));
+	assert.ok(raw instanceof Buffer, "buffer output by default");
+	assert.equal(raw.length, 32, "sha256 length");
+	assert.equal(raw[0], 0xba, "first byte");
+}
+
+exports.testIncremental = function() {
+	var hash = new crypto.Hash("sha1");
+	hash.update("abc").update(new Buffer("123\n", "utf-8"));
+	assert.equal(hash.digest("hex"), "61ee8b5601a84d5154387578466c8998848ba089", "pieces equal one-shot");
+	assert.throws(function() { hash.update("x"); }, Error, "finalized");
+}
+
+exports.testHmac = function() {
+	var expected = "f9bb6c561e49e17a479bd5746411e43efef798e0";
+	assert.equal(crypto.hmac("sha1", "secret", "Testing message.", "hex"), expected, "one-shot hmac");
+	var hmac = new crypto.Hmac("sha1", new Buffer("secret", "utf-8"));
+	hmac.update("Testing ").update("message.");
+	assert.equal(hmac.digest("hex"), expected, "incremental hmac");
+}
+
+exports.testChecksums = function() {
+	assert.equal(crypto.crc32c("123456789"), 0xe3069283, "crc32c check value");
+	assert.equal(crypto.crc32c("56789", crypto.crc32c("1234")), 0xe3069283, "crc32c chaining");
+	assert.equal(crypto.xxh32(""), 0x02cc5d05, "xxh32 empty");
+	assert.equal(crypto.xxh32("123456789"), 0x937bad67, "xxh32");
+	assert.equal(crypto.xxh64("abc", 0, "hex"), "44bc2cf5ad770999", "xxh64");
+	assert.equal(crypto.xxh64("").length, 8, "xxh64 buffer output");
+}
@@ -0,0 +1,49 @@
+/**
+ * This file tests the native json module.
+ */
+
+var assert = require("assert");
+var json = require("json");
+var Buffer = require("binary").Buffer;
+
+exports.testStringify = function() {
+	var value = {a:[1, -2.5, "x\"y\n", null, true], b:{c:"žluťoučký 😀"}, d:undefined, e:function() {}};
+	assert.equal(json.stringify(value).toString("utf-8"), JSON.stringify(value), "same output as JSON.stringify");
+	assert.equal(json.stringify([undefined, NaN, new Date(0)]).toString("utf-8"), '[null,null,"1970-01-01T00:00:00.000Z"]', "null for skipped items, toJSON");
+	assert.equal(json.stringify("\ud800").toString("utf-8"), '"\\ud800"', "lone surrogate is escaped");
+	assert.equal(json.stringify(undefined), undefined, "undefined is not serialized");
+	var large = [1e20, Math.pow(2, 60), -Math.pow(2, 53), 9007199254740991];
+	assert.equal(json.stringify(large).toString("utf-8"), JSON.stringify(large), "integers above 2^53 as JSON.stringify");
+
+	var cycle = {};
+	cycle.self = cycle;
+	assert.throws(function() { json.stringify(cycle); }, TypeError, "circular structure");
+}
+
+exports.testWrite = function() {
+	var chunks = [];
+	var stream = { write: function(buffer) { chunks.push(buffer.toString("utf-8")); } };
+	var items = [];
+	for (var i=0;i<1000;i++) { items.push({id:i, name:"item " + i}); }
+
+	var written = json.write(items, stream, 1024);
+	assert.ok(chunks.length > 1, "output is chunked");
+	assert.equal(chunks.join(""), JSON.stringify(items), "chunks form the whole document");
+	assert.equal(written, chunks.join("").length, "written byte count");
+}
+
+exports.testParse = function() {
+	var text = '{"a":[1,-0.5,1e3,"\\u0041\\ud83d\\ude00"],"__proto__":{"x":1}," é":null,"t":true}';
+	var result = json.parse(new Buffer(text, "utf-8"));
+	assert.equal(JSON.stringify(result), JSON.stringify(JSON.parse(text)), "same result as JSON.parse");
+	assert.equal(result.a[3], "A😀", "escapes");
+	assert.ok(Object.prototype.hasOwnProperty.call(result, "__proto__"), "__proto__ is an own property");
+
+	var buffer = new Buffer('xx[1,2]yy', "utf-8");
+	assert.equal(json.parse(buffer, 2, 7).length, 2, "parse a range");
+	assert.equal(json.parse("[3]")[0], 3, "strings are accepted");
+
+	assert.throws(function() { json.parse(new Buffer("[1,]", "utf-8")); }, SyntaxError, "trailing comma");
+	assert.throws(function() { json.parse(new Buffer('{"a":1', "utf-8")); }, SyntaxError, "unexpected end");
+	assert.throws(function() { json.parse(new Buffer('"a\tb"', "utf-8")); }, SyntaxError, "control character");
+}
@@ -0,0 +1,72 @@
+/**
+ * This file tests the "query" module.
+ */
+
+var assert = require("assert");
+var query = require("query");
+var Query = query.Query;
+var Table = query.Table;
+
+var db = {
+	escape: function(str) { return String(str).replace(/'/g, "''"); },
+	qualify: function(str) { return "`" + str + "`"; }
+};
+
+exports.testToString = function() {
+	Query.setDB(db);
+	var q = new Table("user").select("user.name").where("%f = %s AND %f > %n", "login", "o'neil", "age", "18.5").order("%f DESC", "id").limit(10);
+	assert.equal(q.toString(), "SELECT `user`.`name` FROM `user` AS `user` WHERE `login` = 'o''neil' AND `age` > 18.5   ORDER BY `id` DESC LIMIT 10 ", "inline values");
+	assert.equal(new Query(Query.SELECT).table("t").where("a LIKE '%%x' AND b = %n", "bad").toString(), "SELECT * FROM `t` AS `t` WHERE a LIKE '%x' AND b = 0     ", "%% and NaN");
+}
+
+exports.testParams = function() {
+	Query.setDB(db);
+	var q = new Table("user").update({name:"x", age:3}).where("%f = %n", "id", 7);
+	var p = q.toParams();
+	assert.equal(p.text, "UPDATE `user` SET `name`=$1, `age`=$2 WHERE `id` = 7   ", "placeholders, numbers inline");
+	assert.equal(JSON.stringify(p.values), '["x",3]', "values");
+	assert.equal(new Table("t").select("*").where("%f > %n", "age", "18.5").toParams().text.indexOf("> 18.5") != -1, true, "fractional number inline");
+	assert.equal(new Table("t").select("*").where("%f > %n", "age", Math.pow(2, 60)).toParams().text.indexOf("> " + Math.pow(2, 60)) != -1, true, "large number as toString()");
+	assert.equal(q.toString(), "UPDATE `user` SET `name`='x', `age`='3' WHERE `id` = 7   ", "inline rendering still works");
+
+	Query.setDB({escape: db.escape});
+	assert.equal(new Table("my\"table").select("a.*").toString(), "SELECT \"a\".* FROM \"my\"\"table\" AS \"my\"\"table\"      ", "default quoting");
+}
+
+exports.testExecute = function() {
+	var calls = [];
+	var fake = {
+		escape: db.escape,
+		queryParams: function(text, values) { calls.push("params"); },
+		query: function(text) { calls.push("query"); },
+		prepare: function(name, text) { calls.push("prepare"); },
+		execute: function(name, values) { calls.push("execute"); }
+	};
+	Query.setDB(fake);
+	for (var i=0;i<3;i++) { new Table("t").select("*").where("%f = %s", "name", "x" + i).execute(); }
+	assert.equal(calls.join(","), "params,prepare,execute,execute", "repeated text is prepared");
+
+	calls = [];
+	for (var i=0;i<3;i++) { new Table("t").select("*").where("%f = %s AND %f = %n", "name", "x", "id", i).execute(); }
+	assert.equal(calls.join(","), "params,params,params", "texts with inlined numbers are not prepared");
+	assert.equal(fake._statements.used, 0, "nor counted");
+
+	var max = Query.MAX_USES;
+	Query.MAX_USES = 2;
+	for (var i=0;i<5;i++) { new Table("t" + i).select("*").where("%f = %s", "name", "x").execute(); }
+	assert.equal(fake._statements.used <= 2, true, "uses are capped");
+	Query.MAX_USES = max;
+	Query.setDB(db);
+}
+
+exports.testFilter = function() {
+	if (!query.filter) { return; }
+	var rows = [];
+	for (var i=0;i<100;i++) { rows.push({id:i, name:"n" + (i % 10), flag:(i % 3 == 0)}); }
+
+	var result = query.filter(rows, ["and", [">=", ["col", "id"], ["val", 90]], ["!=", ["col", "name"], ["val", "n5"]]]);
+	assert.equal(result.length, 9, "numeric and string comparison");
+	result = query.filter(rows, ["or", ["in", ["col", "name"], [["val", "n1"], ["val", "n2"]]], ["col", "flag"]]);
+	assert.equal(result.length, 48, "in, or, truthiness");
+	assert.equal(query.filter(rows, ["<", ["col", "id"], ["val", "5"]]), null, "mixed types are left to JS");
+}
@@ -0,0 +1,94 @@
+/**
+ * This file tests the RESP parser and encoder.
+ */
+
+var assert = require("assert");
+var RESP = require("resp");
+var Buffer = require("binary").Buffer;
+
+var bytes = function(str) {
+	return new Buffer(str, "utf-8");
+}
+
+exports.testResp2 = function() {
+	var parser = new RESP.Parser();
+	var replies = parser.push(bytes("+OK\r\n:42\r\n$5\r\nhe\r\no\r\n$-1\r\n*2\r\n$1\r\na\r\n*-1\r\n-ERR wrong\r\n"));
+	assert.equal(replies.length, 6, "six replies");
+	assert.equal(replies[0], "OK", "simple string");
+	assert.equal(replies[1], 42, "integer");
+	assert.ok(replies[2] instanceof Buffer, "bulk string is a Buffer");
+	assert.equal(replies[2].toString("utf-8"), "he\r\no", "binary-safe bulk");
+	assert.equal(replies[3], null, "null bulk");
+	assert.equal(replies[4][0].toString("utf-8"), "a", "array item");
+	assert.equal(replies[4][1], null, "null array");
+	assert.ok(replies[5] instanceof Error, "error reply");
+	assert.equal(replies[5].message, "ERR wrong", "error message");
+}
+
+exports.testIncremental = function() {
+	var parser = new RESP.Parser(false);
+	var data = "*3\r\n$3\r\nfoo\r\n:7\r\n$3\r\nbar\r\n";
+	var replies = [];
+	for (var i=0;i<data.length;i++) {
+		replies = replies.concat(parser.push(bytes(data.charAt(i))));
+		if (i < data.length-1) { assert.equal(replies.length, 0, "incomplete at " + i); }
+	}
+	assert.equal(replies.length, 1, "one reply");
+	assert.equal(replies[0].join(","), "foo,7,bar", "strings mode");
+	assert.equal(parser.isPending(), false, "nothing left");
+}
+
+exports.testChunkedBulk = function() {
+	var parser = new RESP.Parser();
+	var size = 256 * 1024;
+	var body = new Buffer(size);
+	body.fill(120);
+	var replies = parser.push(bytes("*2\r\n:1\r\n$" + size + "\r\n"));
+	assert.equal(replies.length, 0, "array still open");
+	for (var i=0;i<size;i+=1000) {
+		replies = replies.concat(parser.push(body.slice(i, Math.min(i + 1000, size))));
+	}
+	replies = replies.concat(parser.push(bytes("\r\n+OK\r\n")));
+	assert.equal(replies.length, 2, "array and following reply");
+	assert.equal(replies[0][0], 1, "item parsed before the bulk");
+	assert.equal(replies[0][1].length, size, "bulk length");
+	assert.equal(replies[0][1][size - 1], 120, "bulk content");
+	assert.equal(replies[1], "OK", "reply after the bulk");
+	assert.equal(parser.isPending(), false, "nothing left");
+}
+
+exports.testCopies = function() {
+	var parser = new RESP.Parser(true, false);
+	var input = bytes("$3\r\nabc\r\n");
+	var replies = parser.push(input.range(0, input.length));
+	input.fill(0);
+	assert.equal(replies[0].toString("utf-8"), "abc", "reply does not alias the input");
+}
+
+exports.testHostileLength = function() {
+	var parser = new RESP.Parser();
+	assert.equal(parser.push(bytes("*4294967294\r\n:1\r\n")).length, 0, "huge array is not preallocated");
+	assert.equal(parser.isPending(), true, "array open");
+	assert.throws(function() { new RESP.Parser().push(bytes("*99999999999999999999\r\n")); }, Error, "length overflow");
+	assert.throws(function() { new RESP.Parser().push(bytes("*4294967295\r\n")); }, Error, "length above the array limit");
+}
+
+exports.testResp3 = function() {
+	var parser = new RESP.Parser(false);
+	var replies = parser.push(bytes("%2\r\n+a\r\n:1\r\n+b\r\n#t\r\n_\r\n,3.5\r\n~1\r\n+x\r\n=8\r\ntxt:text\r\n|1\r\n+ttl\r\n:3\r\n+value\r\n"));
+	assert.equal(replies.length, 6, "six replies");
+	assert.equal(replies[0].a, 1, "map");
+	assert.equal(replies[0].b, true, "boolean");
+	assert.equal(replies[1], null, "null");
+	assert.equal(replies[2], 3.5, "double");
+	assert.equal(replies[3][0], "x", "set");
+	assert.equal(replies[4], "text", "verbatim prefix stripped");
+	assert.equal(replies[5], "value", "attribute skipped");
+}
+
+exports.testEncode = function() {
+	var encoded = RESP.encodeMany([["SET", "k", new Buffer([0, 1])], ["INCR", 5]]);
+	var expected = "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$2\r\n\x00\x01\r\n*2\r\n$4\r\nINCR\r\n$1\r\n5\r\n";
+	assert.equal(encoded.length, expected.length, "encoded length");
+	for (var i=0;i<expected.length;i++) { assert.equal(encoded[i], expected.charCodeAt(i), "byte " + i); }
+}
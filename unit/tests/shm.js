@@ -0,0 +1,66 @@
+/**
+ * This file tests the shm module.
+ */
+
+var assert = require("assert");
+var Cache = require("shm").Cache;
+var Buffer = require("binary").Buffer;
+
+var name = "unit-test-" + system.getpid();
+
+exports.testSetGet = function() {
+	var cache = new Cache(name, 1024*1024, 256);
+	assert.equal(cache.get("missing"), null, "missing key");
+	assert.equal(cache.set("a", "hello"), true, "set string");
+	assert.equal(cache.get("a"), "hello", "get string");
+	assert.equal(cache.has("a"), true, "has");
+
+	cache.set("b", new Buffer([1, 2, 3]));
+	var b = cache.get("b");
+	assert.ok(b instanceof Buffer, "buffer type preserved");
+	assert.equal(b.length, 3, "buffer length");
+	assert.equal(b[2], 3, "buffer content");
+
+	var length = cache.view("b", function(view) {
+		assert.equal(view[0], 1, "view content");
+		return view.length;
+	});
+	assert.equal(length, 3, "view length");
+	assert.equal(cache.view("missing", function() { return 1; }), null, "view of missing key");
+}
+
+exports.testBadSize = function() {
+	assert.throws(function() { new Cache(name + "-bad", 16); }, RangeError, "size smaller than the header");
+	assert.throws(function() { new Cache(name + "-bad", 1024*1024, 0); }, RangeError, "zero slot size");
+	assert.throws(function() { new Cache(name + "-bad", 1024*1024, -5); }, RangeError, "negative slot size");
+}
+
+exports.testOverwriteRemove = function() {
+	var cache = new Cache(name);
+	cache.set("a", "first");
+	cache.set("a", "second");
+	assert.equal(cache.get("a"), "second", "overwrite");
+	assert.equal(cache.remove("a"), true, "remove");
+	assert.equal(cache.get("a"), null, "removed");
+	assert.equal(cache.remove("a"), false, "remove again");
+}
+
+exports.testTooLarge = function() {
+	var cache = new Cache(name);
+	var big = new Buffer(1024);
+	assert.equal(cache.set("big", big), false, "value larger than slot");
+}
+
+exports.testEviction = function() {
+	var cache = new Cache(name);
+	cache.clear();
+	var buckets = cache.stats().buckets;
+	for (var i=0;i<buckets*2;i++) { cache.set("key" + i, "value" + i); }
+	var stats = cache.stats();
+	assert.ok(stats.used <= buckets, "used within capacity");
+	assert.ok(stats.evictions > 0, "entries were evicted");
+	assert.equal(cache.get("key" + (buckets*2-1)), "value" + (buckets*2-1), "latest entry present");
+	cache.clear();
+	assert.equal(cache.stats().used, 0, "cleared");
+	Cache.unlink(name);
+}
@@ -0,0 +1,66 @@
+/**
+ * This file tests zero-copy and batched socket I/O.
+ */
+
+var assert = require("assert");
+var Socket = require("socket").Socket;
+var Buffer = require("binary").Buffer;
+
+var port = 20000 + (system.getpid() % 20000);
+
+var pair = function() {
+	var server = new Socket(Socket.PF_INET, Socket.SOCK_DGRAM, Socket.IPPROTO_UDP);
+	server.bind("127.0.0.1", port);
+	var client = new Socket(Socket.PF_INET, Socket.SOCK_DGRAM, Socket.IPPROTO_UDP);
+	return [server, client];
+}
+
+exports.testReceiveInto = function() {
+	var sockets = pair();
+	var buffer = new Buffer(8);
+	buffer.fill(0);
+
+	sockets[1].send("abc", "127.0.0.1", port);
+	var count = sockets[0].receiveInto(buffer, 2, 4);
+	assert.equal(count, 3, "bytes read");
+	assert.equal(buffer[2], 97, "data at offset");
+	assert.equal(buffer[0], 0, "bytes before offset untouched");
+	assert.equal(sockets[0].getPeerName()[0], "127.0.0.1", "peer recorded");
+
+	assert.throws(function() { sockets[0].receiveInto(buffer, 9); }, RangeError, "offset past end");
+
+	sockets[0].close();
+	sockets[1].close();
+}
+
+exports.testBatch = function() {
+	var sockets = pair();
+	var sent = sockets[1].sendMany(["one", new Buffer([1, 2]), "three"], "127.0.0.1", port);
+	assert.equal(sent, 3, "all datagrams sent");
+
+	var buffer = new Buffer(64 * 4);
+	var peers = [];
+	var lengths = [];
+	while (lengths.length < 3) {
+		lengths = lengths.concat(sockets[0].receiveMany(buffer.range(lengths.length * 64), 64, 3 - lengths.length, peers));
+	}
+	assert.equal(lengths.join(","), "3,2,5", "message lengths");
+	assert.equal(buffer[64], 1, "second message in second slot");
+	assert.equal(peers[0][0], "127.0.0.1", "peer addresses");
+
+	sockets[0].close();
+	sockets[1].close();
+}
+
+exports.testSendv = function() {
+	var sockets = pair();
+	sockets[1].connect("127.0.0.1", port);
+	assert.equal(sockets[1].sendv([new Buffer([104, 101]), "llo"]), 5, "gathered bytes");
+
+	var buffer = new Buffer(16);
+	assert.equal(sockets[0].receiveInto(buffer), 5, "one datagram");
+	assert.equal(buffer.slice(0, 5).toString("utf-8"), "hello", "parts concatenated in order");
+
+	sockets[0].close();
+	sockets[1].close();
+}
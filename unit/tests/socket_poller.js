@@ -0,0 +1,50 @@
+/**
+ * This file tests Socket.Poller.
+ */
+
+var assert = require("assert");
+var Socket = require("socket").Socket;
+var Poller = Socket.Poller;
+
+var port = 40000 + (system.getpid() % 20000);
+
+var pair = function() {
+	var server = new Socket(Socket.PF_INET, Socket.SOCK_DGRAM, Socket.IPPROTO_UDP);
+	server.bind("127.0.0.1", port);
+	var client = new Socket(Socket.PF_INET, Socket.SOCK_DGRAM, Socket.IPPROTO_UDP);
+	return [server, client];
+}
+
+exports.testReadable = function() {
+	var sockets = pair();
+	var poller = new Poller();
+	poller.set(sockets[0], Poller.READ);
+
+	assert.equal(poller.wait(0).length, 0, "nothing pending");
+
+	sockets[1].send("x", "127.0.0.1", port);
+	var ready = poller.wait(1000);
+	assert.equal(ready.length, 1, "one ready socket");
+	assert.ok(ready[0].socket == sockets[0], "ready socket is the registered object");
+	assert.ok(ready[0].events & Poller.READ, "readable");
+
+	poller.remove(sockets[0]);
+	assert.equal(poller.wait(0).length, 0, "removed socket is not reported");
+
+	poller.close();
+	sockets[0].close();
+	sockets[1].close();
+}
+
+exports.testWritable = function() {
+	var sockets = pair();
+	var poller = new Poller();
+	poller.set(sockets[1], Poller.WRITE);
+	var ready = poller.wait(0);
+	assert.equal(ready.length, 1, "udp socket is writable");
+	assert.ok(ready[0].events & Poller.WRITE, "write bit");
+
+	poller.close();
+	sockets[0].close();
+	sockets[1].close();
+}
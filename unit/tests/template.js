@@ -19,3 +19,21 @@ exports.testTemplate = function() {
 	assert.equal(t.processString(source, data), result, "Template::processString");
 }
 
+
+exports.testFileAndInclude = function() {
+	var fs = require("fs");
+	var path = "/tmp/teajs-template-" + system.getpid() + "-";
+	var main = new fs.File(path + "main.template");
+	var part = new fs.File(path + "part.template");
+	main.open("w").write("<$include(part)> costs $5 for $(data.who)").close();
+	part.open("w").write("[$(data.a)]").close();
+
+	var t = new Template({path:path});
+	var data = {a:"x", who:"you"};
+	assert.equal(t.process("main", data), "<[x]> costs $5 for you", "Template::process with include");
+	assert.equal(t.process("main", {a:"y", who:"me"}), "<[y]> costs $5 for me", "Template::process reuses compiled template");
+
+	main.remove();
+	part.remove();
+	assert.throws(function() { t.process("main", data); }, null, "missing template file");
+}
@@ -0,0 +1,117 @@
+/**
+ * This file tests TLS transfers over a loopback connection.
+ */
+
+var assert = require("assert");
+var Socket = require("socket").Socket;
+var TLS = require("tls").TLS;
+var EL = require("eventloop");
+var Buffer = require("binary").Buffer;
+
+var port = 20000 + (system.getpid() % 20000);
+
+/**
+ * Non-blocking server and client ends of an established TLS connection
+ * @param {bool} [loop] handshake through the event loop, polling for want()
+ */
+var pair = function(loop) {
+	var listener = new Socket(Socket.PF_INET, Socket.SOCK_STREAM, Socket.IPPROTO_TCP);
+	listener.setOption(Socket.SO_REUSEADDR, true);
+	listener.bind("127.0.0.1", port);
+	listener.listen();
+	var client = new Socket(Socket.PF_INET, Socket.SOCK_STREAM, Socket.IPPROTO_TCP);
+	client.connect("127.0.0.1", port);
+	var server = listener.accept();
+	listener.close();
+	server.setBlocking(false);
+	client.setBlocking(false);
+
+	var serverTLS = new TLS(server);
+	serverTLS.useCertificate("unit/tests/texts/tls-cert.pem");
+	serverTLS.usePrivateKey("unit/tests/texts/tls-key.pem");
+	var clientTLS = new TLS(client);
+	clientTLS.setCertificateCheck(false); /* self-signed */
+
+	var accepted = false;
+	var connected = false;
+	if (loop) {
+		var timer = EL.setTimeout(EL.abort, 5000);
+		var step = function(tls, method) {
+			if (tls[method]() !== false) { return true; }
+			assert.ok(tls.want() == TLS.WANT_READ || tls.want() == TLS.WANT_WRITE, "want() after " + method);
+			EL.readSocket(function() {
+				if (tls[method]() === false) { return; }
+				EL.clearSocket(tls);
+				if (method == "accept") { accepted = true; } else { connected = true; }
+				if (accepted && connected) { EL.clearTimeout(timer); }
+			}, tls);
+			return false;
+		}
+		connected = step(clientTLS, "connect");
+		accepted = step(serverTLS, "accept");
+		if (accepted && connected) { EL.clearTimeout(timer); }
+		EL.run();
+		EL.clearTimeout(timer);
+		EL.clearSocket(clientTLS); /* after an abort */
+		EL.clearSocket(serverTLS);
+	} else {
+		for (var i=0; i<10000 && !(accepted && connected); i++) {
+			if (!accepted) { accepted = (serverTLS.accept() !== false); }
+			if (!connected) { connected = (clientTLS.connect() !== false); }
+		}
+	}
+	assert.ok(accepted && connected, "handshake finished");
+	return [serverTLS, clientTLS];
+}
+
+/* no close(): a non-blocking shutdown would wait for the peer's close_notify */
+var release = function(ends) {
+	ends[1].getSocket().close();
+	ends[0].getSocket().close();
+	ends[1].setCertificateCheck(true);
+}
+
+/* server to client; the client's read also takes TLS 1.3 session tickets */
+var transfer = function(ends) {
+	var received = new Buffer(16);
+	while (ends[0].send("ping") === false) {}
+	var count = false;
+	for (var i=0; i<10000 && count === false; i++) { count = ends[1].receiveInto(received); }
+	assert.equal(count, 4, "data after the handshake");
+}
+
+exports.testSendLarge = function() {
+	var ends = pair();
+	var length = 100 * 1024; /* several TLS records */
+	var data = new Buffer(length);
+	for (var i=0; i<length; i++) { data[i] = i & 0xFF; }
+
+	var received = new Buffer(length);
+	var offset = 0;
+	var drain = function() {
+		var count;
+		while (offset < length && (count = ends[0].receiveInto(received, offset)) !== false) { offset += count; }
+	}
+
+	/* without partial writes, a send which would block is repeated with the same data */
+	while (ends[1].send(data) === false) { drain(); }
+	for (var i=0; i<10000 && offset < length; i++) { drain(); }
+
+	assert.equal(offset, length, "all bytes arrived");
+	var same = true;
+	for (var i=0; i<length; i++) { same = same && (received[i] == data[i]); }
+	assert.ok(same, "content");
+
+	release(ends);
+}
+
+exports.testResume = function() {
+	var ends = pair();
+	transfer(ends);
+	release(ends);
+
+	ends = pair(true);
+	assert.equal(ends[1].isSessionReused(), true, "second connection to the same host and port resumes");
+	transfer(ends);
+	release(ends);
+}
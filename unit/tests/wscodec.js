@@ -0,0 +1,84 @@
+/**
+ * This file tests the native websocket frame codec.
+ */
+
+var assert = require("assert");
+var Codec = require("wscodec");
+var Buffer = require("binary").Buffer;
+
+var mask = [0x12, 0x34, 0x56, 0x78];
+
+/* build a masked client frame */
+var frame = function(opcode, bytes, fin) {
+	var header = [(fin === false ? 0 : 0x80) | opcode];
+	if (bytes.length < 126) {
+		header.push(0x80 | bytes.length);
+	} else {
+		header.push(0x80 | 126, bytes.length >> 8, bytes.length & 0xFF);
+	}
+	header = header.concat(mask);
+	for (var i=0;i<bytes.length;i++) { header.push(bytes[i] ^ mask[i % 4]); }
+	return header;
+}
+
+var range = function(length) {
+	var result = [];
+	for (var i=0;i<length;i++) { result.push(i & 0xFF); }
+	return result;
+}
+
+exports.testWholeFrames = function() {
+	var decoder = new Codec.Decoder();
+	var data = range(300);
+	var messages = decoder.push(new Buffer(frame(0x2, data).concat(frame(0x9, [1, 2]))));
+	assert.equal(messages.length, 2, "two frames");
+	assert.equal(messages[0].opcode, 0x2, "binary opcode");
+	assert.equal(messages[0].payload.length, 300, "payload length");
+	for (var i=0;i<300;i++) { assert.equal(messages[0].payload[i], data[i], "unmasked byte " + i); }
+	assert.equal(messages[1].opcode, 0x9, "ping");
+	assert.equal(decoder.isPending(), false, "nothing buffered");
+}
+
+exports.testSplitAndFragmented = function() {
+	var decoder = new Codec.Decoder();
+	var bytes = frame(0x1, [104, 101], false).concat(frame(0xA, []), frame(0x0, [108, 108, 111]));
+	var all = [];
+	for (var i=0;i<bytes.length;i++) { /* one byte at a time */
+		all = all.concat(decoder.push(new Buffer([bytes[i]])));
+	}
+	assert.equal(all.length, 2, "pong and the reassembled message");
+	assert.equal(all[0].opcode, 0xA, "control frame interleaved");
+	assert.equal(all[1].opcode, 0x1, "text opcode of first fragment");
+	assert.equal(all[1].payload.toString("utf-8"), "hello", "fragments joined");
+}
+
+var errorCode = function(decoder, bytes) {
+	try {
+		decoder.push(new Buffer(bytes));
+	} catch (e) {
+		return e.code;
+	}
+	return null;
+}
+
+exports.testProtocolErrors = function() {
+	assert.equal(errorCode(new Codec.Decoder(), [0x82, 0x01, 0x00]), 1002, "unmasked frame rejected");
+	assert.equal(errorCode(new Codec.Decoder(), frame(0x0, [1])), 1002, "continuation without message");
+	assert.equal(errorCode(new Codec.Decoder(true, 10), frame(0x2, range(20))), 1009, "oversized frame rejected");
+}
+
+exports.testEncode = function() {
+	var encoded = Codec.encode(0x1, "hi");
+	assert.equal(encoded.length, 4, "short frame");
+	assert.equal(encoded[0], 0x81, "fin + text");
+	assert.equal(encoded[1], 2, "length");
+
+	var header = Codec.header(0x2, 70000);
+	assert.equal(header.length, 10, "64-bit length header");
+	assert.equal(header[1], 0x7F, "length marker");
+	assert.equal(header[7] * 0x10000 + header[8] * 0x100 + header[9], 70000, "length bytes");
+
+	var decoder = new Codec.Decoder(false);
+	var messages = decoder.push(Codec.encode(0x2, new Buffer([9, 8, 7])));
+	assert.equal(messages[0].payload[2], 7, "roundtrip unmasked");
+}